@@ -0,0 +1,50 @@
+/*
+    Visualize whitespaces in corpus by replacing it into open box ␣.
+    And make a corpus, which is a concated long one sentence.
+    Native version of main.py, with the same output.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "cmdline.h"
+#include "preprocessor.h"
+#include "../common/corpus_store.h"
+
+int main(int argc, char* argv[]) {
+
+  // parsing parameters https://github.com/tanakh/cmdline
+  cmdline::parser a;
+  a.add<std::string>("corpus_path", '\0', "corpus path (UTF-8)", true);
+  a.add<std::string>("processed_path", '\0', "output path", true);
+  a.add<std::string>("store_path", '\0', "also write the processed corpus as a corpus store", false);
+  a.add<int64_t>("n_core", '\0', "n_core", true);
+  a.add<int64_t>("size_block", '\0', "bytes of the corpus processed at once", false, SIZE_BLOCK_DEFAULT);
+  a.parse_check(argc, argv);
+  std::string corpus_path = a.get<std::string>("corpus_path");
+  std::string processed_path = a.get<std::string>("processed_path");
+  std::string store_path = a.get<std::string>("store_path");
+  int64_t n_core = a.get<int64_t>("n_core");
+  int64_t size_block = a.get<int64_t>("size_block");
+
+  Preprocessor preprocessor(n_core, size_block);
+  if (!preprocessor.preprocess(corpus_path, processed_path)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+
+  if (!store_path.empty()) {
+    std::cout << "Saving corpus store to " << store_path << std::endl;
+    CorpusStore corpus;
+    if (!corpus.load_text(processed_path, n_core) || !corpus.save(store_path)) {
+      std::cout << "Invalid file name." << std::endl;
+      return 0;
+    }
+  }
+
+  std::cout << "Done" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,263 @@
+#include "preprocessor.h"
+
+enum CharacterType { VISIBLE, SPACE, NEWLINE, OTHER_WHITESPACE };
+
+// Same classes as main.py : str.isspace() characters are either converted into a
+// space or a newline, or only stripped at the ends of lines (OTHER_WHITESPACE).
+// '\r' is a newline since Python reads the corpus with universal newlines.
+static inline CharacterType classify(const uint32_t c)
+{
+  if (c > 0x3000) return VISIBLE;
+  switch (c) {
+    case 0x0A: case 0x0B: case 0x0C: case 0x0D:
+      return NEWLINE;
+    case 0x09: case 0x20: case 0x85: case 0xA0:
+    case 0x2028: case 0x2029: case 0x202F: case 0x205F: case 0x3000:
+      return SPACE;
+    case 0x1C: case 0x1D: case 0x1E: case 0x1F: case 0x1680:
+      return OTHER_WHITESPACE;
+  }
+  if (c >= 0x2000 && c <= 0x200A) return SPACE;
+  return VISIBLE;
+}
+
+void WhitespaceRun::append(const wchar_t c)
+{
+  if (has_newline) return;
+  const CharacterType type = classify(c);
+  if (type == NEWLINE) {
+    has_newline = true;
+    interior.clear();
+  } else if (type == SPACE) {
+    if (interior.empty() || interior.back() != L' ') interior += L' ';
+  } else {
+    interior += c;
+  }
+}
+
+void WhitespaceRun::append(const WhitespaceRun& run)
+{
+  if (run.has_newline) {
+    has_newline = true;
+    interior.clear();
+    return;
+  }
+  for (wchar_t c : run.interior) append(c);
+}
+
+void WhitespaceRun::clear()
+{
+  has_newline = false;
+  interior.clear();
+}
+
+// Appends `c`, collapsing repeated VISIBLE_SPACE
+static inline void emit(const wchar_t c, std::string& out, bool& is_last_blank)
+{
+  if (c == VISIBLE_SPACE) {
+    if (is_last_blank) return;
+    is_last_blank = true;
+  } else {
+    is_last_blank = false;
+  }
+  append_utf8(c, out);
+}
+
+// Appends the whitespace between two visible characters
+static void emit(const WhitespaceRun& run, std::string& out, bool& is_last_blank)
+{
+  if (run.has_newline) {
+    emit(VISIBLE_SPACE, out, is_last_blank);
+    return;
+  }
+  for (wchar_t c : run.interior) emit((c == L' ') ? VISIBLE_SPACE : c, out, is_last_blank);
+}
+
+// Number of bytes at the end of data[0, size) that belong to a sequence cut by `size`
+static int64_t length_cut_utf8(const unsigned char* data, const int64_t size)
+{
+  for (int64_t i=size-1; i>=0 && i>=size-3; i--) {
+    if ((data[i] & 0xC0) == 0x80) continue;
+    uint32_t code;
+    return (next_utf8(data, i, size, code) == 0) ? size - i : 0;
+  }
+  return 0;
+}
+
+Preprocessor::Preprocessor(const int64_t _n_cores, const int64_t _size_block)
+  : n_cores(_n_cores),
+    size_block(_size_block),
+    has_output(false),
+    is_last_blank(false)
+{
+  assert(n_cores > 0);
+  assert(size_block > 0);
+}
+
+Preprocessor::~Preprocessor() {}
+
+bool Preprocessor::preprocess(const std::string corpus_path, const std::string processed_path)
+{
+  std::ifstream fin(corpus_path, std::ios::binary | std::ios::ate);
+  if (!fin.is_open()) return false;
+  const int64_t size_file = fin.tellg();
+  fin.seekg(0);
+  std::ofstream fout(processed_path, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) return false;
+
+  has_output = false;
+  is_last_blank = false;
+  pending.clear();
+
+  // Blocks are double-buffered : while threads process one, the main thread writes the
+  // output of the previous block and reads the next one
+  std::vector<char> buffers[2] = {std::vector<char>(size_block + 4), std::vector<char>(size_block + 4)};
+  std::vector<PreprocessedSlice> slices[2];
+  std::vector<std::thread> vector_threads(n_cores);
+
+  fin.read(buffers[0].data(), size_block);
+  int64_t n_read = fin.gcount();
+  int64_t n_available = n_read;
+  int64_t offset_read = n_read;
+  bool is_last = (n_read < size_block || offset_read >= size_file);
+  int64_t offset_processed = 0;
+  int64_t i_buffer = 0;
+
+  std::cout << "Pre-processing " << corpus_path << std::endl;
+
+  while (true) {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(buffers[i_buffer].data());
+
+    // A sequence cut by the end of the block is decoded with the next block
+    const int64_t n_carried = is_last ? 0 : length_cut_utf8(data, n_available);
+    const int64_t n_process = n_available - n_carried;
+
+    // Slices start on a lead byte, which no sequence of the previous slice can consume
+    std::vector<int64_t> boundaries(n_cores + 1, n_process);
+    boundaries[0] = 0;
+    for (int64_t k=1; k<n_cores; k++) {
+      int64_t i = std::max(boundaries[k-1], n_process * k / n_cores);
+      while (i < n_process && (data[i] & 0xC0) == 0x80) i++;
+      boundaries[k] = i;
+    }
+
+    std::vector<PreprocessedSlice>& slices_current = slices[i_buffer];
+    slices_current.assign(n_cores, PreprocessedSlice());
+    for (int64_t k=0; k<n_cores; k++) {
+      vector_threads[k] = std::thread(&Preprocessor::process_slice, data,
+                                      boundaries[k], boundaries[k+1], n_available,
+                                      std::ref(slices_current[k]));
+    }
+
+    stitch(slices[1 - i_buffer], fout);
+    slices[1 - i_buffer].clear();
+    int64_t n_available_next = 0;
+    bool is_last_next = true;
+    if (!is_last) {
+      std::vector<char>& next = buffers[1 - i_buffer];
+      std::copy(buffers[i_buffer].begin() + n_process, buffers[i_buffer].begin() + n_available, next.begin());
+      fin.read(next.data() + n_carried, size_block);
+      n_read = fin.gcount();
+      offset_read += n_read;
+      n_available_next = n_carried + n_read;
+      is_last_next = (n_read < size_block || offset_read >= size_file);
+    }
+
+    for (auto& th : vector_threads) th.join();
+    offset_processed += n_process;
+
+    std::cout << "\rProgress : "
+              << std::fixed << std::setprecision(2)
+              << 100.0 * offset_processed / std::max<int64_t>(1, size_file)
+              << "%     " << std::flush;
+
+    if (is_last) {
+      stitch(slices_current, fout);
+      break;
+    }
+    i_buffer = 1 - i_buffer;
+    n_available = n_available_next;
+    is_last = is_last_next;
+  }
+  std::cout << std::endl;
+
+  fout.close();
+  return !fout.fail();
+}
+
+void Preprocessor::preprocess_text(const char* data, const int64_t size, std::string& processed)
+{
+  // The whitespace before and after the body is stripped, as at the ends of the corpus
+  PreprocessedSlice slice;
+  slice.body.swap(processed);
+  slice.body.clear();
+  process_slice(reinterpret_cast<const unsigned char*>(data), 0, size, size, slice);
+  processed.swap(slice.body);
+}
+
+void Preprocessor::process_slice(const unsigned char* data,
+                                 const int64_t i_begin,
+                                 const int64_t i_end,
+                                 const int64_t size,
+                                 PreprocessedSlice& slice)
+{
+  WhitespaceRun run;
+  bool has_visible = false;
+  bool is_blank = false;
+  std::string& body = slice.body;
+  body.reserve(i_end - i_begin);
+
+  for (int64_t i=i_begin; i<i_end;) {
+    uint32_t code;
+    const int64_t length = next_utf8(data, i, size, code);
+    if (length == 0) break;  // sequence cut by the end of the corpus
+    if (length < 0) {        // ill-formed bytes are ignored, as with errors='ignore'
+      i -= length;
+      continue;
+    }
+    i += length;
+
+    const wchar_t c = static_cast<wchar_t>(code);
+    if (classify(code) != VISIBLE) {
+      run.append(c);
+      continue;
+    }
+    if (has_visible) {
+      emit(run, body, is_blank);
+    } else {
+      slice.head = run;
+      slice.is_body_starting_with_blank = (c == VISIBLE_SPACE);
+      has_visible = true;
+    }
+    run.clear();
+    emit(c, body, is_blank);
+  }
+
+  if (has_visible) {
+    slice.tail = run;
+    slice.is_body_ending_with_blank = is_blank;
+  } else {
+    slice.head = run;
+  }
+}
+
+void Preprocessor::stitch(const std::vector<PreprocessedSlice>& slices, std::ofstream& fout)
+{
+  std::string separator;
+  for (const PreprocessedSlice& slice : slices) {
+    pending.append(slice.head);
+    if (slice.body.empty()) continue;
+
+    // Leading and trailing whitespace of the corpus is stripped
+    separator.clear();
+    if (has_output) emit(pending, separator, is_last_blank);
+    fout.write(separator.data(), separator.size());
+
+    const int64_t offset = (slice.is_body_starting_with_blank && is_last_blank) ? length_utf8(VISIBLE_SPACE) : 0;
+    fout.write(slice.body.data() + offset, slice.body.size() - offset);
+
+    has_output = true;
+    is_last_blank = slice.is_body_ending_with_blank;
+    pending = slice.tail;
+  }
+}
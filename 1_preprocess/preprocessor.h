@@ -0,0 +1,76 @@
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+#include <thread>
+
+#include "../common/utf8.h"
+
+#define SIZE_BLOCK_DEFAULT (64 << 20)
+#define VISIBLE_SPACE L'\u2423'  // ␣
+
+// Whitespace between two visible characters.
+// Spaces (and the whitespace normalized into spaces) are collapsed into one ' ' while
+// other whitespace which main.py does not normalize is kept; a newline anywhere in the
+// run turns the whole run into a single separator.
+struct WhitespaceRun {
+  bool has_newline;
+  std::wstring interior;
+
+  WhitespaceRun() : has_newline(false) {}
+  void append(const wchar_t c);
+  void append(const WhitespaceRun& run);
+  void clear();
+};
+
+// Output of one slice of a block, processed independently of its neighbours
+struct PreprocessedSlice {
+  WhitespaceRun head;                // whitespace before the first visible character
+  std::string body;                  // UTF-8 output from the first to the last visible character
+  bool is_body_starting_with_blank;  // body starts with the 3 bytes of VISIBLE_SPACE
+  bool is_body_ending_with_blank;
+  WhitespaceRun tail;                // whitespace after the last visible character
+
+  PreprocessedSlice() : is_body_starting_with_blank(false), is_body_ending_with_blank(false) {}
+};
+
+// Native counterpart of main.py, whose output it reproduces byte for byte :
+// sentences are concatenated and every run of whitespace becomes a single '␣'.
+// The corpus is read in blocks of `size_block` bytes; each block is split among threads
+// and slices are stitched in order, while the next block is read and the previous one
+// written, so memory stays bounded by a few blocks.
+class Preprocessor {
+private:
+  const int64_t n_cores;
+  const int64_t size_block;
+
+  // Stitching state
+  bool has_output;
+  bool is_last_blank;
+  WhitespaceRun pending;
+
+public:
+  Preprocessor(const int64_t _n_cores, const int64_t _size_block);
+  ~Preprocessor();
+  bool preprocess(const std::string corpus_path, const std::string processed_path);
+
+  // One text processed as a whole corpus of its own, into UTF-8 `processed`
+  static void preprocess_text(const char* data, const int64_t size, std::string& processed);
+
+private:
+  static void process_slice(const unsigned char* data,
+                            const int64_t i_begin,
+                            const int64_t i_end,
+                            const int64_t size,
+                            PreprocessedSlice& slice);
+  void stitch(const std::vector<PreprocessedSlice>& slices, std::ofstream& fout);
+};
+
+#endif
@@ -0,0 +1,8 @@
+#!/bin/bash
+set -e
+CORPUS="../data/sample.txt"
+PROCESSED="../data/sample_processed.txt"
+make
+./main --corpus_path=$CORPUS \
+       --processed_path=$PROCESSED \
+       --n_core=8
@@ -1,6 +1,6 @@
 #include "lossycounting.h"
 
-LossyCountingNgram::LossyCountingNgram(const std::wstring& _corpus,
+LossyCountingNgram::LossyCountingNgram(const CorpusStore& _corpus,
                                        const int64_t _max_ngram_size,
                                        const double _support_threshold,
                                        const double _epsilon,
@@ -9,7 +9,9 @@ LossyCountingNgram::LossyCountingNgram(const std::wstring& _corpus,
     max_ngram_size(_max_ngram_size),
     support_threshold(_support_threshold),
     epsilon(_epsilon),
-    n_cores(_n_cores)
+    n_cores(_n_cores),
+    length_counted(0),
+    is_state_kept(false)
 {
   assert(epsilon > 0);
   assert(support_threshold > 0);
@@ -20,6 +22,11 @@ LossyCountingNgram::LossyCountingNgram(const std::wstring& _corpus,
   }
   bucket_size = static_cast<int64_t>(1.0 / epsilon);
   occurence_lower_bound = static_cast<int64_t>(support_threshold * corpus_length);
+  states.resize(max_ngram_size);
+  for (LossyCountingState& state : states) {
+    state.n_positions = 0;
+    state.i_bucket = 1;
+  }
 }
 
 LossyCountingNgram::~LossyCountingNgram() {}
@@ -29,6 +36,7 @@ void LossyCountingNgram::count_ngram()
   const int64_t n_jobs = ngram_size_list.size();
   std::vector<std::thread> vector_threads(n_jobs);
 
+  profile.start_phase("count");
   for (int64_t i_cores=0; i_cores<n_jobs; i_cores++) {
     if (i_cores >= n_cores) vector_threads.at(i_cores-n_cores).join();
     vector_threads.at(i_cores) = std::thread(&LossyCountingNgram::count_ngram_each, this, ngram_size_list[i_cores]);
@@ -36,23 +44,36 @@ void LossyCountingNgram::count_ngram()
 
   //wait for thread left to complete
   for (auto& th : vector_threads) if (th.joinable()) th.join();
+  profile.stop_phase();
 
   // Sort all
+  profile.start_phase("sort");
   std::sort(counted_data.begin(), counted_data.end(),
             [](const std::pair<std::wstring, int64_t>& lhs,
                const std::pair<std::wstring, int64_t>& rhs)
             { return lhs.second > rhs.second; });
+  profile.stop_phase();
 }
 
 void LossyCountingNgram::count_ngram_each(const int64_t ngram_size)
 {
-  std::unordered_map<std::wstring, int64_t> counter_lossycounting, error_lossycounting;
-  std::wstring key, ngram;
-  int64_t i_bucket = 1;
+  LossyCountingState& state = states[ngram_size - 1];
+  std::unordered_map<std::wstring, int64_t>& counter_lossycounting = state.counter;
+  std::unordered_map<std::wstring, int64_t>& error_lossycounting = state.error;
+  std::wstring ngram;
+  int64_t& i_bucket = state.i_bucket;
+  const int64_t n_positions = std::max<int64_t>(0, corpus_length - ngram_size + 1);
+
+  // Only prune passes and the end of the scan are timed
+  const bool is_profiled = profile.is_enabled();
+  CountingSizeStats stats = CountingSizeStats();
+  stats.size = ngram_size;
+  stats.n_positions = n_positions;
+  const auto t_start = std::chrono::steady_clock::now();
 
-  for (int64_t i=0; i <= corpus_length-ngram_size; i++) {
+  for (int64_t i=0; i<n_positions; i++) {
 
-    ngram = corpus.substr(i, ngram_size);
+    corpus.substr(i, ngram_size, ngram);
 
     // If `ngram` exists in counter
     if (counter_lossycounting.find(ngram) != counter_lossycounting.end()) {
@@ -62,8 +83,22 @@ void LossyCountingNgram::count_ngram_each(const int64_t ngram_size)
       error_lossycounting.insert(std::make_pair(ngram, i_bucket - 1));
     }
 
-    if (i && i % bucket_size == 0) {
-      std::vector<std::wstring> vocabulary_current(counter_lossycounting.size());
+    // Buckets run over the whole stream, including the corpora of a loaded snapshot
+    const int64_t i_stream = state.n_positions + i;
+    if (i_stream && i_stream % bucket_size == 0) {
+      std::chrono::steady_clock::time_point t_prune;
+      int64_t n_entries_before = 0;
+      if (is_profiled) {
+        t_prune = std::chrono::steady_clock::now();
+        n_entries_before = counter_lossycounting.size();
+        if (n_entries_before > stats.max_entries) {
+          stats.max_entries = n_entries_before;
+          stats.bytes_tables = estimate_table_bytes<int64_t>(n_entries_before, counter_lossycounting.bucket_count(), ngram_size)
+            + estimate_table_bytes<int64_t>(error_lossycounting.size(), error_lossycounting.bucket_count(), ngram_size);
+        }
+      }
+      std::vector<std::wstring> vocabulary_current;
+      vocabulary_current.reserve(counter_lossycounting.size());
       for (auto& elem : counter_lossycounting) {
         vocabulary_current.push_back(elem.first);
       }
@@ -74,9 +109,28 @@ void LossyCountingNgram::count_ngram_each(const int64_t ngram_size)
         }
       }
       i_bucket += 1;
+      if (is_profiled) {
+        stats.n_prunes++;
+        stats.n_evicted += n_entries_before - counter_lossycounting.size();
+        stats.seconds_prune += CountingProfile::seconds_since(t_prune);
+      }
     }
 
   }
+  state.n_positions += n_positions;
+
+  if (is_profiled) {
+    stats.seconds_count = CountingProfile::seconds_since(t_start);
+    stats.n_entries = counter_lossycounting.size();
+    stats.n_buckets = counter_lossycounting.bucket_count();
+    stats.load_factor = counter_lossycounting.load_factor();
+    if (stats.n_entries > stats.max_entries) {
+      stats.max_entries = stats.n_entries;
+      stats.bytes_tables = estimate_table_bytes<int64_t>(stats.n_entries, stats.n_buckets, ngram_size)
+        + estimate_table_bytes<int64_t>(error_lossycounting.size(), error_lossycounting.bucket_count(), ngram_size);
+    }
+  }
+  const auto t_sort = std::chrono::steady_clock::now();
 
   std::vector<std::pair<std::wstring, int64_t>> elems(counter_lossycounting.begin(),
                                                       counter_lossycounting.end());
@@ -84,7 +138,13 @@ void LossyCountingNgram::count_ngram_each(const int64_t ngram_size)
             [](const std::pair<std::wstring, int64_t>& lhs,
                const std::pair<std::wstring, int64_t>& rhs)
             { return lhs.second > rhs.second; });
+  if (is_profiled) stats.seconds_sort = CountingProfile::seconds_since(t_sort);
+  if (!is_state_kept) {
+    std::unordered_map<std::wstring, int64_t>().swap(counter_lossycounting);
+    std::unordered_map<std::wstring, int64_t>().swap(error_lossycounting);
+  }
 
+  const auto t_merge = std::chrono::steady_clock::now();
   std::vector<std::pair<std::wstring, int64_t>> counted_data_eachthread;
 
   for (int64_t i=0; i<elems.size(); i++) {
@@ -93,20 +153,151 @@ void LossyCountingNgram::count_ngram_each(const int64_t ngram_size)
   }
 
   // Update ngrams & counts
-  std::lock_guard<std::mutex> lock(mtx);
-  counted_data.insert(counted_data.end(), counted_data_eachthread.begin(), counted_data_eachthread.end());
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    counted_data.insert(counted_data.end(), counted_data_eachthread.begin(), counted_data_eachthread.end());
+  }
+
+  if (is_profiled) {
+    stats.seconds_merge = CountingProfile::seconds_since(t_merge);
+    stats.n_kept = counted_data_eachthread.size();
+    profile.add_size(stats);
+  }
+}
+
+// LEB128 varints keep small counts and errors to a byte or two
+static void append_varint(uint64_t x, std::string& out)
+{
+  while (x >= 0x80) {
+    out += static_cast<char>((x & 0x7F) | 0x80);
+    x >>= 7;
+  }
+  out += static_cast<char>(x);
+}
+
+static bool read_varint(const char*& p, const char* end, uint64_t& x)
+{
+  x = 0;
+  for (int shift=0; p<end && shift<64; shift+=7) {
+    const unsigned char c = static_cast<unsigned char>(*p++);
+    x |= static_cast<uint64_t>(c & 0x7F) << shift;
+    if (!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+bool LossyCountingNgram::load_snapshot(const std::string snapshot_path)
+{
+  MappedFile file;
+  if (!file.open(snapshot_path)) return false;
+  const char* p = file.data();
+  const char* end = p + file.size();
+
+  LossyCountingSnapshotHeader h;
+  if (file.size() < sizeof(h)) return false;
+  std::memcpy(&h, p, sizeof(h));
+  p += sizeof(h);
+  if (std::memcmp(h.magic, LOSSYCOUNTING_MAGIC, sizeof(h.magic)) != 0 || h.version != LOSSYCOUNTING_VERSION) {
+    std::cout << "Not a snapshot of lossy counting : " << snapshot_path << std::endl;
+    return false;
+  }
+  if (h.max_ngram_size != max_ngram_size || h.bucket_size != bucket_size) {
+    std::cout << "The snapshot was counted with max_ngram_size " << h.max_ngram_size
+              << " and bucket size " << h.bucket_size << " (1 / epsilon)" << std::endl;
+    return false;
+  }
+
+  std::vector<LossyCountingState> states_loaded(max_ngram_size);
+  for (LossyCountingState& state : states_loaded) {
+    int64_t n_entries;
+    if (end - p < 3 * static_cast<int64_t>(sizeof(int64_t))) return false;
+    std::memcpy(&state.n_positions, p, sizeof(int64_t));
+    std::memcpy(&state.i_bucket, p + sizeof(int64_t), sizeof(int64_t));
+    std::memcpy(&n_entries, p + 2 * sizeof(int64_t), sizeof(int64_t));
+    p += 3 * sizeof(int64_t);
+    if (n_entries < 0 || n_entries > end - p) return false;
+    state.counter.reserve(n_entries);
+    state.error.reserve(n_entries);
+
+    for (int64_t k=0; k<n_entries; k++) {
+      uint64_t length, count, error;
+      if (!read_varint(p, end, length) || length > static_cast<uint64_t>(end - p)) return false;
+      std::wstring ngram;
+      decode_utf8(p, length, ngram);
+      p += length;
+      if (!read_varint(p, end, count) || !read_varint(p, end, error)) return false;
+      state.counter[ngram] = count;
+      state.error[ngram] = error;
+    }
+  }
+  if (p != end) return false;
+
+  states.swap(states_loaded);
+  length_counted = h.length_counted;
+  occurence_lower_bound = static_cast<int64_t>(support_threshold * (length_counted + corpus_length));
+  return true;
+}
+
+bool LossyCountingNgram::save_snapshot(const std::string snapshot_path) const
+{
+  assert(is_state_kept);
+  std::cout << "Saving counting state to " << snapshot_path << std::endl;
+
+  LossyCountingSnapshotHeader h;
+  std::memcpy(h.magic, LOSSYCOUNTING_MAGIC, sizeof(h.magic));
+  h.version = LOSSYCOUNTING_VERSION;
+  h.max_ngram_size = max_ngram_size;
+  h.bucket_size = bucket_size;
+  h.length_counted = length_counted + corpus_length;
+
+  // Write to a temporary file first so that the previous snapshot is never clobbered
+  const std::string path_tmp = snapshot_path + ".tmp";
+  std::ofstream fout(path_tmp, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) return false;
+  fout.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+  std::string buffer;
+  for (const LossyCountingState& state : states) {
+    const int64_t header_state[3] = {state.n_positions, state.i_bucket, static_cast<int64_t>(state.counter.size())};
+    fout.write(reinterpret_cast<const char*>(header_state), sizeof(header_state));
+    buffer.clear();
+    std::string key;
+    for (const auto& elem : state.counter) {
+      key.clear();
+      append_utf8(elem.first, key);
+      append_varint(key.size(), buffer);
+      buffer += key;
+      append_varint(elem.second, buffer);
+      append_varint(state.error.at(elem.first), buffer);
+      if (buffer.size() >= (1 << 20)) {
+        fout.write(buffer.data(), buffer.size());
+        buffer.clear();
+      }
+    }
+    fout.write(buffer.data(), buffer.size());
+  }
+  fout.close();
+  if (fout.fail()) return false;
+  if (std::rename(path_tmp.c_str(), snapshot_path.c_str()) != 0) return false;
+
+  std::cout << "Done" << std::endl;
+  return true;
 }
 
 void LossyCountingNgram::extract_all_ngram_to_csv(const std::string ngram_count_path)
 {
   std::string output_path = ngram_count_path;
   std::cout << "Saving counted ngrams to " << output_path << std::endl;
-  std::wofstream fout(output_path);
-  for (int64_t i=0; i<counted_data.size(); i++) {
-    fout << counted_data[i].first << "\t" << counted_data[i].second << std::endl;
-    if (i) assert(counted_data[i-1].second >= counted_data[i].second);
+  for (int64_t i=1; i<counted_data.size(); i++) {
+    assert(counted_data[i-1].second >= counted_data[i].second);
+  }
+  profile.start_phase("write");
+  const bool is_written = write_tsv_parallel(output_path, counted_data, n_cores);
+  profile.stop_phase();
+  if (!is_written) {
+    std::cout << "Invalid file name." << std::endl;
+    return;
   }
-  fout.close();
   std::cout << "Done" << std::endl;
 }
 
@@ -147,12 +338,16 @@ void LossyCountingNgram::extract_top_ngram_to_csv(const std::string ngram_count_
                const std::pair<std::wstring, int64_t>& rhs)
             { return lhs.second > rhs.second; });
 
-  std::wofstream fout(output_path);
-  for (int64_t i=0; i<extracted_ngram_vector.size(); i++) {
-    fout << extracted_ngram_vector[i].first << "\t" << extracted_ngram_vector[i].second << std::endl;
-    if (i) assert(extracted_ngram_vector[i-1].second >= extracted_ngram_vector[i].second); // Check Sort
+  for (int64_t i=1; i<extracted_ngram_vector.size(); i++) {
+    assert(extracted_ngram_vector[i-1].second >= extracted_ngram_vector[i].second); // Check Sort
+  }
+  profile.start_phase("write_top");
+  const bool is_written = write_tsv_parallel(output_path, extracted_ngram_vector, n_cores);
+  profile.stop_phase();
+  if (!is_written) {
+    std::cout << "Invalid file name." << std::endl;
+    return;
   }
-  fout.close();
 
   std::cout << "Done" << std::endl;
 }
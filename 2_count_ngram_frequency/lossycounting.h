@@ -11,6 +11,7 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstdint>
+#include <cstring>
 #include <cassert>
 #include <algorithm>
 #include <unordered_map>
@@ -20,29 +21,69 @@
 #include <thread>
 #include <mutex>
 
+#include "../common/corpus_store.h"
+#include "../common/mapped_file.h"
+#include "../common/utf8.h"
+#include "../common/parallel_writer.h"
+#include "../common/counting_profile.h"
+
+#define LOSSYCOUNTING_MAGIC "WNELOSSY"
+#define LOSSYCOUNTING_VERSION 1
+
+// Lossy counting of the n-grams of one size over the stream of all corpora counted so far
+struct LossyCountingState {
+  int64_t n_positions;  // n-grams read from the stream
+  int64_t i_bucket;     // current bucket, from 1
+  std::unordered_map<std::wstring, int64_t> counter;
+  std::unordered_map<std::wstring, int64_t> error;
+};
+
+// Snapshot of the counting state, after which a new corpus continues the stream :
+//   header | for each n-gram size : int64_t n_positions, i_bucket, n_entries, then per
+//   entry varint UTF-8 length, UTF-8 bytes, varint count, varint error
+struct LossyCountingSnapshotHeader {
+  char magic[8];
+  int64_t version;
+  int64_t max_ngram_size;
+  int64_t bucket_size;
+  int64_t length_counted;  // characters of the corpora already counted
+};
+
 class LossyCountingNgram 
 {
   private:
-    const std::wstring corpus;
+    const CorpusStore& corpus;
     const int64_t max_ngram_size;
     const double support_threshold;
     const double epsilon;
     const int64_t n_cores;
 
     int64_t corpus_length;
+    int64_t length_counted;
     int64_t bucket_size;
     int64_t occurence_lower_bound;
     std::vector<int64_t> ngram_size_list;
     std::vector<std::pair<std::wstring, int64_t>> counted_data;
+    std::vector<LossyCountingState> states;
+    bool is_state_kept;
+    CountingProfile profile;
     std::mutex mtx;
 
   public:
-    LossyCountingNgram(const std::wstring& _corpus,
+    LossyCountingNgram(const CorpusStore& _corpus,
                        const int64_t _max_ngram_size, 
                        const double _support_threshold,
                        const double _epsilon,
                        const int64_t _n_cores);
     ~LossyCountingNgram();
+    // Keeps the counting state after count_ngram() so that it can be saved
+    void set_state_kept(const bool _is_state_kept) { is_state_kept = _is_state_kept; }
+    // Continues the stream of a snapshot made with the same max_ngram_size and epsilon;
+    // to be called before count_ngram()
+    bool load_snapshot(const std::string snapshot_path);
+    bool save_snapshot(const std::string snapshot_path) const;
+    // Phases and per-size statistics, collected once enabled
+    CountingProfile& get_profile() { return profile; }
     void count_ngram();
     void count_ngram_each(const int64_t ngram_size);
     void extract_all_ngram_to_csv(const std::string ngram_count_path);
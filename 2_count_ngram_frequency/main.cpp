@@ -14,6 +14,9 @@
 
 #include "cmdline.h"
 #include "lossycounting.h"
+#include "../common/corpus_store.h"
+#include "../common/fingerprint.h"
+#include "../common/counting_profile.h"
 
 int main(int argc, char* argv[]) {
 
@@ -35,6 +38,11 @@ int main(int argc, char* argv[]) {
   a.add<int64_t>("n_core", '\0', "n_core", true);
   a.add<double>("support_threshold", '\0', "support threshold", true);
   a.add<double>("epsilon", '\0', "epsilon", true);
+  a.add<std::string>("snapshot_path", '\0', "save the counting state, from which a later run can count a new corpus with --resume_from", false);
+  a.add<std::string>("resume_from", '\0', "snapshot of the corpora counted so far; the counts then cover them and --corpus_path", false);
+  a.add("no_cache", '\0', "count even if the outputs of a run with the same corpus and parameters are present");
+  a.add("profile", '\0', "print the time and peak memory of each phase and the hash table statistics of each n-gram size");
+  a.add<std::string>("profile_path", '\0', "also save the profile as JSON", false);
   a.parse_check(argc, argv);
   std::string corpus_path = a.get<std::string>("corpus_path");
   std::string ngram_count_path = a.get<std::string>("ngram_count_path");
@@ -44,25 +52,93 @@ int main(int argc, char* argv[]) {
   int64_t n_core = a.get<int64_t>("n_core");
   double support_threshold = a.get<double>("support_threshold");
   double epsilon = a.get<double>("epsilon");
+  std::string snapshot_path = a.get<std::string>("snapshot_path");
+  std::string resume_from = a.get<std::string>("resume_from");
+  bool no_cache = a.exist("no_cache");
+  std::string profile_path = a.get<std::string>("profile_path");
+  bool profile = a.exist("profile") || !profile_path.empty();
 
-  // Load corpus
-  std::wifstream fin_corpus(corpus_path);
-  if (!fin_corpus.is_open()) {
+  // Overwriting the resumed snapshot would count --corpus_path twice on a rerun
+  if (!snapshot_path.empty() && snapshot_path == resume_from) {
+    std::cout << "--snapshot_path must differ from --resume_from." << std::endl;
+    return 0;
+  }
+
+  // Skip counting when the outputs were made from the same corpus and parameters
+  Fingerprint fingerprint("2_count_ngram_frequency");
+  if (!fingerprint.add_file("corpus", corpus_path, n_core)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  if (!resume_from.empty() && !fingerprint.add_file("resume_from", resume_from, n_core)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  fingerprint.add("max_ngram_size", max_ngram_size);
+  fingerprint.add("support_threshold", support_threshold);
+  fingerprint.add("epsilon", epsilon);
+  fingerprint.add("extract_num", extract_num);
+  std::vector<std::pair<std::string, std::string>> outputs = {{"ngram_count", ngram_count_path}};
+  if (extract_num != 0) outputs.push_back({"ngram_count_top", ngram_count_top_path});
+  if (!snapshot_path.empty()) outputs.push_back({"snapshot", snapshot_path});
+  if (!no_cache && fingerprint.is_cached(outputs, n_core)) {
+    std::cout << "Up to date : " << ngram_count_path << " (fingerprint " << Fingerprint::path_of(ngram_count_path) << ")" << std::endl;
+    return 0;
+  }
+  Fingerprint::invalidate(ngram_count_path);
+
+  // Load corpus (UTF-8 text or corpus store)
+  StageUsage usage_load("load");
+  if (profile) usage_load.start();
+  CorpusStore corpus;
+  if (!corpus.load(corpus_path, n_core)) {
     std::cout << "Invalid file name." << std::endl;
     return 0;
   }
-  std::wstringstream wss;
-  wss << fin_corpus.rdbuf();
-  std::wstring corpus = wss.str();
-  fin_corpus.close();
+  if (profile) usage_load.stop();
 
   //Extract frequently-used n-grams using lossy counting algorithm
   LossyCountingNgram counter(corpus, max_ngram_size, support_threshold, epsilon, n_core);
+  CountingProfile& counting_profile = counter.get_profile();
+  counting_profile.set_enabled(profile);
+  counting_profile.add_phase(usage_load);
+  counter.set_state_kept(!snapshot_path.empty());
+  if (!resume_from.empty()) {
+    std::cout << "Resuming from " << resume_from << std::endl;
+    counting_profile.start_phase("load_snapshot");
+    const bool is_loaded = counter.load_snapshot(resume_from);
+    counting_profile.stop_phase();
+    if (!is_loaded) {
+      std::cout << "Invalid snapshot." << std::endl;
+      return 0;
+    }
+  }
   counter.count_ngram();
   counter.extract_all_ngram_to_csv(ngram_count_path);
   if (extract_num != 0) {
     counter.extract_top_ngram_to_csv(ngram_count_top_path, extract_num);
   }
+  if (!snapshot_path.empty()) {
+    counting_profile.start_phase("save_snapshot");
+    const bool is_saved = counter.save_snapshot(snapshot_path);
+    counting_profile.stop_phase();
+    if (!is_saved) {
+      std::cout << "Invalid file name." << std::endl;
+      return 0;
+    }
+  }
+  if (profile) {
+    counting_profile.print("2_count_ngram_frequency");
+    if (!profile_path.empty()) {
+      std::cout << "Saving profile to " << profile_path << std::endl;
+      if (!counting_profile.save_json(profile_path, "2_count_ngram_frequency")) {
+        std::cout << "Invalid file name." << std::endl;
+      }
+    }
+  }
+  if (!fingerprint.save(outputs, n_core)) {
+    std::cout << "Failed to save the fingerprint of " << ngram_count_path << std::endl;
+  }
 
   return 0;
 }
@@ -49,7 +49,7 @@ def get_ngram_occurence(path, verbose=True):
     for line in lines:
         if verbose: bar.update()
         ngram, count = line.split()
-        count = locale.atoi(count)
+        count = int(count.replace(",", ""))  # counts of older runs have thousands separators
         ngram_occurence[ngram] = count
     if verbose: bar.close()
     return ngram_occurence
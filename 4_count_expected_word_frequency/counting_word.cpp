@@ -1,7 +1,7 @@
 #include "counting_word.h"
 
-CountingWord::CountingWord(const std::wstring& _corpus,
-                           const std::vector<double> _boundary_data,
+CountingWord::CountingWord(const CorpusStore& _corpus,
+                           const std::vector<double>& _boundary_data,
                            const int64_t _max_word_length,
                            const int64_t _extract_num_maximun,
                            const int64_t _n_cores)
@@ -24,6 +24,7 @@ void CountingWord::count_word()
   const int64_t n_jobs = word_length_list.size();
   std::vector<std::thread> vector_threads(n_jobs);
 
+  profile.start_phase("count");
   for (int64_t i_cores=0; i_cores<n_jobs; i_cores++) {
     if (i_cores >= n_cores) vector_threads.at(i_cores-n_cores).join();
     vector_threads.at(i_cores) = std::thread(&CountingWord::count_word_each, this, word_length_list[i_cores]);
@@ -31,12 +32,15 @@ void CountingWord::count_word()
 
   //wait for thread left to complete
   for (auto& th : vector_threads) if (th.joinable()) th.join();
+  profile.stop_phase();
 
   // Sort all
+  profile.start_phase("sort");
   std::sort(counted_data.begin(), counted_data.end(),
             [](const std::pair<std::wstring, double>& lhs,
                const std::pair<std::wstring, double>& rhs)
             { return lhs.second > rhs.second; });
+  profile.stop_phase();
 }
 
 void CountingWord::count_word_each(const int64_t word_length)
@@ -45,9 +49,15 @@ void CountingWord::count_word_each(const int64_t word_length)
   std::wstring word;
   double probability;
 
+  const bool is_profiled = profile.is_enabled();
+  CountingSizeStats stats = CountingSizeStats();
+  stats.size = word_length;
+  stats.n_positions = std::max<int64_t>(0, corpus_length - word_length + 1);
+  const auto t_start = std::chrono::steady_clock::now();
+
   for (int64_t i=0; i <= corpus_length-word_length; i++) {
 
-    word = corpus.substr(i, word_length);
+    corpus.substr(i, word_length, word);
 
     probability = boundary_data[i];
     for(int64_t j = 1; j < word_length; j++){
@@ -63,30 +73,52 @@ void CountingWord::count_word_each(const int64_t word_length)
 
   }
 
+  if (is_profiled) {
+    stats.seconds_count = CountingProfile::seconds_since(t_start);
+    stats.n_entries = word_count_each.size();
+    stats.max_entries = stats.n_entries;
+    stats.n_buckets = word_count_each.bucket_count();
+    stats.load_factor = word_count_each.load_factor();
+    stats.bytes_tables = estimate_table_bytes<double>(stats.n_entries, stats.n_buckets, word_length);
+  }
+  const auto t_sort = std::chrono::steady_clock::now();
+
   std::vector<std::pair<std::wstring, double>> elems(word_count_each.begin(),
                                                      word_count_each.end());
   std::sort(elems.begin(), elems.end(),
             [](const std::pair<std::wstring, double>& lhs,
                const std::pair<std::wstring, double>& rhs)
             { return lhs.second > rhs.second; });
+  if (is_profiled) stats.seconds_sort = CountingProfile::seconds_since(t_sort);
 
   int64_t min_num = (elems.size() < extract_num_maximun) ? elems.size() : extract_num_maximun;
 
   // Update
-  std::lock_guard<std::mutex> lock(mtx);
-  for (int64_t i=0; i<min_num; i++) {
-    counted_data.push_back(elems[i]);
+  const auto t_merge = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (int64_t i=0; i<min_num; i++) {
+      counted_data.push_back(elems[i]);
+    }
+  }
+
+  if (is_profiled) {
+    stats.seconds_merge = CountingProfile::seconds_since(t_merge);
+    stats.n_kept = min_num;
+    profile.add_size(stats);
   }
 }
 
 void CountingWord::extract_all_word_to_csv(const std::string word_count_path){
   std::string output_path = word_count_path;
   std::cout << "Saving word-like ngrams to " << output_path << std::endl;
-  std::wofstream fout(output_path);
-  for (auto it : counted_data) {
-    fout << it.first << "\t" << it.second << std::endl;
+  profile.start_phase("write");
+  const bool is_written = write_tsv_parallel(output_path, counted_data, n_cores);
+  profile.stop_phase();
+  if (!is_written) {
+    std::cout << "Invalid file name." << std::endl;
+    return;
   }
-  fout.close();
   std::cout << "Done" << std::endl;
 }
 
@@ -95,6 +127,33 @@ void CountingWord::extract_top_word_to_csv(const std::string word_count_top_path
   std::string output_path = word_count_top_path;
   std::cout << "Extract " << extract_num << " words to " << output_path << std::endl;
 
+  std::vector<std::pair<std::wstring, double>> extracted_word_vector;
+  profile.start_phase("extract_top");
+  extract_top_word(extracted_word_vector, extract_num);
+  profile.stop_phase();
+  profile.start_phase("write");
+  const bool is_written = write_word_to_csv(output_path, extracted_word_vector, n_cores);
+  profile.stop_phase();
+  if (!is_written) {
+    std::cout << "Invalid file name." << std::endl;
+    return;
+  }
+
+  std::cout << "Done" << std::endl;
+}
+
+bool CountingWord::write_word_to_csv(const std::string output_path,
+                                     const std::vector<std::pair<std::wstring, double>>& words,
+                                     const int64_t n_threads)
+{
+  for (int64_t i=1; i<words.size(); i++) {
+    assert(words[i-1].second >= words[i].second); // Check Sort
+  }
+  return write_tsv_parallel(output_path, words, n_threads);
+}
+
+void CountingWord::extract_top_word(std::vector<std::pair<std::wstring, double>>& placeholder, const int64_t extract_num)
+{
   std::unordered_map<std::wstring, double> extracted_word_map;
   int64_t num = 0;
 
@@ -113,19 +172,9 @@ void CountingWord::extract_top_word_to_csv(const std::string word_count_top_path
   assert(num == extracted_word_map.size());
   assert(num <= extract_num);
 
-  std::vector<std::pair<std::wstring, double>> extracted_word_vector(extracted_word_map.begin(),
-                                                                     extracted_word_map.end());
-  std::sort(extracted_word_vector.begin(), extracted_word_vector.end(),
+  placeholder.assign(extracted_word_map.begin(), extracted_word_map.end());
+  std::sort(placeholder.begin(), placeholder.end(),
             [](const std::pair<std::wstring, double>& lhs,
                const std::pair<std::wstring, double>& rhs)
             { return lhs.second > rhs.second; });
-
-  std::wofstream fout(output_path);
-  for (int64_t i=0; i<extracted_word_vector.size(); i++) {
-    fout << extracted_word_vector[i].first << "\t" << extracted_word_vector[i].second << std::endl;
-    if (i) assert(extracted_word_vector[i-1].second >= extracted_word_vector[i].second); // Check Sort
-  }
-  fout.close();
-
-  std::cout << "Done" << std::endl;
 }
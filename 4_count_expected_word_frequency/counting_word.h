@@ -20,11 +20,15 @@
 #include <thread>
 #include <mutex>
 
+#include "../common/corpus_store.h"
+#include "../common/parallel_writer.h"
+#include "../common/counting_profile.h"
+
 class CountingWord
 {
   private:
-    const std::wstring corpus;
-    const std::vector<double> boundary_data;
+    const CorpusStore& corpus;
+    const std::vector<double>& boundary_data;
     const int64_t max_word_length;
     const int64_t extract_num_maximun;
     const int64_t n_cores;
@@ -32,19 +36,26 @@ class CountingWord
     int64_t corpus_length;
     std::vector<int64_t> word_length_list;
     std::vector<std::pair<std::wstring, double>> counted_data;
+    CountingProfile profile;
     std::mutex mtx;
 
   public:
-    CountingWord(const std::wstring& _corpus,
-                 const std::vector<double> _boundary_data,
+    CountingWord(const CorpusStore& _corpus,
+                 const std::vector<double>& _boundary_data,
                  const int64_t _max_word_length,
                  const int64_t _extract_num_maximun,
                  const int64_t _n_cores);
     ~CountingWord();
+    // Phases and per-length statistics, collected once enabled
+    CountingProfile& get_profile() { return profile; }
     void count_word();
     void count_word_each(const int64_t word_length);
     void extract_all_word_to_csv(const std::string word_count_path);
     void extract_top_word_to_csv(const std::string word_count_top_path, const int64_t extract_num);
+    void extract_top_word(std::vector<std::pair<std::wstring, double>>& placeholder, const int64_t extract_num);
+    static bool write_word_to_csv(const std::string output_path,
+                                  const std::vector<std::pair<std::wstring, double>>& words,
+                                  const int64_t n_threads);
 };
 
 #endif
@@ -16,6 +16,9 @@
 #include "H5Cpp.h"
 #include "cmdline.h"
 #include "counting_word.h"
+#include "../common/corpus_store.h"
+#include "../common/fingerprint.h"
+#include "../common/counting_profile.h"
 
 int main(int argc, char* argv[]) {
 
@@ -35,6 +38,9 @@ int main(int argc, char* argv[]) {
   a.add<int64_t>("max_word_length", '\0', "max_word_length", true);
   a.add<int64_t>("extract_num", '\0', "extract_num", true);
   a.add<int64_t>("n_core", '\0', "n_core", true);
+  a.add("no_cache", '\0', "count even if the output of a run with the same inputs and parameters is present");
+  a.add("profile", '\0', "print the time and peak memory of each phase and the hash table statistics of each word length");
+  a.add<std::string>("profile_path", '\0', "also save the profile as JSON", false);
   a.parse_check(argc, argv);
   std::string corpus_path = a.get<std::string>("corpus_path");
   std::string boundary_path = a.get<std::string>("boundary_path");
@@ -42,17 +48,34 @@ int main(int argc, char* argv[]) {
   int64_t max_word_length = a.get<int64_t>("max_word_length");
   int64_t extract_num = a.get<int64_t>("extract_num");
   int64_t n_core = a.get<int64_t>("n_core");
+  bool no_cache = a.exist("no_cache");
+  std::string profile_path = a.get<std::string>("profile_path");
+  bool profile = a.exist("profile") || !profile_path.empty();
 
-  // Load corpus
-  std::wifstream fin_corpus(corpus_path);
-  if (!fin_corpus.is_open()) {
+  // Skip counting when the output was made from the same corpus, boundary and parameters
+  Fingerprint fingerprint("4_count_expected_word_frequency");
+  if (!fingerprint.add_file("corpus", corpus_path, n_core) ||
+      !fingerprint.add_file("boundary", boundary_path, n_core)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  fingerprint.add("max_word_length", max_word_length);
+  fingerprint.add("extract_num", extract_num);
+  const std::vector<std::pair<std::string, std::string>> outputs = {{"word_count_top", word_count_top_path}};
+  if (!no_cache && fingerprint.is_cached(outputs, n_core)) {
+    std::cout << "Up to date : " << word_count_top_path << " (fingerprint " << Fingerprint::path_of(word_count_top_path) << ")" << std::endl;
+    return 0;
+  }
+  Fingerprint::invalidate(word_count_top_path);
+
+  // Load corpus (UTF-8 text or corpus store) and boundary
+  StageUsage usage_load("load");
+  if (profile) usage_load.start();
+  CorpusStore corpus;
+  if (!corpus.load(corpus_path, n_core)) {
     std::cout << "Invalid file name." << std::endl;
     return 0;
   }
-  std::wstringstream wss;
-  wss << fin_corpus.rdbuf();
-  std::wstring corpus = wss.str();
-  fin_corpus.close();
 
   // Load boundary data
   // hardwire data properties
@@ -94,12 +117,28 @@ int main(int argc, char* argv[]) {
   file.close();
 
   // check and convert
-  assert((int)(dims[0]) == corpus.length());
+  assert(static_cast<int64_t>(dims[0]) == corpus.size());
   std::vector<double> boundary_data(boundary_data_tmp, &boundary_data_tmp[(int)(dims[0])]);
+  if (profile) usage_load.stop();
 
   CountingWord wordcounter(corpus, boundary_data, max_word_length, extract_num, n_core);
+  CountingProfile& counting_profile = wordcounter.get_profile();
+  counting_profile.set_enabled(profile);
+  counting_profile.add_phase(usage_load);
   wordcounter.count_word();
   wordcounter.extract_top_word_to_csv(word_count_top_path, extract_num);
+  if (profile) {
+    counting_profile.print("4_count_expected_word_frequency");
+    if (!profile_path.empty()) {
+      std::cout << "Saving profile to " << profile_path << std::endl;
+      if (!counting_profile.save_json(profile_path, "4_count_expected_word_frequency")) {
+        std::cout << "Invalid file name." << std::endl;
+      }
+    }
+  }
+  if (!fingerprint.save(outputs, n_core)) {
+    std::cout << "Failed to save the fingerprint of " << word_count_top_path << std::endl;
+  }
 
   return 0;
 }
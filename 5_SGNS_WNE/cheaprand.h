@@ -24,6 +24,10 @@ public:
     return randomstate; 
   }
 
+  void set_randomstate(const int64_t _randomstate) {
+    randomstate = _randomstate;
+  }
+
   inline int64_t generate_randint(const int64_t max) {
     assert(max > 0);
     randomstate = randomstate * 25214903917 + 11;
@@ -0,0 +1,151 @@
+#include "checkpoint.h"
+
+Checkpoint::Checkpoint() : data(nullptr), size(0) {}
+
+Checkpoint::~Checkpoint() {
+  close();
+}
+
+bool Checkpoint::open(const std::string& path)
+{
+  close();
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CheckpointHeader))) {
+    ::close(fd);
+    return false;
+  }
+  void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) return false;
+  data = p;
+  size = st.st_size;
+
+  // Check file signature and that every section lies within the file. Counts are bounded
+  // by the room left after their offset before being multiplied, so that a corrupt header
+  // can neither be negative nor overflow past the checks.
+  const CheckpointHeader& h = header();
+  const int64_t size_matrices = 3 * static_cast<int64_t>(sizeof(double));
+  if (std::memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0
+      || h.version != CHECKPOINT_VERSION
+      || h.size_vocabulary < 0 || h.dim_embedding < 0 || h.n_cores < 0
+      || h.offset_thread_states < 0 || h.offset_thread_states > size
+      || h.offset_embeddings < 0 || h.offset_embeddings > size
+      || h.offset_vocabulary < 0 || h.offset_vocabulary > size
+      || h.n_cores > (size - h.offset_thread_states) / static_cast<int64_t>(sizeof(ThreadState))
+      || (h.dim_embedding > 0 && h.size_vocabulary > (size - h.offset_embeddings) / size_matrices / h.dim_embedding)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void Checkpoint::close()
+{
+  if (data != nullptr) munmap(data, size);
+  data = nullptr;
+  size = 0;
+}
+
+const CheckpointHeader& Checkpoint::header() const {
+  return *static_cast<const CheckpointHeader*>(data);
+}
+
+const ThreadState* Checkpoint::thread_states() const {
+  return reinterpret_cast<const ThreadState*>(static_cast<const char*>(data) + header().offset_thread_states);
+}
+
+const double* Checkpoint::embeddings_words() const {
+  return reinterpret_cast<const double*>(static_cast<const char*>(data) + header().offset_embeddings);
+}
+
+const double* Checkpoint::embeddings_contexts_left() const {
+  return embeddings_words() + header().size_vocabulary * header().dim_embedding;
+}
+
+const double* Checkpoint::embeddings_contexts_right() const {
+  return embeddings_contexts_left() + header().size_vocabulary * header().dim_embedding;
+}
+
+void Checkpoint::vocabulary(std::vector<std::wstring>& placeholder) const
+{
+  const char* p = static_cast<const char*>(data) + header().offset_vocabulary;
+  const char* end = static_cast<const char*>(data) + size;
+
+  for (int64_t i=0; i<header().size_vocabulary && p + sizeof(int64_t) <= end; i++) {
+    int64_t length;
+    std::memcpy(&length, p, sizeof(int64_t));
+    p += sizeof(int64_t);
+    if (length < 0 || p + length * sizeof(int32_t) > end) break;
+    std::wstring word(length, L'\0');
+    for (int64_t j=0; j<length; j++) {
+      int32_t c;
+      std::memcpy(&c, p + j * sizeof(int32_t), sizeof(int32_t));
+      word[j] = static_cast<wchar_t>(c);
+    }
+    p += length * sizeof(int32_t);
+    placeholder.push_back(word);
+  }
+}
+
+bool Checkpoint::write(const std::string& path,
+                       const CheckpointHeader& _header,
+                       const std::vector<ThreadState>& thread_states,
+                       const double* embeddings_words,
+                       const double* embeddings_contexts_left,
+                       const double* embeddings_contexts_right,
+                       const std::vector<std::wstring>& vocabulary)
+{
+  CheckpointHeader h = _header;
+  const int64_t n = h.size_vocabulary * h.dim_embedding;
+  std::memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  h.version = CHECKPOINT_VERSION;
+  h.n_cores = thread_states.size();
+  h.offset_thread_states = sizeof(CheckpointHeader);
+  const int64_t end_thread_states = h.offset_thread_states + h.n_cores * sizeof(ThreadState);
+  h.offset_embeddings = (end_thread_states + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+  h.offset_vocabulary = h.offset_embeddings + 3 * n * sizeof(double);
+
+  // Write to a temporary file first so that an interrupted write never clobbers
+  // the previous checkpoint
+  const std::string path_tmp = path + ".tmp";
+  std::ofstream fout(path_tmp, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) return false;
+
+  const std::vector<char> padding(h.offset_embeddings - end_thread_states, 0);
+  fout.write(reinterpret_cast<const char*>(&h), sizeof(CheckpointHeader));
+  fout.write(reinterpret_cast<const char*>(thread_states.data()), h.n_cores * sizeof(ThreadState));
+  fout.write(padding.data(), padding.size());
+  fout.write(reinterpret_cast<const char*>(embeddings_words), n * sizeof(double));
+  fout.write(reinterpret_cast<const char*>(embeddings_contexts_left), n * sizeof(double));
+  fout.write(reinterpret_cast<const char*>(embeddings_contexts_right), n * sizeof(double));
+
+  std::vector<int32_t> buffer;
+  for (auto& word : vocabulary) {
+    const int64_t length = word.size();
+    buffer.assign(word.begin(), word.end());
+    fout.write(reinterpret_cast<const char*>(&length), sizeof(int64_t));
+    fout.write(reinterpret_cast<const char*>(buffer.data()), length * sizeof(int32_t));
+  }
+  fout.close();
+  if (fout.fail()) return false;
+
+  return std::rename(path_tmp.c_str(), path.c_str()) == 0;
+}
+
+uint64_t hash_vocabulary(const std::vector<std::wstring>& vocabulary)
+{
+  // FNV-1a over code points, words separated by a zero
+  uint64_t hash = 14695981039346656037ULL;
+  for (auto& word : vocabulary) {
+    for (wchar_t c : word) {
+      hash ^= static_cast<uint32_t>(c);
+      hash *= 1099511628211ULL;
+    }
+    hash ^= 0;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
@@ -0,0 +1,79 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CHECKPOINT_MAGIC "WNECKPT"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ALIGNMENT 4096
+
+// Resumable position of one training thread.
+// A thread restarts at `i_str` of epoch `i_iteration` with its RNG in `randomstate`.
+struct ThreadState {
+  int64_t i_iteration;
+  int64_t i_str;
+  int64_t randomstate;
+};
+
+// Layout of a checkpoint file:
+//   header | thread states | (padding) | embeddings_words | embeddings_contexts_left
+//   | embeddings_contexts_right | vocabulary
+// The embedding matrices start on a page boundary so the file can be memory-mapped
+// and each matrix used in place as `size_vocabulary * dim_embedding` doubles.
+// The vocabulary is stored as (int64_t length, int32_t code points...) per word.
+struct CheckpointHeader {
+  char magic[8];
+  int64_t version;
+  int64_t size_vocabulary;
+  int64_t dim_embedding;
+  int64_t n_cores;
+  int64_t length_corpus;
+  int64_t n_iteration;
+  int64_t seed;
+  uint64_t hash_vocabulary;
+  int64_t offset_thread_states;
+  int64_t offset_embeddings;
+  int64_t offset_vocabulary;
+};
+
+class Checkpoint {
+private:
+  void* data;
+  int64_t size;
+
+public:
+  Checkpoint();
+  ~Checkpoint();
+  bool open(const std::string& path);
+  void close();
+
+  const CheckpointHeader& header() const;
+  const ThreadState* thread_states() const;
+  const double* embeddings_words() const;
+  const double* embeddings_contexts_left() const;
+  const double* embeddings_contexts_right() const;
+  void vocabulary(std::vector<std::wstring>& placeholder) const;
+
+  static bool write(const std::string& path,
+                    const CheckpointHeader& header,
+                    const std::vector<ThreadState>& thread_states,
+                    const double* embeddings_words,
+                    const double* embeddings_contexts_left,
+                    const double* embeddings_contexts_right,
+                    const std::vector<std::wstring>& vocabulary);
+};
+
+uint64_t hash_vocabulary(const std::vector<std::wstring>& vocabulary);
+
+#endif
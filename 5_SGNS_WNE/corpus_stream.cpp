@@ -0,0 +1,154 @@
+#include "corpus_stream.h"
+
+CorpusStreamer::CorpusStreamer(const std::string _path,
+                               const int64_t _size_chunk,
+                               const int64_t _length_overlap,
+                               const int64_t _n_prefetch,
+                               const int64_t _i_iteration_start,
+                               const int64_t _n_iteration)
+  : path(_path),
+    size_chunk(_size_chunk),
+    length_overlap(_length_overlap),
+    n_prefetch(_n_prefetch),
+    i_iteration_start(_i_iteration_start),
+    n_iteration(_n_iteration),
+    size_file(-1),
+    is_store(false),
+    is_reader_finished(false),
+    is_stopped(false)
+{
+  assert(size_chunk > 0);
+  assert(length_overlap >= 0);
+  assert(n_prefetch > 0);
+
+  if (CorpusStore::is_store(path)) {
+    if (!store.load_store(path)) return;
+    is_store = true;
+    size_file = store.size();
+  } else {
+    std::ifstream fin(path, std::ios::binary | std::ios::ate);
+    if (!fin.is_open()) return;
+    size_file = fin.tellg();
+    fin.close();
+  }
+
+  reader = std::thread(&CorpusStreamer::run_reader, this);
+}
+
+CorpusStreamer::~CorpusStreamer()
+{
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    is_stopped = true;
+  }
+  cv_not_full.notify_all();
+  if (reader.joinable()) reader.join();
+}
+
+bool CorpusStreamer::is_open() const {
+  return size_file >= 0;
+}
+
+int64_t CorpusStreamer::get_size_file() const {
+  return size_file;
+}
+
+bool CorpusStreamer::next(CorpusChunk& chunk)
+{
+  std::unique_lock<std::mutex> lock(mtx);
+  cv_not_empty.wait(lock, [this]{ return !queue.empty() || is_reader_finished; });
+  if (queue.empty()) return false;
+  chunk = std::move(queue.front());
+  queue.pop_front();
+  cv_not_full.notify_all();
+  return true;
+}
+
+bool CorpusStreamer::push(CorpusChunk& chunk)
+{
+  std::unique_lock<std::mutex> lock(mtx);
+  cv_not_full.wait(lock, [this]{ return static_cast<int64_t>(queue.size()) < n_prefetch || is_stopped; });
+  if (is_stopped) return false;
+  queue.push_back(std::move(chunk));
+  cv_not_empty.notify_all();
+  return true;
+}
+
+void CorpusStreamer::run_reader()
+{
+  std::vector<char> buffer(is_store ? 0 : size_chunk);
+
+  for (int64_t i_iteration=i_iteration_start; i_iteration<n_iteration; i_iteration++) {
+    if (is_store) read_store(i_iteration);
+    else read_text(i_iteration, buffer);
+    std::lock_guard<std::mutex> lock(mtx);
+    if (is_stopped) break;
+  }
+
+  std::lock_guard<std::mutex> lock(mtx);
+  is_reader_finished = true;
+  cv_not_empty.notify_all();
+}
+
+void CorpusStreamer::read_text(const int64_t i_iteration, std::vector<char>& buffer)
+{
+  std::ifstream fin(path, std::ios::binary);
+  std::wstring overlap;
+  int64_t n_carried = 0;     // bytes of an incomplete UTF-8 sequence at the end of the buffer
+  int64_t offset_read = 0;   // bytes read from the file
+  int64_t offset_train = 0;  // byte offset of the first position not trained yet
+
+  while (offset_read < size_file) {
+    fin.read(buffer.data() + n_carried, size_chunk - n_carried);
+    const int64_t n_read = fin.gcount();
+    if (n_read <= 0) break;
+    offset_read += n_read;
+    const bool is_last = (offset_read >= size_file);
+
+    CorpusChunk chunk;
+    chunk.text.swap(overlap);
+    const int64_t n_available = n_carried + n_read;
+    const int64_t n_decoded = decode_utf8(buffer.data(), n_available, chunk.text);
+    n_carried = n_available - n_decoded;
+    std::copy(buffer.begin() + n_decoded, buffer.begin() + n_available, buffer.begin());
+
+    // Keep the tail as the head of the next chunk
+    const int64_t length_text = chunk.text.size();
+    const int64_t length_tail = is_last ? 0 : std::min(length_overlap, length_text);
+    overlap.assign(chunk.text, length_text - length_tail, length_tail);
+    int64_t size_tail = n_carried;
+    for (wchar_t c : overlap) size_tail += length_utf8(c);
+
+    chunk.i_train_end = length_text - length_tail;
+    chunk.i_iteration = i_iteration;
+    chunk.offset_begin = offset_train;
+    chunk.offset_end = is_last ? size_file : offset_read - size_tail;
+    chunk.is_last_in_epoch = is_last;
+    offset_train = chunk.offset_end;
+
+    if (!push(chunk)) return;
+  }
+}
+
+void CorpusStreamer::read_store(const int64_t i_iteration)
+{
+  // Chunks hold about `size_chunk` bytes of ids. Each one covers the trained positions
+  // [offset_begin, offset_end) followed by `length_overlap` characters of right context.
+  const int64_t length_chunk = std::max<int64_t>(1, size_chunk / store.get_width());
+  const int64_t length_corpus = store.size();
+
+  for (int64_t offset_begin=0; offset_begin<length_corpus; offset_begin+=length_chunk) {
+    const int64_t offset_end = std::min(length_corpus, offset_begin + length_chunk);
+    const int64_t offset_context = std::min(length_corpus, offset_end + length_overlap);
+
+    CorpusChunk chunk;
+    store.substr(offset_begin, offset_context - offset_begin, chunk.text);
+    chunk.i_train_end = offset_end - offset_begin;
+    chunk.i_iteration = i_iteration;
+    chunk.offset_begin = offset_begin;
+    chunk.offset_end = offset_end;
+    chunk.is_last_in_epoch = (offset_end == length_corpus);
+
+    if (!push(chunk)) return;
+  }
+}
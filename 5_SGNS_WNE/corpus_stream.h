@@ -0,0 +1,78 @@
+#ifndef CORPUS_STREAM_H
+#define CORPUS_STREAM_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../common/utf8.h"
+#include "../common/corpus_store.h"
+
+#define SIZE_CHUNK_STREAM_DEFAULT (64 << 20)
+#define N_PREFETCH_CHUNKS 2
+
+// A piece of the corpus handed to the trainer.
+// Positions [0, i_train_end) of `text` are trained in this chunk and the rest only serves
+// as right context, to be trained in the next chunk, so that n-grams crossing chunk
+// boundaries are seen.
+struct CorpusChunk {
+  std::wstring text;
+  int64_t i_train_end;
+  int64_t i_iteration;
+  int64_t offset_begin;   // offset in the input where the trained positions start
+  int64_t offset_end;     // offset in the input where they end
+  bool is_last_in_epoch;
+};
+
+// Reads a UTF-8 corpus file in chunks of about `size_chunk` bytes, epoch after epoch.
+// A background thread decodes up to `n_prefetch` chunks ahead of the consumer, so
+// disk reads and decoding overlap with training and memory does not grow with the corpus.
+// A corpus store is mapped instead and offsets then count characters rather than bytes.
+class CorpusStreamer {
+private:
+  const std::string path;
+  const int64_t size_chunk;
+  const int64_t length_overlap;
+  const int64_t n_prefetch;
+  const int64_t i_iteration_start;
+  const int64_t n_iteration;
+
+  int64_t size_file;
+  CorpusStore store;
+  bool is_store;
+  std::deque<CorpusChunk> queue;
+  bool is_reader_finished;
+  bool is_stopped;
+  std::mutex mtx;
+  std::condition_variable cv_not_empty;
+  std::condition_variable cv_not_full;
+  std::thread reader;
+
+public:
+  CorpusStreamer(const std::string _path,
+                 const int64_t _size_chunk,
+                 const int64_t _length_overlap,
+                 const int64_t _n_prefetch,
+                 const int64_t _i_iteration_start,
+                 const int64_t _n_iteration);
+  ~CorpusStreamer();
+  bool is_open() const;
+  int64_t get_size_file() const;
+  bool next(CorpusChunk& chunk);
+
+private:
+  void run_reader();
+  void read_text(const int64_t i_iteration, std::vector<char>& buffer);
+  void read_store(const int64_t i_iteration);
+  bool push(CorpusChunk& chunk);
+};
+
+#endif
@@ -16,6 +16,8 @@
 
 #include "cmdline.h"
 #include "skipgram.h"
+#include "vocabulary_loader.h"
+#include "sweep.h"
 
 int main(int argc, char* argv[]) {
 
@@ -32,7 +34,12 @@ int main(int argc, char* argv[]) {
   a.add<std::string>("corpus_path", '\0', "corpus path", true);
   a.add<std::string>("word_data_path", '\0', "word_data_path", false);
   a.add<std::string>("ngram_data_path", '\0', "ngram_data_path", false);
-  a.add<std::string>("output_path", '\0', "output path", true);
+  a.add<std::string>("output_path", '\0', "output path", false);
+  a.add<std::string>("output_format", '\0', "output format (text, binary, npy, int8 or pq)", false, "text");
+  a.add<int64_t>("pq_subspaces", '\0', "subspaces of the pq output format (0: one per 4 dimensions)", false, 0);
+  a.add<int64_t>("pq_iteration", '\0', "k-means iterations of the pq output format", false, 10);
+  a.add<int64_t>("quantization_report_query", '\0', "words whose neighbours are compared after int8 or pq quantization (0: no report)", false, 100);
+  a.add("save_contexts", '\0', "also save left and right context embeddings");
 
   a.add<int64_t>("size_window", '\0', "size_window", true);
   a.add<int64_t>("dim_embedding", '\0', "dim_embedding", true);
@@ -46,12 +53,34 @@ int main(int argc, char* argv[]) {
   a.add<double>("power_unigram_table", '\0', "power_unigram_table", true);
 
   a.add<int64_t>("embed_num", '\0', "embed_num", true);
+
+  a.add<std::string>("checkpoint_path", '\0', "checkpoint_path", false);
+  a.add<int64_t>("checkpoint_interval", '\0', "checkpoint interval in seconds", false, 600);
+  a.add<std::string>("resume_from", '\0', "resume_from", false);
+  a.add<std::string>("continue_from", '\0', "checkpoint of a model to train further on --corpus_path, adding the new words of --word_data_path", false);
+  a.add<double>("known_learning_rate_ratio", '\0', "ratio of the learning rate for the words of --continue_from", false, 1.0);
+  a.add<int64_t>("stats_interval", '\0', "interval of training statistics in seconds (0: progress bar only)", false, 0);
+  a.add<std::string>("stats_path", '\0', "JSON lines file of training statistics", false);
+  a.add("stream_corpus", '\0', "stream the corpus from disk instead of loading it");
+  a.add<int64_t>("size_chunk", '\0', "bytes per chunk when streaming the corpus", false, SIZE_CHUNK_STREAM_DEFAULT);
+  a.add<std::string>("sweep_path", '\0', "train one model per line of this file, sharing the corpus and vocabulary", false);
+  a.add<int64_t>("sweep_parallel", '\0', "models of the sweep trained at the same time", false, 1);
+  a.add<int64_t>("n_processes", '\0', "training processes of --n_cores threads, each on its part of the corpus, merging their models", false, 1);
+  a.add<int64_t>("sync_interval", '\0', "positions trained by each process between two merges of the models", false, 1000000);
+  a.add("bind_cores", '\0', "bind each training process to --n_cores consecutive cores");
+  a.add<double>("held_out_ratio", '\0', "fraction of the corpus, at its end, held out to evaluate the loss after each epoch and stop early (0: off)", false, 0);
+  a.add<double>("min_improvement", '\0', "relative decrease of the held-out loss in an epoch below which one last epoch is trained", false, 0.005);
   a.parse_check(argc, argv);
 
   std::string corpus_path = a.get<std::string>("corpus_path");
   std::string word_data_path = a.get<std::string>("word_data_path");
   std::string ngram_data_path = a.get<std::string>("ngram_data_path");
   std::string output_path = a.get<std::string>("output_path");
+  std::string output_format = a.get<std::string>("output_format");
+  bool save_contexts = a.exist("save_contexts");
+  int64_t pq_subspaces = a.get<int64_t>("pq_subspaces");
+  int64_t pq_iteration = a.get<int64_t>("pq_iteration");
+  int64_t quantization_report_query = a.get<int64_t>("quantization_report_query");
 
   int64_t size_window = a.get<int64_t>("size_window");
   int64_t dim_embedding = a.get<int64_t>("dim_embedding");
@@ -66,84 +95,201 @@ int main(int argc, char* argv[]) {
 
   int64_t embed_num = a.get<int64_t>("embed_num");
 
-  // Load corpus
-  std::wifstream fin_corpus(corpus_path);
+  std::string checkpoint_path = a.get<std::string>("checkpoint_path");
+  int64_t checkpoint_interval = a.get<int64_t>("checkpoint_interval");
+  std::string resume_from = a.get<std::string>("resume_from");
+  std::string continue_from = a.get<std::string>("continue_from");
+  double known_learning_rate_ratio = a.get<double>("known_learning_rate_ratio");
+  int64_t stats_interval = a.get<int64_t>("stats_interval");
+  std::string stats_path = a.get<std::string>("stats_path");
+  if (!stats_path.empty() && stats_interval == 0) stats_interval = 10;
+  bool stream_corpus = a.exist("stream_corpus");
+  int64_t size_chunk = a.get<int64_t>("size_chunk");
+  std::string sweep_path = a.get<std::string>("sweep_path");
+  int64_t sweep_parallel = a.get<int64_t>("sweep_parallel");
+  int64_t n_processes = a.get<int64_t>("n_processes");
+  int64_t sync_interval = a.get<int64_t>("sync_interval");
+  bool bind_cores = a.exist("bind_cores");
+  double held_out_ratio = a.get<double>("held_out_ratio");
+  double min_improvement = a.get<double>("min_improvement");
+
+  if (!SkipGram::is_valid_output_format(output_format)) {
+    std::cout << "Invalid output format." << std::endl;
+    return 0;
+  }
+  if (pq_subspaces < 0 || pq_subspaces > dim_embedding || pq_iteration < 0 || quantization_report_query < 0) {
+    std::cout << "Invalid quantization settings." << std::endl;
+    return 0;
+  }
+  if (known_learning_rate_ratio < 0) {
+    std::cout << "--known_learning_rate_ratio must not be negative." << std::endl;
+    return 0;
+  }
+
+  if (n_processes <= 0 || sync_interval <= 0) {
+    std::cout << "--n_processes and --sync_interval must be positive." << std::endl;
+    return 0;
+  }
+  if (n_processes > 1 && (stream_corpus || !sweep_path.empty() || !checkpoint_path.empty() || !resume_from.empty())) {
+    std::cout << "--n_processes cannot be combined with --stream_corpus, --sweep_path, --checkpoint_path or --resume_from." << std::endl;
+    return 0;
+  }
+
+  if (held_out_ratio < 0 || held_out_ratio >= 1) {
+    std::cout << "--held_out_ratio must be in [0, 1)." << std::endl;
+    return 0;
+  }
+  if (min_improvement < 0) {
+    std::cout << "--min_improvement must not be negative." << std::endl;
+    return 0;
+  }
+  if (held_out_ratio > 0 && (stream_corpus || !sweep_path.empty() || !resume_from.empty() || n_processes > 1)) {
+    std::cout << "--held_out_ratio cannot be combined with --stream_corpus, --sweep_path, --resume_from or --n_processes." << std::endl;
+    return 0;
+  }
+
+  // Models of a sweep, each overriding the parameters given above
+  std::vector<SweepConfig> sweep_configs;
+  if (!sweep_path.empty()) {
+    if (stream_corpus || !resume_from.empty() || !continue_from.empty()) {
+      std::cout << "--sweep_path cannot be combined with --stream_corpus, --resume_from or --continue_from." << std::endl;
+      return 0;
+    }
+    if (sweep_parallel <= 0 || (sweep_parallel > 1 && (!checkpoint_path.empty() || stats_interval > 0))) {
+      std::cout << "--checkpoint_path and --stats_interval need --sweep_parallel=1." << std::endl;
+      return 0;
+    }
+    const SweepConfig base{output_path, size_window, dim_embedding, seed, n_iteration, n_negative_sample,
+                           learning_rate, rate_sample, power_unigram_table};
+    if (!load_sweep_configs(sweep_path, base, sweep_configs)) return 0;
+  } else if (output_path.empty()) {
+    std::cout << "--output_path is needed." << std::endl;
+    return 0;
+  }
+
+  // Load corpus (UTF-8 text or corpus store), unless it is streamed from disk during training
+  std::ifstream fin_corpus(corpus_path);
   if (!fin_corpus.is_open()) {
     std::cout << "Invalid file name." << std::endl;
     return 0;
   }
-  std::wstringstream wss;
-  wss << fin_corpus.rdbuf();
-  std::wstring corpus = wss.str();
   fin_corpus.close();
+  CorpusStore corpus;
+  if (!stream_corpus && !corpus.load(corpus_path, n_cores)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
 
   // Load extracted words data
-  std::wifstream fin_word(word_data_path);
-  if (!fin_word.is_open()) {
+  std::vector<std::wstring> vocabulary;
+  if (!load_vocabulary(word_data_path, embed_num, vocabulary)) {
     std::cout << "Invalid file name." << std::endl;
     return 0;
   }
-  std::wstringstream wss2_w;
-  wss2_w << fin_word.rdbuf();
-  std::vector<std::wstring> vocabulary;
-  std::unordered_map<std::wstring, int64_t> vocabulary2id_tmp;
-  std::wstring linedata_w;
-  int64_t id = 0;
-  int64_t pos_w;
-  std::wstring n_w;
-  std::wstring delim_w = L"\t";
-  while(embed_num && std::getline(wss2_w, linedata_w)){
-    embed_num--;
-    pos_w = linedata_w.find(delim_w);
-    n_w = linedata_w.substr(0, pos_w);
-    vocabulary.push_back(n_w);
-    vocabulary2id_tmp[n_w] = id;
-    id++;
-  }
-  fin_word.close();
-  assert(vocabulary.size() == id);
-    
+
+  // A continued model keeps its words and ids, followed by the new words
+  if (!continue_from.empty()) {
+    Checkpoint checkpoint;
+    if (!checkpoint.open(continue_from)) {
+      std::cout << "Invalid checkpoint file." << std::endl;
+      return 0;
+    }
+    std::vector<std::wstring> vocabulary_known;
+    checkpoint.vocabulary(vocabulary_known);
+    expand_vocabulary(vocabulary_known, vocabulary);
+  }
+
   // Load extracted n-grams data
-  std::wifstream fin_ngram(ngram_data_path);
-  if (!fin_ngram.is_open()) {
+  std::vector<int64_t> count_vocabulary;
+  if (!load_count_vocabulary(ngram_data_path, vocabulary, n_cores, count_vocabulary)) {
     std::cout << "Invalid file name." << std::endl;
     return 0;
   }
-  std::wstringstream wss2;
-  wss2 << fin_ngram.rdbuf();
-  int64_t* count_vocabulary_tmp = new int64_t[vocabulary.size()];
-  // initialize the occuerrence of words with 1
-  for(int64_t i = 0; i < vocabulary.size(); i++){
-    count_vocabulary_tmp[i] = 1;
-  }
-  std::wstring linedata;
-  int64_t pos;
-  std::wstring n;
-  std::wstring delim = L"\t";
-  while(std::getline(wss2, linedata)){
-    pos = linedata.find(delim);
-    n = linedata.substr(0, pos);
-    std::wistringstream wstrm(linedata.substr(pos+delim.length(), std::wstring::npos));
-    int64_t number;
-    wstrm >> number;
-    if (vocabulary2id_tmp.find(n) != vocabulary2id_tmp.end()) count_vocabulary_tmp[vocabulary2id_tmp[n]] = number;
-  }
-  fin_ngram.close();
-  std::vector<int64_t> count_vocabulary(count_vocabulary_tmp, &count_vocabulary_tmp[vocabulary.size()]);
   assert(count_vocabulary.size() == vocabulary.size());
 
+  // Train the models of the sweep on one copy of the corpus and vocabulary
+  if (!sweep_configs.empty()) {
+    const std::shared_ptr<const VocabularyIndex> index = std::make_shared<const VocabularyIndex>(vocabulary, count_vocabulary);
+    std::vector<std::wstring>().swap(vocabulary);
+    std::vector<int64_t>().swap(count_vocabulary);
+    Sweep sweep(corpus, index, sweep_configs, n_cores, sweep_parallel, output_format, save_contexts);
+    if (!checkpoint_path.empty()) {
+      sweep.set_checkpoint(checkpoint_path, checkpoint_interval);
+    }
+    sweep.set_stats(stats_path, stats_interval);
+    sweep.set_quantization(pq_subspaces, pq_iteration, quantization_report_query);
+    sweep.run();
+    return 0;
+  }
+
   // Word embedding
   SkipGram sg(corpus, vocabulary, count_vocabulary,
               size_window, dim_embedding, seed,
               n_iteration, n_negative_sample, n_cores,
               learning_rate, rate_sample, power_unigram_table);
-  auto t1 = std::chrono::high_resolution_clock::now();
-  sg.train();
-  auto t2 = std::chrono::high_resolution_clock::now();
-  std::cout << "Training took "
-            << std::chrono::duration_cast<std::chrono::milliseconds>(t2-t1).count()
-            << " milliseconds\n";
-  sg.save_vector(output_path);
+  // An interrupted continued training resumes from its own checkpoint
+  if (!continue_from.empty() && !sg.continue_from(continue_from)) {
+    return 0;
+  }
+  sg.set_learning_rate_known(known_learning_rate_ratio);
+  if (!resume_from.empty() && !sg.load_checkpoint(resume_from)) {
+    return 0;
+  }
+  if (!checkpoint_path.empty()) {
+    sg.set_checkpoint(checkpoint_path, checkpoint_interval);
+  }
+  sg.set_stats(stats_path, stats_interval);
+  sg.set_quantization(pq_subspaces, pq_iteration, quantization_report_query);
+  if (!sg.set_early_stopping(held_out_ratio, min_improvement)) {
+    return 0;
+  }
+  auto train = [&]() {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    if (stream_corpus) {
+      sg.train_stream(corpus_path, size_chunk);
+    } else {
+      sg.train();
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    std::cout << "Training took "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(t2-t1).count()
+              << " milliseconds\n";
+  };
+  auto save = [&]() {
+    sg.save_vector(output_path, output_format);
+    if (save_contexts) {
+      sg.save_context_vector(output_path, output_format);
+    }
+  };
+
+  if (n_processes == 1) {
+    train();
+    save();
+    return 0;
+  }
+
+  // Processes forked from this one share the corpus and vocabulary loaded above and
+  // train their copies of the model, which they merge through a shared memory segment.
+  // The first process reports progress and saves the final, merged, model.
+  SharedModel shared;
+  if (!shared.create(n_processes, 3 * static_cast<int64_t>(vocabulary.size()) * dim_embedding)) {
+    std::cout << "Could not create the shared memory segment of the model." << std::endl;
+    return 0;
+  }
+  std::cout << "Training with " << n_processes << " processes of " << n_cores << " threads, merging every "
+            << sync_interval << " positions" << std::endl;
+  run_processes(shared, n_processes, bind_cores ? n_cores : 0, [&](const int64_t rank) {
+    sg.share_parameters(shared, rank, sync_interval);
+    if (rank > 0) {
+      sg.show_progress(false);
+      sg.set_stats("", 0);
+      sg.train();
+    } else {
+      train();
+      if (!shared.is_aborted()) save();
+    }
+    return shared.is_aborted() ? 1 : 0;
+  });
 
   return 0;
 }
@@ -0,0 +1,154 @@
+#include "shared_model.h"
+
+bool SharedModel::create(const int64_t n_processes, const int64_t n_parameters)
+{
+  assert(n_processes > 0);
+  assert(n_parameters >= 0);
+  close();
+
+  const std::string name = "/wne_sgns_" + std::to_string(getpid());
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) return false;
+  shm_unlink(name.c_str());
+
+  // Reserve the pages now; tmpfs would otherwise fail on first write with SIGBUS
+  const int64_t size = SHARED_MODEL_ALIGNMENT + (n_processes + 1) * n_parameters * sizeof(double);
+  if (posix_fallocate(fd, 0, size) != 0) {
+    ::close(fd);
+    return false;
+  }
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) return false;
+  mapped = p;
+  size_mapped = size;
+
+  header = new (mapped) SharedModelHeader();
+  std::memcpy(header->magic, SHARED_MODEL_MAGIC, sizeof(header->magic));
+  header->n_processes = n_processes;
+  header->n_parameters = n_parameters;
+  header->n_arrived.store(0);
+  header->generation.store(0);
+  header->is_aborted.store(0);
+  parameters_all = reinterpret_cast<double*>(static_cast<char*>(mapped) + SHARED_MODEL_ALIGNMENT);
+  return true;
+}
+
+void SharedModel::close()
+{
+  if (mapped != nullptr) munmap(mapped, size_mapped);
+  mapped = nullptr;
+  size_mapped = 0;
+  header = nullptr;
+  parameters_all = nullptr;
+}
+
+// Generation barrier; the last process to arrive opens the next generation
+bool SharedModel::wait_all()
+{
+  const int64_t generation = header->generation.load();
+  if (header->n_arrived.fetch_add(1) + 1 == header->n_processes) {
+    header->n_arrived.store(0);
+    header->generation.fetch_add(1);
+    return !is_aborted();
+  }
+  for (int64_t n_spin=0; header->generation.load() == generation; n_spin++) {
+    if (is_aborted()) return false;
+    if (n_spin < 1000) {
+      std::this_thread::yield();
+    } else {
+      usleep(100);
+    }
+  }
+  return !is_aborted();
+}
+
+bool SharedModel::synchronize(const int64_t rank, const int64_t n_threads)
+{
+  assert(rank >= 0 && rank < header->n_processes);
+  assert(n_threads > 0);
+
+  // Every slot has stopped changing
+  if (!wait_all()) return false;
+
+  const int64_t n_processes = header->n_processes;
+  const int64_t n_parameters = header->n_parameters;
+  const int64_t i_begin = rank * n_parameters / n_processes;
+  const int64_t i_end = (rank + 1) * n_parameters / n_processes;
+  const int64_t length_thread = (i_end - i_begin + n_threads - 1) / n_threads;
+  double* parameters_base = parameters(n_processes);
+  auto merge = [&](const int64_t i_thread_begin, const int64_t i_thread_end) {
+    for (int64_t i=i_thread_begin; i<i_thread_end; i++) {
+      double merged = parameters_base[i];
+      for (int64_t p=0; p<n_processes; p++) merged += parameters(p)[i] - parameters_base[i];
+      for (int64_t p=0; p<n_processes; p++) parameters(p)[i] = merged;
+      parameters_base[i] = merged;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int64_t id_thread=1; id_thread<n_threads; id_thread++) {
+    const int64_t i_thread_begin = std::min(i_end, i_begin + id_thread * length_thread);
+    threads.push_back(std::thread(merge, i_thread_begin, std::min(i_end, i_thread_begin + length_thread)));
+  }
+  merge(i_begin, std::min(i_end, i_begin + length_thread));
+  for (auto& t : threads) t.join();
+
+  // Nobody trains again before every range is merged
+  return wait_all();
+}
+
+static void bind_cores(const int64_t rank, const int64_t n_cores_bound)
+{
+  const int64_t n_cpus = std::max<long>(1, sysconf(_SC_NPROCESSORS_ONLN));
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int64_t i=rank*n_cores_bound; i<(rank+1)*n_cores_bound; i++) CPU_SET(i % n_cpus, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    std::cout << "Could not bind process " << rank << " to its cores." << std::endl;
+  }
+}
+
+bool run_processes(SharedModel& shared,
+                   const int64_t n_processes,
+                   const int64_t n_cores_bound,
+                   const std::function<int(const int64_t)>& work)
+{
+  // Buffered output would otherwise be written again by every child
+  std::cout << std::flush;
+  std::wcout << std::flush;
+
+  const pid_t pid_parent = getpid();
+  std::vector<pid_t> pids;
+  for (int64_t rank=0; rank<n_processes; rank++) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+      std::cout << "Could not start training process " << rank << "." << std::endl;
+      shared.abort();
+      break;
+    }
+    if (pid == 0) {
+      // Nobody would abort the group once the coordinator is gone
+      prctl(PR_SET_PDEATHSIG, SIGKILL);
+      if (getppid() != pid_parent) _exit(1);
+      if (n_cores_bound > 0) bind_cores(rank, n_cores_bound);
+      const int status = work(rank);
+      std::cout << std::flush;
+      std::wcout << std::flush;
+      _exit(status);
+    }
+    pids.push_back(pid);
+  }
+
+  bool is_succeeded = (pids.size() == n_processes);
+  for (int64_t n_running=pids.size(); n_running>0; n_running--) {
+    int status;
+    const pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) break;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+    const int64_t rank = std::find(pids.begin(), pids.end(), pid) - pids.begin();
+    std::cout << "Training process " << rank << " failed." << std::endl;
+    shared.abort();
+    is_succeeded = false;
+  }
+  return is_succeeded;
+}
@@ -0,0 +1,92 @@
+#ifndef SHARED_MODEL_H
+#define SHARED_MODEL_H
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define SHARED_MODEL_MAGIC "WNESHARE"
+#define SHARED_MODEL_ALIGNMENT 4096
+
+// Control block at the head of the segment. The atomics are lock-free, hence usable
+// from every process mapping the segment.
+struct SharedModelHeader {
+  char magic[8];
+  int64_t n_processes;
+  int64_t n_parameters;
+  std::atomic<int64_t> n_arrived;
+  std::atomic<int64_t> generation;
+  std::atomic<int64_t> is_aborted;
+};
+
+// Parameters of the training processes of one machine in a POSIX shared memory segment:
+//   header | (padding) | parameters of process 0 | ... | parameters of process n - 1 | base
+// Each process trains its own copy of the model, the slot of its rank, from the base,
+// the parameters of the last synchronization. At every synchronize() all processes
+// meet, and each one merges a range of the parameters: the updates of all processes
+// since the base are added to it, and every slot and the base are set to the result.
+// Summing rather than averaging the updates keeps the step of each process; a mean
+// would divide it by the number of processes.
+// The segment is unlinked as soon as it is mapped and reaches the processes by fork(),
+// so nothing is left in /dev/shm whichever way they end.
+class SharedModel {
+private:
+  void* mapped;
+  int64_t size_mapped;
+  SharedModelHeader* header;
+  double* parameters_all;
+
+public:
+  SharedModel() : mapped(nullptr), size_mapped(0), header(nullptr), parameters_all(nullptr) {}
+  ~SharedModel() { close(); }
+
+  // `n_parameters` doubles per process; false if /dev/shm cannot hold them
+  bool create(const int64_t n_processes, const int64_t n_parameters);
+  void close();
+
+  int64_t get_n_processes() const { return header->n_processes; }
+  int64_t get_n_parameters() const { return header->n_parameters; }
+  // Slot of process `rank`, or the base for rank == n_processes
+  double* parameters(const int64_t rank) const { return parameters_all + rank * header->n_parameters; }
+
+  // Merges the slots of all processes, the range of `rank` on n_threads threads.
+  // Blocks until every process has called it; false once the group is aborted.
+  bool synchronize(const int64_t rank, const int64_t n_threads);
+  void abort() { header->is_aborted.store(1); }
+  bool is_aborted() const { return header->is_aborted.load() != 0; }
+
+private:
+  bool wait_all();
+
+  SharedModel(const SharedModel&);
+  SharedModel& operator=(const SharedModel&);
+};
+
+// Runs work(rank) in n_processes forked processes and waits for them; they are killed
+// if the calling process dies. The first one failing (non-zero status or signal)
+// aborts `shared`, so that the others leave their next synchronization instead of
+// waiting for it forever. With n_cores_bound > 0, process `rank` is bound to the cores
+// [rank * n_cores_bound, (rank + 1) * n_cores_bound).
+bool run_processes(SharedModel& shared,
+                   const int64_t n_processes,
+                   const int64_t n_cores_bound,
+                   const std::function<int(const int64_t)>& work);
+
+#endif
@@ -1,6 +1,6 @@
 #include "skipgram.h"
 
-SkipGram::SkipGram(const std::wstring& _corpus,
+SkipGram::SkipGram(const CorpusStore& _corpus,
                    const std::vector<std::wstring>& _vocabulary,
                    const std::vector<int64_t>& _count_vocabulary,
                    const int64_t _size_window,
@@ -12,9 +12,28 @@ SkipGram::SkipGram(const std::wstring& _corpus,
                    const double _learning_rate,
                    const double _rate_sample,
                    const double _power_unigram_table)
+  : SkipGram(_corpus, std::make_shared<const VocabularyIndex>(_vocabulary, _count_vocabulary),
+             _size_window, _dim_embedding, _seed, _n_iteration, _n_negative_sample, _n_cores,
+             _learning_rate, _rate_sample, _power_unigram_table)
+{
+}
+
+SkipGram::SkipGram(const CorpusStore& _corpus,
+                   const std::shared_ptr<const VocabularyIndex> _index,
+                   const int64_t _size_window,
+                   const int64_t _dim_embedding,
+                   const int64_t _seed,
+                   const int64_t _n_iteration,
+                   const int64_t _n_negative_sample,
+                   const int64_t _n_cores,
+                   const double _learning_rate,
+                   const double _rate_sample,
+                   const double _power_unigram_table)
   : corpus(_corpus),
-    vocabulary(_vocabulary),
-    count_vocabulary(_count_vocabulary),
+    index(_index),
+    vocabulary(_index->vocabulary),
+    count_vocabulary(_index->count_vocabulary),
+    vocabulary2id(_index->vocabulary2id),
     size_window(_size_window),
     dim_embedding(_dim_embedding),
     seed(_seed),
@@ -23,7 +42,30 @@ SkipGram::SkipGram(const std::wstring& _corpus,
     n_cores(_n_cores),
     learning_rate(_learning_rate),
     rate_sample(_rate_sample),
-    power_unigram_table(_power_unigram_table)
+    power_unigram_table(_power_unigram_table),
+    checkpoint_interval(0),
+    id_checkpoint_requested(0),
+    is_training_done(false),
+    stats_interval(0),
+    length_corpus_streamed(0),
+    is_progress_shown(true),
+    pq_subspaces(0),
+    pq_iteration(10),
+    n_quantization_query(100),
+    size_vocabulary_known(0),
+    ratio_learning_rate_known(1),
+    shared_model(nullptr),
+    rank_process(0),
+    sync_interval(0),
+    n_threads_synchronizing(0),
+    id_synchronization(0),
+    is_synchronization_failed(false),
+    length_held_out(0),
+    min_improvement(0),
+    loss_held_out_last(0),
+    n_iteration_planned(_n_iteration),
+    i_iteration_plan(0),
+    learning_rate_plan(_learning_rate)
 {
 
   // Check given parameter
@@ -39,22 +81,22 @@ SkipGram::SkipGram(const std::wstring& _corpus,
 
   // Parameter setting
   size_vocabulary = vocabulary.size();
-  sum_count_vocabulary = std::accumulate(count_vocabulary.begin(), count_vocabulary.end(), 0);
-  max_length_word = 0;
-  for (auto &v : vocabulary) {
-    const int64_t length = v.size();
-    if (length > max_length_word) max_length_word = length;
-  }
+  sum_count_vocabulary = index->sum_count_vocabulary;
+  max_length_word = index->max_length_word;
 
   cheaprand = CheapRand(seed);
 
-  for (int64_t i=0; i<size_vocabulary; i++) {
-    vocabulary2id[vocabulary[i]] = i;
-  }
-
   initialize_parameters();
   construct_unigramtable(power_unigram_table);
 
+  // Every thread starts at the head of its chunk with its own seed
+  for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+    thread_states.push_back(ThreadState{0, 0, id_thread + seed});
+  }
+  id_checkpoint_served.assign(n_cores, 0);
+  is_thread_finished.assign(n_cores, false);
+  thread_stats = std::vector<ThreadStats>(n_cores);
+
   std::wcout << std::endl;
   std::wcout << "###### SGNS-WNE ######" << std::endl;
   std::wcout << "corpus.size()       : " << corpus.size() << std::endl;
@@ -73,9 +115,12 @@ SkipGram::SkipGram(const std::wstring& _corpus,
 }
 
 SkipGram::~SkipGram() {
-  delete[] embeddings_words;
-  delete[] embeddings_contexts_left;
-  delete[] embeddings_contexts_right;
+  // Shared parameters belong to the segment
+  if (shared_model == nullptr) {
+    delete[] embeddings_words;
+    delete[] embeddings_contexts_left;
+    delete[] embeddings_contexts_right;
+  }
   delete[] table_unigram;
 }
 
@@ -97,11 +142,24 @@ void SkipGram::initialize_parameters() {
 }
 
 void SkipGram::train() {
-  const int64_t length_corpus = corpus.size();
-  const int64_t length_chunk = length_corpus / n_cores;
-  int64_t i_corpus_start = 0;
+  // Processes sharing a model split the corpus, so that every thread of every process
+  // has a chunk of the same length and they all reach each synchronization
+  const int64_t n_processes = (shared_model == nullptr) ? 1 : shared_model->get_n_processes();
+  const int64_t length_corpus = corpus.size() - length_held_out;
+  const int64_t length_chunk = length_corpus / (n_processes * n_cores);
+  int64_t i_corpus_start = rank_process * n_cores * length_chunk;
   std::vector<std::thread> vector_threads(n_cores);
 
+  is_thread_finished.assign(n_cores, false);
+  id_checkpoint_served.assign(n_cores, id_checkpoint_requested.load());
+
+  // Periodic checkpoints and statistics are handled by background threads
+  std::thread stats_reporter = start_monitoring();
+  std::thread checkpointer;
+  if (!checkpoint_path.empty() && checkpoint_interval > 0) {
+    checkpointer = std::thread(&SkipGram::run_checkpointer, this);
+  }
+
   for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
     vector_threads.at(id_thread) = std::thread(&SkipGram::train_model_eachthread,
                                                this,
@@ -113,6 +171,123 @@ void SkipGram::train() {
   for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
     vector_threads.at(id_thread).join();
   }
+
+  stop_monitoring(stats_reporter);
+  if (checkpointer.joinable()) checkpointer.join();
+  if (length_held_out > 0 && n_iteration_planned < n_iteration) {
+    std::wcout << "Stopped after " << n_iteration_planned << " of " << n_iteration << " epochs" << std::endl;
+  }
+  if (!checkpoint_path.empty()) save_checkpoint(checkpoint_path);
+}
+
+void SkipGram::train_stream(const std::string corpus_path, const int64_t size_chunk)
+{
+  // Epochs are streamed from the last one every thread has completed
+  int64_t i_iteration_start = n_iteration;
+  for (auto& state : thread_states) i_iteration_start = std::min(i_iteration_start, state.i_iteration);
+
+  // A position needs the center word and the contexts of size_window segments after it
+  const int64_t length_overlap = (std::max<int64_t>(1, size_window) + 1) * max_length_word - 1;
+  CorpusStreamer streamer(corpus_path, size_chunk, length_overlap, N_PREFETCH_CHUNKS,
+                          i_iteration_start, n_iteration);
+  if (!streamer.is_open()) {
+    std::cout << "Invalid file name." << std::endl;
+    return;
+  }
+  const int64_t size_file = std::max<int64_t>(1, streamer.get_size_file());
+
+  std::vector<TrainingWorkspace> workspaces(n_cores);
+  for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+    workspaces[id_thread].gradient_words.resize(dim_embedding);
+    workspaces[id_thread].cheaprand.set_randomstate(thread_states[id_thread].randomstate);
+    workspaces[id_thread].stats = ThreadStatsSnapshot();
+    workspaces[id_thread].stats.learning_rate = learning_rate;
+  }
+  std::vector<std::thread> vector_threads(n_cores);
+  std::thread stats_reporter = start_monitoring();
+  const bool is_stats_enabled = (stats_interval > 0);
+  const bool is_progress_printed = !is_stats_enabled && is_progress_shown;
+  int64_t length_epoch = 0;
+
+  if (is_progress_printed) std::wcout << std::endl;
+
+  CorpusChunk chunk;
+  while (streamer.next(chunk)) {
+    // Positions of the chunk are split among threads, which may read across their
+    // boundaries up to the end of the chunk
+    const int64_t length_thread = (chunk.i_train_end + n_cores - 1) / n_cores;
+    const double progress_begin = (chunk.i_iteration * size_file + chunk.offset_begin) / static_cast<double>(n_iteration * size_file);
+    const double progress_end = (chunk.i_iteration * size_file + chunk.offset_end) / static_cast<double>(n_iteration * size_file);
+
+    for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+      vector_threads.at(id_thread) = std::thread([&, id_thread]() {
+        TrainingWorkspace& workspace = workspaces[id_thread];
+        const int64_t i_begin = std::min(chunk.i_train_end, id_thread * length_thread);
+        const int64_t i_end = std::min(chunk.i_train_end, (id_thread + 1) * length_thread);
+        const int64_t length_text = chunk.text.size();
+
+        for (int64_t i_str=i_begin; i_str<i_end; i_str++) {
+          double ratio_completed = progress_begin + (progress_end - progress_begin) * i_str / std::max<int64_t>(1, chunk.i_train_end);
+          if (ratio_completed > 0.9999) ratio_completed = 0.9999;
+          const double _learning_rate = learning_rate * (1 - ratio_completed);
+
+          if (is_stats_enabled && (i_str - i_begin) % SIZE_CHUNK_PROGRESSBAR == 0) {
+            workspace.stats.progress = ratio_completed;
+            workspace.stats.publish(thread_stats[id_thread]);
+          }
+          train_position(chunk.text, i_str, length_text, _learning_rate, workspace);
+        }
+        workspace.stats.progress = progress_end;
+        workspace.stats.publish(thread_stats[id_thread]);
+      });
+    }
+    for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+      vector_threads.at(id_thread).join();
+    }
+
+    if (is_progress_printed) {
+      std::wcout << "\rProgress : "
+                 << std::fixed << std::setprecision(2) << 100 * progress_end
+                 << "%     " << std::flush;
+    }
+
+    // Epochs end on a consistent state, which is checkpointed
+    length_epoch += chunk.i_train_end;
+    if (chunk.is_last_in_epoch) {
+      length_corpus_streamed = length_epoch;
+      length_epoch = 0;
+      for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+        thread_states[id_thread] = ThreadState{chunk.i_iteration + 1, 0, workspaces[id_thread].cheaprand.get_randomstate()};
+      }
+      if (!checkpoint_path.empty()) {
+        if (is_progress_printed) std::wcout << std::endl;
+        save_checkpoint(checkpoint_path);
+      }
+    }
+  }
+
+  if (is_progress_printed) std::wcout << std::endl << std::flush;
+  stop_monitoring(stats_reporter);
+}
+
+std::thread SkipGram::start_monitoring()
+{
+  is_training_done = false;
+  for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+    ThreadStatsSnapshot().publish(thread_stats[id_thread]);
+  }
+  if (stats_interval > 0) return std::thread(&SkipGram::run_stats_reporter, this);
+  return std::thread();
+}
+
+void SkipGram::stop_monitoring(std::thread& stats_reporter)
+{
+  {
+    std::lock_guard<std::mutex> lock(mtx_training);
+    is_training_done = true;
+  }
+  cv_training.notify_all();
+  if (stats_reporter.joinable()) stats_reporter.join();
 }
 
 void SkipGram::train_model_eachthread(const int64_t id_thread,
@@ -120,120 +295,743 @@ void SkipGram::train_model_eachthread(const int64_t id_thread,
                                       const int64_t length_str,
                                       const int64_t n_cores)
 {
-  const std::wstring corpus_thread = corpus.substr(i_corpus_start, length_str);
-  std::unordered_map<std::wstring, int64_t> vocabulary2id_thread = vocabulary2id;
-  std::vector<int64_t> count_vocabulary_thread = count_vocabulary;
+  TrainingWorkspace workspace;
+  workspace.gradient_words.resize(dim_embedding);
+
+  // Resume from the published state (the head of the chunk unless loaded from a checkpoint)
+  const ThreadState state_start = thread_states[id_thread];
+  workspace.cheaprand.set_randomstate(state_start.randomstate);
+  int64_t id_checkpoint_served_thread = id_checkpoint_served[id_thread];
 
-  double* gradient_words = new double[dim_embedding];
-  CheapRand cheaprand_thread(id_thread + seed);
+  // The progress bar is replaced by the statistics reporter when it runs
+  const bool is_stats_enabled = (stats_interval > 0);
+  const bool is_progress_printer = (id_thread == n_cores - 1) && !is_stats_enabled && is_progress_shown;
+  ThreadStatsSnapshot& stats = workspace.stats;
+  stats = ThreadStatsSnapshot();
+  stats.learning_rate = learning_rate;
 
-  if (id_thread == n_cores - 1) std::wcout << std::endl;
+  if (is_progress_printer) std::wcout << std::endl;
 
-  for (int64_t i_iteration=0; i_iteration<n_iteration; i_iteration++) {
+  const int64_t sync_interval_thread = std::max<int64_t>(1, sync_interval / n_cores);
+
+  // n_iteration_planned only changes at the end of an epoch, while every thread waits
+  for (int64_t i_iteration=state_start.i_iteration; i_iteration<n_iteration_planned; i_iteration++) {
     // For each position in corpus
-    for (int64_t i_str=0; i_str<length_str; i_str++) {
+    const int64_t i_str_start = (i_iteration == state_start.i_iteration) ? state_start.i_str : 0;
+    for (int64_t i_str=i_str_start; i_str<length_str; i_str++) {
+
+      if (shared_model != nullptr && (i_iteration * length_str + i_str) % sync_interval_thread == 0
+          && (i_iteration * length_str + i_str) > 0 && !synchronize_processes()) {
+        return;
+      }
+
+      if (id_checkpoint_requested.load(std::memory_order_relaxed) != id_checkpoint_served_thread) {
+        const ThreadState state{i_iteration, i_str, workspace.cheaprand.get_randomstate()};
+        id_checkpoint_served_thread = publish_thread_state(id_thread, state, false);
+      }
 
-      if (id_thread == n_cores - 1) {
-        const int64_t i_progress = i_iteration * length_str + i_str;
-        if (i_progress % SIZE_CHUNK_PROGRESSBAR == 0) {
+      const int64_t i_progress = i_iteration * length_str + i_str;
+      if (i_progress % SIZE_CHUNK_PROGRESSBAR == 0) {
+        if (is_progress_printer) {
           // Print progress
-          const double percent = 100 * (double)i_progress / (n_iteration * length_str);
+          const double percent = 100 * (double)i_progress / (n_iteration_planned * length_str);
           std::wcout << "\rProgress : "
                      << std::fixed << std::setprecision(2) << percent
                      << "%     " << std::flush;
         }
+        if (is_stats_enabled) {
+          stats.progress = i_progress / static_cast<double>(n_iteration_planned * length_str);
+          stats.publish(thread_stats[id_thread]);
+        }
       }
 
-      double ratio_completed = (i_iteration*length_str + i_str) / static_cast<double>(n_iteration*length_str + 1);
-      if (ratio_completed > 0.9999) ratio_completed = 0.9999;
-      const double _learning_rate = learning_rate * (1 - ratio_completed);
+      const double _learning_rate = scheduled_learning_rate(i_progress, length_str);
 
-      // For each (center) word for every n-gram
-      for (int64_t length_word=1; length_word<=max_length_word; length_word++) {
-        if (i_str + length_word - 1 >= length_str) break;
+      train_position(corpus, i_corpus_start + i_str, i_corpus_start + length_str, _learning_rate, workspace);
+    }
 
-        const std::wstring word = corpus_thread.substr(i_str, length_word);
-        if (vocabulary2id_thread.find(word) == vocabulary2id_thread.end()) continue;
-        const int64_t id_word = vocabulary2id_thread[word];
+    if (length_held_out > 0) {
+      wait_threads([this, i_iteration, length_str]() {
+        end_epoch(i_iteration + 1, length_str);
+        return true;
+      });
+    }
+  }
 
-        const int64_t freq = count_vocabulary_thread[id_word];
-        const double probability_reject = (sqrt(freq/(rate_sample*sum_count_vocabulary)) + 1) * (rate_sample*sum_count_vocabulary) / freq;
-        if (probability_reject < cheaprand_thread.generate_rand_uniform(0, 1)) continue;
+  // The processes end with the same, merged, parameters
+  if (shared_model != nullptr && !synchronize_processes()) return;
 
-        // For each context word
-        for (int64_t length_context=1; length_context<=max_length_word; length_context++) {
-          if (i_str + length_word + length_context - 1 >= length_str) break;
+  stats.progress = 1.0;
+  stats.publish(thread_stats[id_thread]);
+  const ThreadState state_end{std::max(n_iteration_planned, state_start.i_iteration), 0, workspace.cheaprand.get_randomstate()};
+  publish_thread_state(id_thread, state_end, true);
+  if (is_progress_printer) std::wcout << std::endl << std::flush;
+}
 
-          const std::wstring context = corpus_thread.substr(i_str + length_word, length_context);
-          if (vocabulary2id_thread.find(context) == vocabulary2id_thread.end()) continue;
-          const int64_t id_context = vocabulary2id_thread[context];
+template <class Text>
+void SkipGram::train_position(const Text& text,
+                              const int64_t i_str,
+                              const int64_t i_limit,
+                              const double _learning_rate,
+                              TrainingWorkspace& workspace)
+{
+  ThreadStatsSnapshot& stats = workspace.stats;
+  CheapRand& cheaprand_thread = workspace.cheaprand;
+  std::wstring& word = workspace.word;
 
-          //// Skip-gram with negative sampling
+  stats.n_positions++;
+  stats.learning_rate = _learning_rate;
 
-          // Vector representation of `word` can be obtained by
-          //  (embeddings_words[i_head_word], ..., embeddings_words[i_head_word + dim_embedding - 1]).
-          int64_t i_head_word, i_head_context, i_head_target;
+  // For each (center) word for every n-gram
+  for (int64_t length_word=1; length_word<=max_length_word; length_word++) {
+    if (i_str + length_word > i_limit) break;
 
-          for (const bool is_right_context : {true, false}) {
+    copy_substr(text, i_str, length_word, word);
+    stats.n_lookups++;
+    const auto it_word = vocabulary2id.find(word);
+    if (it_word == vocabulary2id.end()) continue;
+    const int64_t id_word = it_word->second;
+    stats.n_lookup_hits++;
 
-            if (is_right_context) { // Right context
-              i_head_word = dim_embedding * id_word;
-              i_head_context = dim_embedding * id_context;
-            } else { // Left context
-              i_head_word = dim_embedding * id_context;
-              i_head_context = dim_embedding * id_word;
-            }
+    const int64_t freq = count_vocabulary[id_word];
+    const double probability_reject = (sqrt(freq/(rate_sample*sum_count_vocabulary)) + 1) * (rate_sample*sum_count_vocabulary) / freq;
+    if (probability_reject < cheaprand_thread.generate_rand_uniform(0, 1)) continue;
 
-            for (int64_t i=0; i<dim_embedding; i++) {
-              gradient_words[i] = 0;
-            }
+    // Wider windows : the window of this word is drawn from 1 to size_window, and each
+    // further hop begins after one of the contexts of the previous hop sampled uniformly,
+    // so that the cost per position grows with the window rather than with the number
+    // of paths
+    const int64_t window = (size_window > 1) ? 1 + cheaprand_thread.generate_randint(size_window) : 1;
+    int64_t i_context = i_str + length_word;
+    for (int64_t hop=1; hop<=window && i_context<i_limit; hop++) {
+      i_context += train_contexts(text, i_context, i_limit, id_word, hop < window, _learning_rate, workspace);
+    }
+  }
+}
 
-            for (int64_t i_ns=-1; i_ns<n_negative_sample; i_ns++) {
-              const bool is_negative_sample = (i_ns >= 0);
+// Returns the length of one of the contexts found, sampled uniformly by reservoir sampling
+// if `is_segment_sampled`, or 1 : a character which starts none is a segment by itself
+template <class Text>
+int64_t SkipGram::train_contexts(const Text& text,
+                                 const int64_t i_context,
+                                 const int64_t i_limit,
+                                 const int64_t id_word,
+                                 const bool is_segment_sampled,
+                                 const double _learning_rate,
+                                 TrainingWorkspace& workspace)
+{
+  const bool is_stats_enabled = (stats_interval > 0);
+  ThreadStatsSnapshot& stats = workspace.stats;
+  CheapRand& cheaprand_thread = workspace.cheaprand;
+  std::wstring& context = workspace.context;
+  double* gradient_words = workspace.gradient_words.data();
+  int64_t length_segment = 1;
+  int64_t n_found = 0;
 
-              if (is_negative_sample) {
-                i_head_target = dim_embedding * table_unigram[cheaprand_thread.generate_randint(SIZE_TABLE_UNIGRAM)];
-                if (i_head_target == i_head_context) {
-                  continue;
-                }
-              } else {
-                i_head_target = i_head_context;
-              }
+  // For each context n-gram starting at `i_context`
+  for (int64_t length_context=1; length_context<=max_length_word; length_context++) {
+    if (i_context + length_context > i_limit) break;
 
-              double x = 0; // inner product
-              for (int64_t i=0; i<dim_embedding; i++) {
-                if (is_right_context) {
-                  x += embeddings_words[i_head_word + i] * embeddings_contexts_right[i_head_target + i];
-                } else {
-                  x += embeddings_words[i_head_word + i] * embeddings_contexts_left[i_head_target + i];
-                }
-              }
+    copy_substr(text, i_context, length_context, context);
+    stats.n_lookups++;
+    const auto it_context = vocabulary2id.find(context);
+    if (it_context == vocabulary2id.end()) continue;
+    const int64_t id_context = it_context->second;
+    stats.n_lookup_hits++;
+    stats.n_pairs++;
+    if (is_segment_sampled && cheaprand_thread.generate_randint(++n_found) == 0) length_segment = length_context;
 
-              const double g = 1. / (1. + exp(-x)) - (1.0 - (double)is_negative_sample);
-              for (int64_t i=0; i<dim_embedding; i++) {
-                if (is_right_context) {
-                  gradient_words[i] += g * embeddings_contexts_right[i_head_target + i];
-                  embeddings_contexts_right[i_head_target + i] -= _learning_rate * g * embeddings_words[i_head_word + i];
-                } else {
-                  gradient_words[i] += g * embeddings_contexts_left[i_head_target + i];
-                  embeddings_contexts_left[i_head_target + i] -= _learning_rate * g * embeddings_words[i_head_word + i];
-                }
-              }
+    //// Skip-gram with negative sampling
 
-            }
+    // Vector representation of `word` can be obtained by
+    //  (embeddings_words[i_head_word], ..., embeddings_words[i_head_word + dim_embedding - 1]).
+    int64_t i_head_word, i_head_context, i_head_target;
+    int64_t id_row_word, id_row_context, id_row_target;
 
-            for (int64_t i=0; i<dim_embedding; i++) {
-              embeddings_words[i_head_word + i] -= _learning_rate * gradient_words[i];
-            }
+    for (const bool is_right_context : {true, false}) {
+
+      if (is_right_context) { // Right context
+        id_row_word = id_word;
+        id_row_context = id_context;
+      } else { // Left context
+        id_row_word = id_context;
+        id_row_context = id_word;
+      }
+      i_head_word = dim_embedding * id_row_word;
+      i_head_context = dim_embedding * id_row_context;
 
+      for (int64_t i=0; i<dim_embedding; i++) {
+        gradient_words[i] = 0;
+      }
+
+      for (int64_t i_ns=-1; i_ns<n_negative_sample; i_ns++) {
+        const bool is_negative_sample = (i_ns >= 0);
+
+        if (is_negative_sample) {
+          id_row_target = table_unigram[cheaprand_thread.generate_randint(SIZE_TABLE_UNIGRAM)];
+          i_head_target = dim_embedding * id_row_target;
+          stats.n_negative_samples++;
+          if (i_head_target == i_head_context) {
+            continue;
           }
+        } else {
+          id_row_target = id_row_context;
+          i_head_target = i_head_context;
         }
+
+        double x = 0; // inner product
+        for (int64_t i=0; i<dim_embedding; i++) {
+          if (is_right_context) {
+            x += embeddings_words[i_head_word + i] * embeddings_contexts_right[i_head_target + i];
+          } else {
+            x += embeddings_words[i_head_word + i] * embeddings_contexts_left[i_head_target + i];
+          }
+        }
+
+        if (is_stats_enabled) {
+          stats.sum_loss += loss_sample(x, is_negative_sample);
+          stats.n_loss++;
+        }
+
+        const double g = 1. / (1. + exp(-x)) - (1.0 - (double)is_negative_sample);
+        const double learning_rate_target = learning_rate_row(id_row_target, _learning_rate);
+        for (int64_t i=0; i<dim_embedding; i++) {
+          if (is_right_context) {
+            gradient_words[i] += g * embeddings_contexts_right[i_head_target + i];
+            embeddings_contexts_right[i_head_target + i] -= learning_rate_target * g * embeddings_words[i_head_word + i];
+          } else {
+            gradient_words[i] += g * embeddings_contexts_left[i_head_target + i];
+            embeddings_contexts_left[i_head_target + i] -= learning_rate_target * g * embeddings_words[i_head_word + i];
+          }
+        }
+
+      }
+
+      const double learning_rate_word = learning_rate_row(id_row_word, _learning_rate);
+      for (int64_t i=0; i<dim_embedding; i++) {
+        embeddings_words[i_head_word + i] -= learning_rate_word * gradient_words[i];
       }
+
     }
   }
+  return length_segment;
+}
 
-  delete[] gradient_words;
-  if (id_thread == n_cores - 1) std::wcout << std::endl << std::flush;
+// Called by every thread of the process at the same positions; the last one to arrive
+// runs `run_last` while the others wait. False for all of them once it has failed.
+bool SkipGram::wait_threads(const std::function<bool()>& run_last)
+{
+  std::unique_lock<std::mutex> lock(mtx_synchronization);
+  const int64_t id = id_synchronization;
+  if (++n_threads_synchronizing < n_cores) {
+    cv_synchronization.wait(lock, [this, id]{ return id_synchronization != id; });
+    return !is_synchronization_failed.load();
+  }
+
+  if (!run_last()) is_synchronization_failed.store(true);
+  n_threads_synchronizing = 0;
+  id_synchronization++;
+  cv_synchronization.notify_all();
+  return !is_synchronization_failed.load();
+}
+
+// Merges the parameters with the other processes
+bool SkipGram::synchronize_processes()
+{
+  return wait_threads([this]() { return shared_model->synchronize(rank_process, n_cores); });
+}
+
+// Linear decay over the current plan; without re-planning, from learning_rate at the
+// first position to 0 at the end of n_iteration epochs
+double SkipGram::scheduled_learning_rate(const int64_t i_progress, const int64_t length_epoch) const
+{
+  double ratio_completed = (i_progress - i_iteration_plan * length_epoch)
+    / static_cast<double>((n_iteration_planned - i_iteration_plan) * length_epoch + 1);
+  if (ratio_completed > 0.9999) ratio_completed = 0.9999;
+  return learning_rate_plan * (1 - ratio_completed);
+}
+
+// Run by the last thread to finish epoch `n_iteration_done`. Once the held-out loss
+// improves by less than min_improvement, the plan is cut to one more epoch, in which
+// the learning rate decays from its current value to 0 : stopping at a high learning
+// rate would leave the embeddings where the last updates threw them.
+void SkipGram::end_epoch(const int64_t n_iteration_done, const int64_t length_epoch)
+{
+  int64_t n_samples;
+  const double loss = evaluate_held_out(n_samples);
+  const double improvement = (loss_held_out_last > 0) ? (loss_held_out_last - loss) / loss_held_out_last : 0;
+  loss_held_out_last = loss;
+
+  const bool is_progress_printed = (stats_interval == 0) && is_progress_shown;
+  if (is_progress_printed) std::wcout << std::endl;
+  std::wcout << "Held-out loss after epoch " << n_iteration_done << " : " << std::fixed << std::setprecision(4) << loss
+             << " (" << std::setprecision(2) << -100 * improvement << "%)" << std::endl;
+
+  if (improvement < min_improvement && n_iteration_done + 1 < n_iteration_planned) {
+    learning_rate_plan = scheduled_learning_rate(n_iteration_done * length_epoch, length_epoch);
+    i_iteration_plan = n_iteration_done;
+    n_iteration_planned = n_iteration_done + 1;
+    std::wcout << "Held-out loss decreased by less than " << 100 * min_improvement
+               << "% : one last epoch, with the learning rate decaying from "
+               << std::setprecision(4) << learning_rate_plan << " to 0" << std::endl;
+  }
+  std::wcout.unsetf(std::ios::floatfield);
+  std::wcout << std::setprecision(6);
+}
+
+// Mean SGNS loss of every (word, next word) pair of the held-out slice, both directions,
+// evaluated without updates on n_cores threads. The negatives of each block of
+// SIZE_BLOCK_HELD_OUT positions come from a generator seeded by the block, so every
+// evaluation draws the same ones, whatever the number of threads. `n_samples` is the
+// number of losses averaged, 0 if the slice holds no pair.
+double SkipGram::evaluate_held_out(int64_t& n_samples) const
+{
+  const int64_t i_held_out = corpus.size() - length_held_out;
+  const int64_t n_blocks = (length_held_out + SIZE_BLOCK_HELD_OUT - 1) / SIZE_BLOCK_HELD_OUT;
+  std::vector<double> sum_loss(n_blocks, 0);
+  std::vector<int64_t> n_loss(n_blocks, 0);
+
+  auto evaluate = [&](const int64_t id_thread) {
+    std::wstring word, context;
+    for (int64_t i_block=id_thread; i_block<n_blocks; i_block+=n_cores) {
+      CheapRand cheaprand_block(seed + i_block);
+      const int64_t i_begin = i_held_out + i_block * SIZE_BLOCK_HELD_OUT;
+      const int64_t i_end = std::min<int64_t>(corpus.size(), i_begin + SIZE_BLOCK_HELD_OUT);
+
+      for (int64_t i_str=i_begin; i_str<i_end; i_str++) {
+        for (int64_t length_word=1; length_word<=max_length_word; length_word++) {
+          if (i_str + length_word > corpus.size()) break;
+          corpus.substr(i_str, length_word, word);
+          const auto it_word = vocabulary2id.find(word);
+          if (it_word == vocabulary2id.end()) continue;
+
+          const int64_t i_context = i_str + length_word;
+          for (int64_t length_context=1; length_context<=max_length_word; length_context++) {
+            if (i_context + length_context > corpus.size()) break;
+            corpus.substr(i_context, length_context, context);
+            const auto it_context = vocabulary2id.find(context);
+            if (it_context == vocabulary2id.end()) continue;
+
+            for (const bool is_right_context : {true, false}) {
+              const int64_t id_row_word = is_right_context ? it_word->second : it_context->second;
+              const int64_t id_row_context = is_right_context ? it_context->second : it_word->second;
+              const double* embeddings_targets = is_right_context ? embeddings_contexts_right : embeddings_contexts_left;
+              const double* embedding_word = embeddings_words + dim_embedding * id_row_word;
+
+              for (int64_t i_ns=-1; i_ns<n_negative_sample; i_ns++) {
+                const bool is_negative_sample = (i_ns >= 0);
+                const int64_t id_row_target = is_negative_sample
+                  ? table_unigram[cheaprand_block.generate_randint(SIZE_TABLE_UNIGRAM)] : id_row_context;
+                if (is_negative_sample && id_row_target == id_row_context) continue;
+
+                const double* embedding_target = embeddings_targets + dim_embedding * id_row_target;
+                double x = 0;
+                for (int64_t i=0; i<dim_embedding; i++) x += embedding_word[i] * embedding_target[i];
+                sum_loss[i_block] += loss_sample(x, is_negative_sample);
+                n_loss[i_block]++;
+              }
+            }
+          }
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int64_t id_thread=1; id_thread<n_cores; id_thread++) threads.push_back(std::thread(evaluate, id_thread));
+  evaluate(0);
+  for (auto& t : threads) t.join();
+
+  // Summed in block order, for the same result on any number of threads
+  double sum_loss_total = 0;
+  n_samples = 0;
+  for (int64_t i_block=0; i_block<n_blocks; i_block++) {
+    sum_loss_total += sum_loss[i_block];
+    n_samples += n_loss[i_block];
+  }
+  return n_samples ? sum_loss_total / n_samples : 0;
+}
+
+int64_t SkipGram::publish_thread_state(const int64_t id_thread, const ThreadState& state, const bool is_finished)
+{
+  std::lock_guard<std::mutex> lock(mtx_training);
+  thread_states[id_thread] = state;
+  id_checkpoint_served[id_thread] = id_checkpoint_requested.load();
+  is_thread_finished[id_thread] = is_finished;
+  cv_training.notify_all();
+  return id_checkpoint_served[id_thread];
+}
+
+void SkipGram::run_checkpointer()
+{
+  std::unique_lock<std::mutex> lock(mtx_training);
+
+  while (true) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(checkpoint_interval);
+    if (cv_training.wait_until(lock, deadline, [this]{ return is_training_done; })) break;
+
+    // Ask every running thread for its position and wait until all of them answered.
+    // Threads only publish at position boundaries and never block, so training does not stall.
+    const int64_t id_request = id_checkpoint_requested.fetch_add(1) + 1;
+    cv_training.wait(lock, [this, id_request]{
+      for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+        if (!is_thread_finished[id_thread] && id_checkpoint_served[id_thread] != id_request) return false;
+      }
+      return true;
+    });
+    const std::vector<ThreadState> states = thread_states;
+
+    // The matrices are written while training goes on (the same Hogwild-style races as
+    // training itself), so the saved parameters are slightly ahead of the saved positions
+    lock.unlock();
+    write_checkpoint(checkpoint_path, states);
+    lock.lock();
+  }
+}
+
+void SkipGram::run_stats_reporter()
+{
+  std::ofstream fout_stats;
+  if (!stats_path.empty()) fout_stats.open(stats_path, std::ios::binary | std::ios::trunc);
+
+  const auto time_start = std::chrono::steady_clock::now();
+  auto time_last = time_start;
+  std::vector<ThreadStatsSnapshot> snapshots_last(n_cores, ThreadStatsSnapshot());
+  std::vector<ThreadStatsSnapshot> snapshots(n_cores);
+
+  std::unique_lock<std::mutex> lock(mtx_training);
+  bool is_done = false;
+
+  while (!is_done) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(stats_interval);
+    is_done = cv_training.wait_until(lock, deadline, [this]{ return is_training_done; });
+    lock.unlock();
+
+    const auto time_now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(time_now - time_start).count();
+    const double interval = std::max(1e-9, std::chrono::duration<double>(time_now - time_last).count());
+    time_last = time_now;
+
+    // Aggregate over threads; rates are over the last interval, or the whole run at the end
+    ThreadStatsSnapshot total = ThreadStatsSnapshot(), delta = ThreadStatsSnapshot();
+    const ThreadStatsSnapshot zero = ThreadStatsSnapshot();
+    const double rate_interval = is_done ? std::max(1e-9, elapsed) : interval;
+    std::string json_threads;
+    for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+      ThreadStatsSnapshot& s = snapshots[id_thread];
+      const ThreadStatsSnapshot& l = is_done ? zero : snapshots_last[id_thread];
+      s.load(thread_stats[id_thread]);
+      total.n_positions += s.n_positions;
+      total.n_pairs += s.n_pairs;
+      total.n_negative_samples += s.n_negative_samples;
+      total.n_lookups += s.n_lookups;
+      total.n_lookup_hits += s.n_lookup_hits;
+      total.n_loss += s.n_loss;
+      total.sum_loss += s.sum_loss;
+      total.learning_rate += s.learning_rate / n_cores;
+      total.progress += s.progress / n_cores;
+      delta.n_positions += s.n_positions - l.n_positions;
+      delta.n_pairs += s.n_pairs - l.n_pairs;
+      delta.n_loss += s.n_loss - l.n_loss;
+      delta.sum_loss += s.sum_loss - l.sum_loss;
+
+      if (id_thread) json_threads += ", ";
+      json_threads += "{\"id\": ";
+      append_int64(id_thread, json_threads);
+      json_threads += ", \"progress\": ";
+      append_double(s.progress, json_threads);
+      json_threads += ", \"positions_per_sec\": ";
+      append_double((s.n_positions - l.n_positions) / rate_interval, json_threads);
+      json_threads += ", \"pairs_per_sec\": ";
+      append_double((s.n_pairs - l.n_pairs) / rate_interval, json_threads);
+      json_threads += "}";
+    }
+    snapshots_last = snapshots;
+
+    const double positions_per_sec = delta.n_positions / rate_interval;
+    const double pairs_per_sec = delta.n_pairs / rate_interval;
+    const double hit_rate = total.n_lookups ? total.n_lookup_hits / static_cast<double>(total.n_lookups) : 0;
+    const double loss = delta.n_loss ? delta.sum_loss / delta.n_loss : 0;
+
+    std::string line = is_done ? "Total" : "Progress : ";
+    if (!is_done) {
+      append_double(100 * total.progress, line);
+      line += "%";
+    }
+    line += "  positions/sec : ";
+    append_double(positions_per_sec, line);
+    line += "  pairs/sec : ";
+    append_double(pairs_per_sec, line);
+    line += "  negative samples : ";
+    append_int64(total.n_negative_samples, line);
+    line += "  hit rate : ";
+    append_double(hit_rate, line);
+    line += "  loss : ";
+    append_double(loss, line);
+    line += "  learning_rate : ";
+    append_double(total.learning_rate, line);
+    std::wcout << line.c_str() << std::endl;
+
+    if (fout_stats.is_open()) {
+      std::string json = "{\"elapsed_sec\": ";
+      append_double(elapsed, json);
+      json += ", \"is_final\": ";
+      json += is_done ? "true" : "false";
+      json += ", \"progress\": ";
+      append_double(total.progress, json);
+      json += ", \"learning_rate\": ";
+      append_double(total.learning_rate, json);
+      json += ", \"positions\": ";
+      append_int64(total.n_positions, json);
+      json += ", \"pairs\": ";
+      append_int64(total.n_pairs, json);
+      json += ", \"negative_samples\": ";
+      append_int64(total.n_negative_samples, json);
+      json += ", \"lookups\": ";
+      append_int64(total.n_lookups, json);
+      json += ", \"lookup_hit_rate\": ";
+      append_double(hit_rate, json);
+      json += ", \"positions_per_sec\": ";
+      append_double(positions_per_sec, json);
+      json += ", \"pairs_per_sec\": ";
+      append_double(pairs_per_sec, json);
+      json += ", \"loss\": ";
+      append_double(loss, json);
+      json += ", \"threads\": [" + json_threads + "]}\n";
+      fout_stats.write(json.data(), json.size());
+      fout_stats.flush();
+    }
+
+    lock.lock();
+  }
+}
+
+bool SkipGram::set_early_stopping(const double held_out_ratio, const double _min_improvement)
+{
+  assert(held_out_ratio >= 0 && held_out_ratio < 1 && _min_improvement >= 0);
+  length_held_out = static_cast<int64_t>(held_out_ratio * corpus.size());
+  min_improvement = _min_improvement;
+  if (length_held_out == 0) return true;
+  std::wcout << "Holding out the last " << length_held_out << " characters of the corpus" << std::endl;
+
+  // Without any pair, every evaluation would be 0 and training would stop after two epochs
+  int64_t n_samples;
+  loss_held_out_last = evaluate_held_out(n_samples);
+  if (n_samples == 0) {
+    std::wcout << "The held-out slice holds no pair of n-grams of the vocabulary : raise --held_out_ratio." << std::endl;
+    return false;
+  }
+  std::wcout << "Held-out loss before training : " << std::fixed << std::setprecision(4) << loss_held_out_last << std::endl;
+  std::wcout.unsetf(std::ios::floatfield);
+  std::wcout << std::setprecision(6);
+  return true;
+}
+
+void SkipGram::set_stats(const std::string _stats_path, const int64_t _stats_interval)
+{
+  assert(_stats_interval >= 0);
+  stats_path = _stats_path;
+  stats_interval = _stats_interval;
+}
+
+// Counters summed over the training threads, final once training has returned
+ThreadStatsSnapshot SkipGram::total_stats() const
+{
+  ThreadStatsSnapshot total = ThreadStatsSnapshot();
+  for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+    ThreadStatsSnapshot s;
+    s.load(thread_stats[id_thread]);
+    total.n_positions += s.n_positions;
+    total.n_pairs += s.n_pairs;
+    total.n_negative_samples += s.n_negative_samples;
+    total.n_lookups += s.n_lookups;
+    total.n_lookup_hits += s.n_lookup_hits;
+    total.n_loss += s.n_loss;
+    total.sum_loss += s.sum_loss;
+  }
+  return total;
+}
+
+void SkipGram::show_progress(const bool _is_progress_shown)
+{
+  is_progress_shown = _is_progress_shown;
+}
+
+void SkipGram::set_quantization(const int64_t _pq_subspaces, const int64_t _pq_iteration, const int64_t _n_quantization_query)
+{
+  assert(_pq_subspaces >= 0 && _pq_subspaces <= dim_embedding);
+  assert(_pq_iteration >= 0);
+  assert(_n_quantization_query >= 0);
+  pq_subspaces = _pq_subspaces;
+  pq_iteration = _pq_iteration;
+  n_quantization_query = _n_quantization_query;
+}
+
+void SkipGram::set_checkpoint(const std::string _checkpoint_path, const int64_t _checkpoint_interval)
+{
+  assert(_checkpoint_interval >= 0);
+  checkpoint_path = _checkpoint_path;
+  checkpoint_interval = _checkpoint_interval;
+}
+
+bool SkipGram::save_checkpoint(const std::string path)
+{
+  std::cout << "Saving checkpoint to " << path << std::endl;
+
+  std::vector<ThreadState> states;
+  {
+    std::lock_guard<std::mutex> lock(mtx_training);
+    states = thread_states;
+  }
+  if (!write_checkpoint(path, states)) {
+    std::cout << "Failed to write checkpoint." << std::endl;
+    return false;
+  }
+
+  std::cout << "Done" << std::endl;
+  return true;
+}
+
+bool SkipGram::write_checkpoint(const std::string path, const std::vector<ThreadState>& states)
+{
+  CheckpointHeader header = CheckpointHeader();
+  header.size_vocabulary = size_vocabulary;
+  header.dim_embedding = dim_embedding;
+  header.length_corpus = (corpus.size() == 0) ? length_corpus_streamed : corpus.size();
+  header.n_iteration = n_iteration;
+  header.seed = seed;
+  header.hash_vocabulary = hash_vocabulary(vocabulary);
+
+  return Checkpoint::write(path, header, states,
+                           embeddings_words, embeddings_contexts_left, embeddings_contexts_right,
+                           vocabulary);
+}
+
+bool SkipGram::load_checkpoint(const std::string path)
+{
+  std::cout << "Loading checkpoint from " << path << std::endl;
+
+  Checkpoint checkpoint;
+  if (!checkpoint.open(path)) {
+    std::cout << "Invalid checkpoint file." << std::endl;
+    return false;
+  }
+  const CheckpointHeader& header = checkpoint.header();
+  if (header.size_vocabulary != size_vocabulary
+      || header.dim_embedding != dim_embedding
+      || header.hash_vocabulary != hash_vocabulary(vocabulary)) {
+    std::cout << "Checkpoint does not match the vocabulary or dim_embedding." << std::endl;
+    return false;
+  }
+  // When streaming there is no corpus in memory to compare with
+  if (corpus.size() != 0 && header.length_corpus != corpus.size()) {
+    std::cout << "Checkpoint was trained on a different corpus." << std::endl;
+    return false;
+  }
+
+  // A finished checkpoint can be trained for more epochs with any n_cores,
+  // an interrupted one needs the same partitioning of the corpus
+  const ThreadState* states = checkpoint.thread_states();
+  bool is_finished = true;
+  for (int64_t id_thread=0; id_thread<header.n_cores; id_thread++) {
+    if (states[id_thread].i_iteration < header.n_iteration) is_finished = false;
+  }
+  if (!is_finished && header.n_cores != n_cores) {
+    std::cout << "Interrupted checkpoint requires n_cores=" << header.n_cores << "." << std::endl;
+    return false;
+  }
+
+  for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+    if (header.n_cores == n_cores) {
+      thread_states[id_thread] = states[id_thread];
+    } else {
+      thread_states[id_thread] = ThreadState{header.n_iteration, 0, id_thread + seed};
+    }
+  }
+
+  const int64_t n = size_vocabulary * dim_embedding;
+  std::memcpy(embeddings_words, checkpoint.embeddings_words(), n * sizeof(double));
+  std::memcpy(embeddings_contexts_left, checkpoint.embeddings_contexts_left(), n * sizeof(double));
+  std::memcpy(embeddings_contexts_right, checkpoint.embeddings_contexts_right(), n * sizeof(double));
+
+  if (is_finished) {
+    std::cout << "Checkpoint finished " << header.n_iteration << " epochs";
+  } else {
+    int64_t i_iteration_min = header.n_iteration;
+    for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+      i_iteration_min = std::min(i_iteration_min, states[id_thread].i_iteration);
+    }
+    std::cout << "Checkpoint interrupted in epoch " << i_iteration_min + 1 << " of " << header.n_iteration;
+  }
+  std::cout << ", training until epoch " << n_iteration << std::endl;
+  return true;
+}
+
+bool SkipGram::continue_from(const std::string path)
+{
+  std::cout << "Continuing from " << path << std::endl;
+
+  Checkpoint checkpoint;
+  if (!checkpoint.open(path)) {
+    std::cout << "Invalid checkpoint file." << std::endl;
+    return false;
+  }
+  const CheckpointHeader& header = checkpoint.header();
+  const int64_t n_known = header.size_vocabulary;
+  if (header.dim_embedding != dim_embedding || n_known > size_vocabulary
+      || header.hash_vocabulary != hash_vocabulary(std::vector<std::wstring>(vocabulary.begin(), vocabulary.begin() + n_known))) {
+    std::cout << "Checkpoint vocabulary is not a prefix of the vocabulary, or dim_embedding differs." << std::endl;
+    return false;
+  }
+
+  // The matrices were allocated for the whole vocabulary; the rows of the continued
+  // model fill their head and the new words keep their random initialization
+  const int64_t n = n_known * dim_embedding;
+  std::memcpy(embeddings_words, checkpoint.embeddings_words(), n * sizeof(double));
+  std::memcpy(embeddings_contexts_left, checkpoint.embeddings_contexts_left(), n * sizeof(double));
+  std::memcpy(embeddings_contexts_right, checkpoint.embeddings_contexts_right(), n * sizeof(double));
+  size_vocabulary_known = n_known;
+
+  std::cout << n_known << " words continued, " << size_vocabulary - n_known << " new words" << std::endl;
+  return true;
+}
+
+void SkipGram::set_learning_rate_known(const double _ratio_learning_rate_known)
+{
+  assert(_ratio_learning_rate_known >= 0);
+  ratio_learning_rate_known = _ratio_learning_rate_known;
+}
+
+void SkipGram::share_parameters(SharedModel& _shared_model, const int64_t _rank_process, const int64_t _sync_interval)
+{
+  const int64_t n = size_vocabulary * dim_embedding;
+  assert(shared_model == nullptr);
+  assert(_shared_model.get_n_parameters() == 3 * n);
+  assert(_rank_process >= 0 && _rank_process < _shared_model.get_n_processes());
+  assert(_sync_interval > 0);
+  shared_model = &_shared_model;
+  rank_process = _rank_process;
+  sync_interval = _sync_interval;
+
+  // Every process starts from the same parameters, the first base, with its own
+  // negative samples
+  double* parameters = shared_model->parameters(rank_process);
+  std::memcpy(parameters, embeddings_words, n * sizeof(double));
+  std::memcpy(parameters + n, embeddings_contexts_left, n * sizeof(double));
+  std::memcpy(parameters + 2 * n, embeddings_contexts_right, n * sizeof(double));
+  if (rank_process == 0) {
+    std::memcpy(shared_model->parameters(shared_model->get_n_processes()), parameters, 3 * n * sizeof(double));
+  }
+  delete[] embeddings_words;
+  delete[] embeddings_contexts_left;
+  delete[] embeddings_contexts_right;
+  embeddings_words = parameters;
+  embeddings_contexts_left = parameters + n;
+  embeddings_contexts_right = parameters + 2 * n;
+
+  for (int64_t id_thread=0; id_thread<n_cores; id_thread++) {
+    thread_states[id_thread] = ThreadState{0, 0, rank_process * n_cores + id_thread + seed};
+  }
 }
 
 void SkipGram::construct_unigramtable(const double power_unigram_table) {
@@ -257,24 +1055,153 @@ void SkipGram::construct_unigramtable(const double power_unigram_table) {
   }
 }
 
-void SkipGram::save_vector(const std::string output_path)
+void SkipGram::save_vector(const std::string output_path, const std::string output_format)
 {
   std::cout << "Saving embeddings to " << output_path << std::endl;
+  if (!save_matrix(output_path, output_format, embeddings_words)) return;
+  if (output_format == "npy") {
+    std::cout << "Saving vocabulary to " << output_path << ".vocab" << std::endl;
+    std::ofstream fout(output_path + ".vocab", std::ios::binary);
+    if (!fout.is_open()) {
+      std::cout << "Invalid file name." << std::endl;
+      return;
+    }
+    write_rows_parallel(fout, size_vocabulary, n_cores, [this](const int64_t i, std::string& buffer) {
+      append_utf8(vocabulary[i], buffer);
+      buffer += '\n';
+    });
+    fout.close();
+    if (fout.fail()) {
+      std::cout << "Failed to write " << output_path << ".vocab" << std::endl;
+      return;
+    }
+  }
+  std::cout << "Done" << std::endl;
+}
 
-  std::wofstream fout(output_path);
-  fout << size_vocabulary << " " << dim_embedding << std::endl;
-  for (int64_t i=0; i<size_vocabulary; i++) {
-    fout << vocabulary[i] << " ";
-    for (int64_t j=0; j<dim_embedding; j++) {
-      fout << embeddings_words[i*dim_embedding + j];
-      if (j < dim_embedding - 1) {
-        fout << " ";
-      }else{
-        fout << std::endl;
+void SkipGram::save_context_vector(const std::string output_path, const std::string output_format)
+{
+  const std::string output_path_left = path_with_suffix(output_path, "_context_left");
+  const std::string output_path_right = path_with_suffix(output_path, "_context_right");
+
+  std::cout << "Saving left context embeddings to " << output_path_left << std::endl;
+  if (!save_matrix(output_path_left, output_format, embeddings_contexts_left)) return;
+  std::cout << "Saving right context embeddings to " << output_path_right << std::endl;
+  if (!save_matrix(output_path_right, output_format, embeddings_contexts_right)) return;
+  std::cout << "Done" << std::endl;
+}
+
+bool SkipGram::is_valid_output_format(const std::string output_format)
+{
+  return output_format == "text" || output_format == "binary" || output_format == "npy"
+    || output_format == "int8" || output_format == "pq";
+}
+
+// False, after saying so, if `output_path` cannot be opened or fully written
+bool SkipGram::save_matrix(const std::string output_path, const std::string output_format, const double* matrix)
+{
+  if (output_format == "int8" || output_format == "pq") {
+    return save_quantized(output_path, output_format, matrix);
+  }
+
+  std::ofstream fout(output_path, std::ios::binary);
+  if (!fout.is_open()) {
+    std::cout << "Invalid file name." << std::endl;
+    return false;
+  }
+  std::string header;
+
+  if (output_format == "text") {
+    // word2vec text format : "word v_1 v_2 ... v_dim"
+    append_int64(size_vocabulary, header);
+    header += ' ';
+    append_int64(dim_embedding, header);
+    header += '\n';
+    fout.write(header.data(), header.size());
+
+    write_rows_parallel(fout, size_vocabulary, n_cores, [this, matrix](const int64_t i, std::string& buffer) {
+      append_utf8(vocabulary[i], buffer);
+      for (int64_t j=0; j<dim_embedding; j++) {
+        buffer += ' ';
+        append_double(matrix[i*dim_embedding + j], buffer);
       }
-    }
+      buffer += '\n';
+    });
+  } else if (output_format == "binary") {
+    // word2vec binary format : "word " followed by dim_embedding float32 and a newline
+    append_int64(size_vocabulary, header);
+    header += ' ';
+    append_int64(dim_embedding, header);
+    header += '\n';
+    fout.write(header.data(), header.size());
+
+    write_rows_parallel(fout, size_vocabulary, n_cores, [this, matrix](const int64_t i, std::string& buffer) {
+      append_utf8(vocabulary[i], buffer);
+      buffer += ' ';
+      for (int64_t j=0; j<dim_embedding; j++) {
+        const float value = static_cast<float>(matrix[i*dim_embedding + j]);
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(float));
+      }
+      buffer += '\n';
+    });
+  } else if (output_format == "npy") {
+    // NumPy .npy (version 1.0) holding a C-ordered float32 matrix, which can be
+    // memory-mapped with numpy.load(path, mmap_mode='r'). Words are in `output_path`.vocab
+    append_npy_header(size_vocabulary, dim_embedding, header);
+    fout.write(header.data(), header.size());
+
+    write_rows_parallel(fout, size_vocabulary, n_cores, [this, matrix](const int64_t i, std::string& buffer) {
+      for (int64_t j=0; j<dim_embedding; j++) {
+        const float value = static_cast<float>(matrix[i*dim_embedding + j]);
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(float));
+      }
+    });
   }
+
   fout.close();
+  if (fout.fail()) {
+    std::cout << "Failed to write " << output_path << std::endl;
+    return false;
+  }
+  return true;
+}
 
-  std::cout << "Done" << std::endl;
+bool SkipGram::save_quantized(const std::string output_path, const std::string output_format, const double* matrix)
+{
+  QuantizedMatrix quantized;
+  if (output_format == "int8") {
+    quantized.quantize_int8(matrix, size_vocabulary, dim_embedding, n_cores);
+  } else {
+    const int64_t n_subspaces = (pq_subspaces > 0) ? pq_subspaces : (dim_embedding + 3) / 4;
+    quantized.quantize_pq(matrix, size_vocabulary, dim_embedding, n_subspaces, pq_iteration, seed, n_cores);
+  }
+  std::vector<std::string> words(size_vocabulary);
+  for (int64_t i=0; i<size_vocabulary; i++) append_utf8(vocabulary[i], words[i]);
+  if (!quantized.save(output_path, words)) {
+    std::cout << "Invalid file name." << std::endl;
+    return false;
+  }
+
+  if (n_quantization_query > 0 && size_vocabulary > 1) {
+    QuantizationReport report;
+    evaluate_quantization(matrix, quantized, n_quantization_query, 10, seed, n_cores, report);
+    std::cout << "Quantization : " << quantized.bytes_per_row() << " bytes per embedding instead of "
+              << sizeof(float) * dim_embedding << " as float32, squared error "
+              << std::setprecision(4) << 100 * report.relative_error << "% of the squared norm" << std::endl;
+    std::cout << "Top-" << report.k << " neighbours of " << report.n_queries << " words : recall "
+              << report.recall << ", mean rank " << report.mean_rank << " (" << (report.k + 1) / 2.0
+              << " at full precision)" << std::setprecision(6) << std::endl;
+  }
+  return true;
+}
+
+std::string SkipGram::path_with_suffix(const std::string path, const std::string suffix)
+{
+  // "dir/embeddings.txt" -> "dir/embeddings<suffix>.txt"
+  const size_t pos_slash = path.find_last_of('/');
+  const size_t pos_dot = path.find_last_of('.');
+  if (pos_dot == std::string::npos || (pos_slash != std::string::npos && pos_dot < pos_slash)) {
+    return path + suffix;
+  }
+  return path.substr(0, pos_dot) + suffix + path.substr(pos_dot);
 }
@@ -17,18 +17,42 @@
 #include <numeric>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <vector>
 
 #include "cheaprand.h"
+#include "checkpoint.h"
+#include "../common/parallel_writer.h"
+#include "training_stats.h"
+#include "corpus_stream.h"
+#include "vocabulary_index.h"
+#include "shared_model.h"
+#include "../common/corpus_store.h"
+#include "../common/quantizer.h"
 
 #define SIZE_TABLE_UNIGRAM 1000000
 #define SIZE_CHUNK_PROGRESSBAR 1000
+#define SIZE_BLOCK_HELD_OUT 10000
+
+// Scratch space and local state of a training thread
+struct TrainingWorkspace {
+  std::vector<double> gradient_words;
+  std::wstring word;
+  std::wstring context;
+  CheapRand cheaprand;
+  ThreadStatsSnapshot stats;
+};
 
 class SkipGram {
 private:
-  const std::wstring corpus;
-  const std::vector<std::wstring> vocabulary;
-  const std::vector<int64_t> count_vocabulary;
+  const CorpusStore& corpus;
+  const std::shared_ptr<const VocabularyIndex> index;
+  const std::vector<std::wstring>& vocabulary;
+  const std::vector<int64_t>& count_vocabulary;
+  const std::unordered_map<std::wstring, int64_t>& vocabulary2id;
 
   const int64_t size_window;
   const int64_t dim_embedding;
@@ -45,7 +69,6 @@ private:
   int64_t size_vocabulary;
   int64_t sum_count_vocabulary;
   int64_t max_length_word;
-  std::unordered_map<std::wstring, int64_t> vocabulary2id;
 
   CheapRand cheaprand;
   int64_t* table_unigram;
@@ -53,8 +76,64 @@ private:
   double* embeddings_contexts_left;
   double* embeddings_contexts_right;
 
+  // Checkpointing
+  // Training threads publish their ThreadState whenever `id_checkpoint_requested`
+  // moves past the last request they served.
+  std::string checkpoint_path;
+  int64_t checkpoint_interval;
+  std::vector<ThreadState> thread_states;
+  std::vector<int64_t> id_checkpoint_served;
+  std::vector<bool> is_thread_finished;
+  std::atomic<int64_t> id_checkpoint_requested;
+  bool is_training_done;
+  std::mutex mtx_training;
+  std::condition_variable cv_training;
+
+  // Throughput and loss instrumentation, reported every `stats_interval` seconds
+  std::string stats_path;
+  int64_t stats_interval;
+  std::vector<ThreadStats> thread_stats;
+
+  // Number of characters of the corpus, known after a streamed epoch
+  int64_t length_corpus_streamed;
+
+  // Progress bar, off when several models train at the same time
+  bool is_progress_shown;
+
+  // int8 and pq output formats; 0 subspaces picks one per 4 dimensions
+  int64_t pq_subspaces;
+  int64_t pq_iteration;
+  int64_t n_quantization_query;
+
+  // Continued training : the first `size_vocabulary_known` rows come from the continued
+  // model and are updated with `ratio_learning_rate_known` times the learning rate
+  int64_t size_vocabulary_known;
+  double ratio_learning_rate_known;
+
+  // Multi-process training : the parameters are the slot of `rank_process` in
+  // `shared_model`, merged with the other processes every `sync_interval` positions
+  SharedModel* shared_model;
+  int64_t rank_process;
+  int64_t sync_interval;
+  int64_t n_threads_synchronizing;
+  int64_t id_synchronization;
+  std::atomic<bool> is_synchronization_failed;
+  std::mutex mtx_synchronization;
+  std::condition_variable cv_synchronization;
+
+  // Early stopping : the last `length_held_out` characters of the corpus are not trained
+  // on, and their loss is evaluated after every epoch. The learning rate decays linearly
+  // from `learning_rate_plan` at epoch `i_iteration_plan` to 0 at `n_iteration_planned`,
+  // which is moved forward when the held-out loss stops improving by `min_improvement`.
+  int64_t length_held_out;
+  double min_improvement;
+  double loss_held_out_last;
+  int64_t n_iteration_planned;
+  int64_t i_iteration_plan;
+  double learning_rate_plan;
+
 public:
-  SkipGram(const std::wstring& _corpus,
+  SkipGram(const CorpusStore& _corpus,
            const std::vector<std::wstring>& _vocabulary,
            const std::vector<int64_t>& _count_vocabulary,
            const int64_t _size_window,
@@ -66,16 +145,85 @@ public:
            const double _learning_rate,
            const double _rate_sample,
            const double _power_unigram_table);
+  SkipGram(const CorpusStore& _corpus,
+           const std::shared_ptr<const VocabularyIndex> _index,
+           const int64_t _size_window,
+           const int64_t _dim_embedding,
+           const int64_t _seed,
+           const int64_t _n_iteration,
+           const int64_t _n_negative_sample,
+           const int64_t _n_cores,
+           const double _learning_rate,
+           const double _rate_sample,
+           const double _power_unigram_table);
   ~SkipGram();
   void train();
-  void save_vector(const std::string output_path);
+  void train_stream(const std::string corpus_path, const int64_t size_chunk);
+  void save_vector(const std::string output_path, const std::string output_format);
+  void save_context_vector(const std::string output_path, const std::string output_format);
+  static bool is_valid_output_format(const std::string output_format);
+  void set_checkpoint(const std::string _checkpoint_path, const int64_t _checkpoint_interval);
+  bool save_checkpoint(const std::string path);
+  bool load_checkpoint(const std::string path);
+  // Starts from the embeddings of a checkpoint whose vocabulary is a prefix of ours;
+  // the rows of the other words keep their initial values
+  bool continue_from(const std::string path);
+  void set_learning_rate_known(const double _ratio_learning_rate_known);
+  // Moves the parameters into the slot of `_rank_process` and makes train() cover the
+  // partition of the corpus of that process, merging every `_sync_interval` positions
+  void share_parameters(SharedModel& _shared_model, const int64_t _rank_process, const int64_t _sync_interval);
+  // Holds out the last `held_out_ratio` of the corpus for train() to stop early.
+  // False if the held-out slice holds no pair to evaluate.
+  bool set_early_stopping(const double held_out_ratio, const double _min_improvement);
+  void set_stats(const std::string _stats_path, const int64_t _stats_interval);
+  ThreadStatsSnapshot total_stats() const;
+  void show_progress(const bool _is_progress_shown);
+  void set_quantization(const int64_t _pq_subspaces, const int64_t _pq_iteration, const int64_t _n_quantization_query);
 
 private:
   void train_model_eachthread(const int64_t id_thread,
                               const int64_t i_wstr_start,
                               const int64_t length_str,
                               const int64_t n_cores);
+  template <class Text>
+  void train_position(const Text& text,
+                      const int64_t i_str,
+                      const int64_t i_limit,
+                      const double _learning_rate,
+                      TrainingWorkspace& workspace);
+  template <class Text>
+  int64_t train_contexts(const Text& text,
+                         const int64_t i_context,
+                         const int64_t i_limit,
+                         const int64_t id_word,
+                         const bool is_segment_sampled,
+                         const double _learning_rate,
+                         TrainingWorkspace& workspace);
+  bool wait_threads(const std::function<bool()>& run_last);
+  bool synchronize_processes();
+  void end_epoch(const int64_t n_iteration_done, const int64_t length_epoch);
+  double evaluate_held_out(int64_t& n_samples) const;
+  double scheduled_learning_rate(const int64_t i_progress, const int64_t length_epoch) const;
+  std::thread start_monitoring();
+  void stop_monitoring(std::thread& stats_reporter);
+  int64_t publish_thread_state(const int64_t id_thread, const ThreadState& state, const bool is_finished);
+  void run_checkpointer();
+  bool write_checkpoint(const std::string path, const std::vector<ThreadState>& states);
+  void run_stats_reporter();
+  bool save_matrix(const std::string output_path, const std::string output_format, const double* matrix);
+  bool save_quantized(const std::string output_path, const std::string output_format, const double* matrix);
+  static std::string path_with_suffix(const std::string path, const std::string suffix);
   void initialize_parameters();
   void construct_unigramtable(const double power_unigram_table);
+  // -log(sigmoid(x)) for the positive sample, -log(sigmoid(-x)) for negative ones
+  static double loss_sample(const double x, const bool is_negative_sample)
+  {
+    const double z = is_negative_sample ? x : -x;
+    return (z > 0) ? z + log1p(exp(-z)) : log1p(exp(z));
+  }
+  double learning_rate_row(const int64_t id, const double _learning_rate) const
+  {
+    return (id < size_vocabulary_known) ? ratio_learning_rate_known * _learning_rate : _learning_rate;
+  }
 };
 #endif
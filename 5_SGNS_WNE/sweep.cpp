@@ -0,0 +1,192 @@
+#include "sweep.h"
+
+template <class T>
+static bool parse_value(const std::string& text, T& value)
+{
+  std::istringstream iss(text);
+  iss.imbue(std::locale::classic());
+  iss >> value;
+  return !iss.fail() && iss.eof();
+}
+
+bool load_sweep_configs(const std::string sweep_path,
+                        const SweepConfig& base,
+                        std::vector<SweepConfig>& configs)
+{
+  std::ifstream fin(sweep_path);
+  if (!fin.is_open()) {
+    std::cout << "Invalid file name." << std::endl;
+    return false;
+  }
+
+  std::string line;
+  for (int64_t i_line=1; std::getline(fin, line); i_line++) {
+    std::istringstream iss(line);
+    std::string item;
+    if (!(iss >> item) || item[0] == '#') continue;
+
+    SweepConfig config = base;
+    config.output_path.clear();
+    do {
+      const size_t equal = item.find('=');
+      const std::string key = item.substr(0, equal);
+      const std::string value = (equal == std::string::npos) ? "" : item.substr(equal + 1);
+      bool is_valid = false;
+      if (equal == std::string::npos) is_valid = false;
+      else if (key == "output_path") is_valid = !(config.output_path = value).empty();
+      else if (key == "size_window") is_valid = parse_value(value, config.size_window);
+      else if (key == "dim_embedding") is_valid = parse_value(value, config.dim_embedding);
+      else if (key == "seed") is_valid = parse_value(value, config.seed);
+      else if (key == "n_iteration") is_valid = parse_value(value, config.n_iteration);
+      else if (key == "n_negative_sample") is_valid = parse_value(value, config.n_negative_sample);
+      else if (key == "learning_rate") is_valid = parse_value(value, config.learning_rate);
+      else if (key == "rate_sample") is_valid = parse_value(value, config.rate_sample);
+      else if (key == "power_unigram_table") is_valid = parse_value(value, config.power_unigram_table);
+      if (!is_valid) {
+        std::cout << "Invalid setting \"" << item << "\" in line " << i_line << " of " << sweep_path << std::endl;
+        return false;
+      }
+    } while (iss >> item);
+
+    if (config.output_path.empty()) {
+      std::cout << "Line " << i_line << " of " << sweep_path << " has no output_path." << std::endl;
+      return false;
+    }
+    for (const SweepConfig& other : configs) {
+      if (other.output_path == config.output_path) {
+        std::cout << "output_path " << config.output_path << " is used twice in " << sweep_path << std::endl;
+        return false;
+      }
+    }
+    configs.push_back(config);
+  }
+  return true;
+}
+
+Sweep::Sweep(const CorpusStore& _corpus,
+             const std::shared_ptr<const VocabularyIndex> _index,
+             const std::vector<SweepConfig>& _configs,
+             const int64_t _n_cores,
+             const int64_t _n_parallel,
+             const std::string _output_format,
+             const bool _save_contexts)
+  : corpus(_corpus),
+    index(_index),
+    configs(_configs),
+    n_cores(_n_cores),
+    n_parallel(_n_parallel),
+    output_format(_output_format),
+    save_contexts(_save_contexts),
+    checkpoint_interval(0),
+    stats_interval(0),
+    pq_subspaces(0),
+    pq_iteration(10),
+    n_quantization_query(100),
+    i_model_next(0)
+{
+  assert(n_cores > 0);
+  assert(n_parallel > 0);
+}
+
+Sweep::~Sweep() {}
+
+void Sweep::set_checkpoint(const std::string _checkpoint_path, const int64_t _checkpoint_interval)
+{
+  assert(n_parallel == 1);
+  checkpoint_path = _checkpoint_path;
+  checkpoint_interval = _checkpoint_interval;
+}
+
+void Sweep::set_stats(const std::string _stats_path, const int64_t _stats_interval)
+{
+  assert(n_parallel == 1 || _stats_interval == 0);
+  stats_path = _stats_path;
+  stats_interval = _stats_interval;
+}
+
+void Sweep::set_quantization(const int64_t _pq_subspaces, const int64_t _pq_iteration, const int64_t _n_quantization_query)
+{
+  pq_subspaces = _pq_subspaces;
+  pq_iteration = _pq_iteration;
+  n_quantization_query = _n_quantization_query;
+}
+
+void Sweep::run()
+{
+  results.assign(configs.size(), SweepResult{0, 0, 0});
+  i_model_next = 0;
+
+  std::vector<std::thread> workers(std::min<int64_t>(n_parallel, configs.size()));
+  for (auto& worker : workers) worker = std::thread(&Sweep::run_worker, this);
+  for (auto& worker : workers) worker.join();
+
+  print_report();
+}
+
+void Sweep::run_worker()
+{
+  for (int64_t i_model=i_model_next++; i_model<configs.size(); i_model=i_model_next++) {
+    train_model(i_model);
+  }
+}
+
+void Sweep::train_model(const int64_t i_model)
+{
+  const SweepConfig& config = configs[i_model];
+  std::unique_ptr<SkipGram> sg;
+  {
+    std::lock_guard<std::mutex> lock(mtx_output);
+    std::cout << std::endl << "Model " << i_model + 1 << "/" << configs.size() << " : " << config.output_path << std::endl;
+    sg.reset(new SkipGram(corpus, index,
+                          config.size_window, config.dim_embedding, config.seed,
+                          config.n_iteration, config.n_negative_sample, n_cores,
+                          config.learning_rate, config.rate_sample, config.power_unigram_table));
+    sg->show_progress(n_parallel == 1);
+    if (!checkpoint_path.empty()) {
+      sg->set_checkpoint(checkpoint_path + "." + std::to_string(i_model + 1), checkpoint_interval);
+    }
+    sg->set_stats(stats_path.empty() ? "" : stats_path + "." + std::to_string(i_model + 1), stats_interval);
+    sg->set_quantization(std::min(pq_subspaces, config.dim_embedding), pq_iteration, n_quantization_query);
+  }
+
+  const auto t1 = std::chrono::steady_clock::now();
+  sg->train();
+  const auto t2 = std::chrono::steady_clock::now();
+
+  SweepResult& result = results[i_model];
+  const ThreadStatsSnapshot stats = sg->total_stats();
+  result.seconds = std::chrono::duration<double>(t2 - t1).count();
+  result.positions_per_sec = stats.n_positions / std::max(1e-9, result.seconds);
+  result.pairs_per_sec = stats.n_pairs / std::max(1e-9, result.seconds);
+
+  std::lock_guard<std::mutex> lock(mtx_output);
+  std::cout << "Model " << i_model + 1 << "/" << configs.size() << " : training took "
+            << static_cast<int64_t>(1000 * result.seconds) << " milliseconds" << std::endl;
+  sg->save_vector(config.output_path, output_format);
+  if (save_contexts) {
+    sg->save_context_vector(config.output_path, output_format);
+  }
+}
+
+void Sweep::print_report() const
+{
+  std::cout << std::endl << "###### Sweep ######" << std::endl;
+  std::cout << std::right << std::setw(5) << "model" << std::setw(6) << "dim" << std::setw(5) << "neg"
+            << std::setw(11) << "lr" << std::setw(11) << "sample" << std::setw(7) << "power"
+            << std::setw(11) << "time (s)" << std::setw(15) << "positions/sec" << std::setw(13) << "pairs/sec"
+            << "  output_path" << std::endl;
+  for (int64_t i_model=0; i_model<configs.size(); i_model++) {
+    const SweepConfig& config = configs[i_model];
+    const SweepResult& result = results[i_model];
+    std::cout << std::setw(5) << i_model + 1 << std::setw(6) << config.dim_embedding
+              << std::setw(5) << config.n_negative_sample
+              << std::setw(11) << config.learning_rate << std::setw(11) << config.rate_sample
+              << std::setw(7) << config.power_unigram_table
+              << std::fixed << std::setprecision(2) << std::setw(11) << result.seconds
+              << std::setprecision(0) << std::setw(15) << result.positions_per_sec
+              << std::setw(13) << result.pairs_per_sec
+              << "  " << config.output_path << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <locale>
+#include <cstdint>
+#include <cassert>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+#include "skipgram.h"
+#include "vocabulary_index.h"
+#include "../common/corpus_store.h"
+
+// Hyperparameters of one model of a sweep
+struct SweepConfig {
+  std::string output_path;
+  int64_t size_window;
+  int64_t dim_embedding;
+  int64_t seed;
+  int64_t n_iteration;
+  int64_t n_negative_sample;
+  double learning_rate;
+  double rate_sample;
+  double power_unigram_table;
+};
+
+// Reads one model per line as whitespace-separated key=value pairs overriding `base`,
+// e.g. "output_path=emb_d100.txt dim_embedding=100 learning_rate=0.05".
+// Empty lines and lines starting with '#' are skipped.
+bool load_sweep_configs(const std::string sweep_path,
+                        const SweepConfig& base,
+                        std::vector<SweepConfig>& configs);
+
+// Trains several models on one corpus and one VocabularyIndex, `n_parallel` models at
+// a time with `n_cores` threads each, and reports the time and throughput of each model.
+class Sweep {
+private:
+  const CorpusStore& corpus;
+  const std::shared_ptr<const VocabularyIndex> index;
+  const std::vector<SweepConfig> configs;
+  const int64_t n_cores;
+  const int64_t n_parallel;
+  const std::string output_format;
+  const bool save_contexts;
+
+  // Model k writes `<checkpoint_path>.k` and `<stats_path>.k`
+  std::string checkpoint_path;
+  int64_t checkpoint_interval;
+  std::string stats_path;
+  int64_t stats_interval;
+  int64_t pq_subspaces;
+  int64_t pq_iteration;
+  int64_t n_quantization_query;
+
+  struct SweepResult {
+    double seconds;
+    double positions_per_sec;
+    double pairs_per_sec;
+  };
+  std::vector<SweepResult> results;
+  std::atomic<int64_t> i_model_next;
+  std::mutex mtx_output;  // std::cout and std::wcout are not synchronized
+
+public:
+  Sweep(const CorpusStore& _corpus,
+        const std::shared_ptr<const VocabularyIndex> _index,
+        const std::vector<SweepConfig>& _configs,
+        const int64_t _n_cores,
+        const int64_t _n_parallel,
+        const std::string _output_format,
+        const bool _save_contexts);
+  ~Sweep();
+  void set_checkpoint(const std::string _checkpoint_path, const int64_t _checkpoint_interval);
+  void set_stats(const std::string _stats_path, const int64_t _stats_interval);
+  // As SkipGram::set_quantization; pq_subspaces is capped by the dimension of each model
+  void set_quantization(const int64_t _pq_subspaces, const int64_t _pq_iteration, const int64_t _n_quantization_query);
+  void run();
+
+private:
+  void run_worker();
+  void train_model(const int64_t i_model);
+  void print_report() const;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef TRAINING_STATS_H
+#define TRAINING_STATS_H
+
+#include <atomic>
+#include <cstdint>
+
+// Counters of one training thread.
+// The thread accumulates them in locals and publishes its own slot with relaxed
+// stores every SIZE_CHUNK_PROGRESSBAR positions; the reporter thread only reads.
+// Slots are padded so that two threads never publish to the same cache line.
+struct ThreadStats {
+  std::atomic<int64_t> n_positions;        // positions in the corpus visited
+  std::atomic<int64_t> n_pairs;            // (word, context) pairs trained
+  std::atomic<int64_t> n_negative_samples; // negative samples drawn
+  std::atomic<int64_t> n_lookups;          // n-grams looked up in the vocabulary
+  std::atomic<int64_t> n_lookup_hits;      // ... and found
+  std::atomic<int64_t> n_loss;             // samples whose loss is summed in sum_loss
+  std::atomic<double> sum_loss;            // SGNS loss, -log(sigmoid(+-x))
+  std::atomic<double> learning_rate;       // current learning rate
+  std::atomic<double> progress;            // fraction of the thread's work done
+  char padding[64];
+};
+
+// Local counterpart of ThreadStats kept by the training thread and by the reporter
+struct ThreadStatsSnapshot {
+  int64_t n_positions;
+  int64_t n_pairs;
+  int64_t n_negative_samples;
+  int64_t n_lookups;
+  int64_t n_lookup_hits;
+  int64_t n_loss;
+  double sum_loss;
+  double learning_rate;
+  double progress;
+
+  void publish(ThreadStats& stats) const {
+    stats.n_positions.store(n_positions, std::memory_order_relaxed);
+    stats.n_pairs.store(n_pairs, std::memory_order_relaxed);
+    stats.n_negative_samples.store(n_negative_samples, std::memory_order_relaxed);
+    stats.n_lookups.store(n_lookups, std::memory_order_relaxed);
+    stats.n_lookup_hits.store(n_lookup_hits, std::memory_order_relaxed);
+    stats.n_loss.store(n_loss, std::memory_order_relaxed);
+    stats.sum_loss.store(sum_loss, std::memory_order_relaxed);
+    stats.learning_rate.store(learning_rate, std::memory_order_relaxed);
+    stats.progress.store(progress, std::memory_order_relaxed);
+  }
+
+  void load(const ThreadStats& stats) {
+    n_positions = stats.n_positions.load(std::memory_order_relaxed);
+    n_pairs = stats.n_pairs.load(std::memory_order_relaxed);
+    n_negative_samples = stats.n_negative_samples.load(std::memory_order_relaxed);
+    n_lookups = stats.n_lookups.load(std::memory_order_relaxed);
+    n_lookup_hits = stats.n_lookup_hits.load(std::memory_order_relaxed);
+    n_loss = stats.n_loss.load(std::memory_order_relaxed);
+    sum_loss = stats.sum_loss.load(std::memory_order_relaxed);
+    learning_rate = stats.learning_rate.load(std::memory_order_relaxed);
+    progress = stats.progress.load(std::memory_order_relaxed);
+  }
+};
+
+#endif
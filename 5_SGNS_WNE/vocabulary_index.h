@@ -0,0 +1,37 @@
+#ifndef VOCABULARY_INDEX_H
+#define VOCABULARY_INDEX_H
+
+#include <string>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+// Vocabulary of SkipGram with its counts and lookup table.
+// It is not modified once built, so models trained on the same vocabulary share one
+// instance (see sweep.h) instead of each keeping a copy.
+struct VocabularyIndex {
+  const std::vector<std::wstring> vocabulary;
+  const std::vector<int64_t> count_vocabulary;
+  std::unordered_map<std::wstring, int64_t> vocabulary2id;
+  int64_t sum_count_vocabulary;
+  int64_t max_length_word;
+
+  VocabularyIndex(const std::vector<std::wstring>& _vocabulary,
+                  const std::vector<int64_t>& _count_vocabulary)
+    : vocabulary(_vocabulary),
+      count_vocabulary(_count_vocabulary)
+  {
+    sum_count_vocabulary = std::accumulate(count_vocabulary.begin(), count_vocabulary.end(), static_cast<int64_t>(0));
+    max_length_word = 0;
+    for (auto &v : vocabulary) {
+      const int64_t length = v.size();
+      if (length > max_length_word) max_length_word = length;
+    }
+    for (int64_t i=0; i<vocabulary.size(); i++) {
+      vocabulary2id[vocabulary[i]] = i;
+    }
+  }
+};
+
+#endif
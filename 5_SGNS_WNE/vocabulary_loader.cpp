@@ -0,0 +1,154 @@
+#include "vocabulary_loader.h"
+
+VocabularyTable::VocabularyTable(const std::vector<std::wstring>& vocabulary)
+{
+  keys.resize(vocabulary.size());
+  for (int64_t id=0; id<vocabulary.size(); id++) append_utf8(vocabulary[id], keys[id]);
+  build();
+}
+
+VocabularyTable::VocabularyTable(const std::vector<std::string>& vocabulary_utf8)
+  : keys(vocabulary_utf8)
+{
+  build();
+}
+
+void VocabularyTable::build()
+{
+  int64_t size_table = 16;
+  while (size_table < 2 * static_cast<int64_t>(keys.size())) size_table *= 2;
+  slots.assign(size_table, -1);
+  mask = size_table - 1;
+
+  hashes.resize(keys.size());
+  for (int64_t id=0; id<keys.size(); id++) {
+    hashes[id] = hash(keys[id].data(), keys[id].size());
+
+    // A word listed twice maps to its last id
+    uint64_t i = hashes[id] & mask;
+    while (slots[i] >= 0 && keys[slots[i]] != keys[id]) i = (i + 1) & mask;
+    slots[i] = id;
+  }
+}
+
+uint64_t VocabularyTable::hash(const char* key, const int64_t length)
+{
+  // FNV-1a
+  uint64_t h = 14695981039346656037ULL;
+  for (int64_t i=0; i<length; i++) {
+    h ^= static_cast<unsigned char>(key[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+int64_t VocabularyTable::find(const char* key, const int64_t length) const
+{
+  const uint64_t h = hash(key, length);
+  for (uint64_t i=h&mask; slots[i]>=0; i=(i+1)&mask) {
+    const int64_t id = slots[i];
+    if (hashes[id] == h && keys[id].size() == length
+        && std::memcmp(keys[id].data(), key, length) == 0) return id;
+  }
+  return -1;
+}
+
+bool load_vocabulary(const std::string word_data_path,
+                     const int64_t embed_num,
+                     std::vector<std::wstring>& vocabulary)
+{
+  MappedFile file;
+  if (!file.open(word_data_path)) return false;
+  const char* p = file.data();
+  const char* end = p + file.size();
+
+  for (int64_t i=0; i<embed_num && p<end; i++) {
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    const char* tab = static_cast<const char*>(std::memchr(p, '\t', eol - p));
+    if (tab == nullptr) tab = eol;
+
+    std::wstring word;
+    decode_utf8(p, tab - p, word);
+    vocabulary.push_back(word);
+    p = eol + 1;
+  }
+  return true;
+}
+
+int64_t expand_vocabulary(const std::vector<std::wstring>& vocabulary_known,
+                          std::vector<std::wstring>& vocabulary)
+{
+  std::unordered_set<std::wstring> words_known(vocabulary_known.begin(), vocabulary_known.end());
+  std::vector<std::wstring> expanded(vocabulary_known);
+  for (const std::wstring& word : vocabulary) {
+    if (words_known.insert(word).second) expanded.push_back(word);
+  }
+  const int64_t n_added = expanded.size() - vocabulary_known.size();
+  vocabulary.swap(expanded);
+  return n_added;
+}
+
+// Parses the count after the tab; counts may be written with thousands separators
+// by a locale-imbued stream, as the other stages do
+static int64_t parse_count(const char* p, const char* end)
+{
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  int64_t number = 0;
+  for (; p < end; p++) {
+    if (*p >= '0' && *p <= '9') number = 10 * number + (*p - '0');
+    else if (*p != ',') break;
+  }
+  return number;
+}
+
+bool load_count_vocabulary(const std::string ngram_data_path,
+                           const std::vector<std::wstring>& vocabulary,
+                           const int64_t n_cores,
+                           std::vector<int64_t>& count_vocabulary)
+{
+  MappedFile file;
+  if (!file.open(ngram_data_path)) return false;
+  const char* data = file.data();
+  const int64_t size = file.size();
+  const int64_t size_vocabulary = vocabulary.size();
+  const VocabularyTable table(vocabulary);
+
+  // Each thread parses whole lines : a range starts after a newline
+  const int64_t n_jobs = std::max<int64_t>(1, std::min<int64_t>(n_cores, size / (1 << 20)));
+  std::vector<int64_t> boundaries(n_jobs + 1, size);
+  boundaries[0] = 0;
+  for (int64_t k=1; k<n_jobs; k++) {
+    const int64_t i = std::max(boundaries[k-1], size * k / n_jobs);
+    const char* eol = static_cast<const char*>(std::memchr(data + i, '\n', size - i));
+    boundaries[k] = (eol == nullptr) ? size : eol + 1 - data;
+  }
+
+  // Each job keeps the (id, count) of the lines it matched, in file order
+  std::vector<std::vector<std::pair<int64_t, int64_t>>> counts(n_jobs);
+  std::vector<std::thread> vector_threads(n_jobs);
+  for (int64_t k=0; k<n_jobs; k++) {
+    vector_threads[k] = std::thread([&, k]() {
+      const char* p = data + boundaries[k];
+      const char* end = data + boundaries[k+1];
+      while (p < end) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (eol == nullptr) eol = end;
+        const char* tab = static_cast<const char*>(std::memchr(p, '\t', eol - p));
+        if (tab != nullptr) {
+          const int64_t id = table.find(p, tab - p);
+          if (id >= 0) counts[k].emplace_back(id, parse_count(tab + 1, eol));
+        }
+        p = eol + 1;
+      }
+    });
+  }
+  for (auto& th : vector_threads) th.join();
+
+  // initialize the occurrence of words with 1, then take the last count found
+  count_vocabulary.assign(size_vocabulary, 1);
+  for (int64_t k=0; k<n_jobs; k++) {
+    for (const auto& count : counts[k]) count_vocabulary[count.first] = count.second;
+  }
+  return true;
+}
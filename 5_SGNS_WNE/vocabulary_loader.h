@@ -0,0 +1,55 @@
+#ifndef VOCABULARY_LOADER_H
+#define VOCABULARY_LOADER_H
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+#include <thread>
+
+#include "../common/utf8.h"
+#include "../common/mapped_file.h"
+
+// Open-addressing table from the UTF-8 bytes of the vocabulary to their ids.
+// Lines of the n-gram file are probed in place, without building a key per line.
+class VocabularyTable {
+private:
+  std::vector<std::string> keys;
+  std::vector<uint64_t> hashes;
+  std::vector<int64_t> slots;  // id, or -1 for an empty slot
+  uint64_t mask;
+
+public:
+  explicit VocabularyTable(const std::vector<std::wstring>& vocabulary);
+  // From words already encoded in UTF-8
+  explicit VocabularyTable(const std::vector<std::string>& vocabulary_utf8);
+  int64_t find(const char* key, const int64_t length) const;
+
+private:
+  void build();
+  static uint64_t hash(const char* key, const int64_t length);
+};
+
+// Reads the words of the first `embed_num` lines of `word_data_path`
+// (the text before the first tab of each line)
+bool load_vocabulary(const std::string word_data_path,
+                     const int64_t embed_num,
+                     std::vector<std::wstring>& vocabulary);
+
+// Appends to `vocabulary_known` the words of `vocabulary` it lacks, in their order,
+// and stores the result in `vocabulary`; returns the number of words added
+int64_t expand_vocabulary(const std::vector<std::wstring>& vocabulary_known,
+                          std::vector<std::wstring>& vocabulary);
+
+// Reads the counts of `vocabulary` from `ngram_data_path` ("n-gram\tcount" lines),
+// splitting the file among `n_cores` threads. Words which do not appear count 1, and
+// the last line wins when a word appears several times.
+bool load_count_vocabulary(const std::string ngram_data_path,
+                           const std::vector<std::wstring>& vocabulary,
+                           const int64_t n_cores,
+                           std::vector<int64_t>& count_vocabulary);
+
+#endif
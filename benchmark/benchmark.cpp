@@ -0,0 +1,424 @@
+/*
+    Benchmark the hot loops and the whole run of stages 2, 4 and 5
+*/
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <locale>
+#include <codecvt>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include <unordered_map>
+
+#include "cmdline.h"
+#include "synthetic_corpus.h"
+#include "../common/corpus_store.h"
+#include "../common/resource_usage.h"
+#include "../2_count_ngram_frequency/lossycounting.h"
+#include "../4_count_expected_word_frequency/counting_word.h"
+#include "../5_SGNS_WNE/skipgram.h"
+#include "../common/parallel_writer.h"
+
+struct BenchmarkResult {
+  std::string suite;
+  std::string name;
+  int64_t size;       // n-gram or word length, or context window, of a micro-benchmark, 0 otherwise
+  int64_t n_threads;
+  double seconds;     // best of the repeats
+  int64_t peak_bytes;
+  bool is_peak_of_stage;
+  std::vector<std::pair<std::string, double>> throughputs;
+  double speedup;     // against the first thread count of the same benchmark
+};
+
+// Discards what the stages print while they are measured
+class SilentOutput {
+private:
+  class NullBuffer : public std::streambuf {
+  protected:
+    int overflow(int c) { return traits_type::not_eof(c); }
+  };
+  class WideNullBuffer : public std::wstreambuf {
+  protected:
+    std::wint_t overflow(std::wint_t c) { return traits_type::not_eof(c); }
+  };
+  NullBuffer null_buffer;
+  WideNullBuffer wide_null_buffer;
+  std::streambuf* buffer_cout;
+  std::wstreambuf* buffer_wcout;
+
+public:
+  SilentOutput()
+  {
+    buffer_cout = std::cout.rdbuf(&null_buffer);
+    buffer_wcout = std::wcout.rdbuf(&wide_null_buffer);
+  }
+  ~SilentOutput()
+  {
+    std::cout.rdbuf(buffer_cout);
+    std::wcout.rdbuf(buffer_wcout);
+  }
+};
+
+class Benchmark {
+private:
+  const CorpusStore& corpus;
+  const std::vector<double>& word_boundary;
+  const int64_t repeat;
+  std::vector<BenchmarkResult> results;
+
+public:
+  Benchmark(const CorpusStore& _corpus, const std::vector<double>& _word_boundary, const int64_t _repeat)
+    : corpus(_corpus), word_boundary(_word_boundary), repeat(_repeat) {}
+
+  // Runs `setup` then measures `run` `repeat` times and keeps the fastest run.
+  // `run` returns the amounts of work done, reported per second under the given names.
+  template <class Setup, class Run>
+  void measure(const std::string suite, const std::string name, const int64_t size, const int64_t n_threads,
+               const std::vector<std::string> names_throughput, Setup setup, Run run)
+  {
+    BenchmarkResult result{suite, name, size, n_threads, 0, 0, true, {}, 1};
+    std::vector<double> amounts;
+    for (int64_t i_repeat=0; i_repeat<repeat; i_repeat++) {
+      StageUsage usage(name);
+      std::vector<double> amounts_repeat;
+      {
+        SilentOutput silent;
+        auto state = setup();
+        usage.start();
+        amounts_repeat = run(*state);
+        usage.stop();
+      }
+      if (i_repeat == 0 || usage.seconds < result.seconds) {
+        result.seconds = usage.seconds;
+        amounts = amounts_repeat;
+      }
+      result.peak_bytes = std::max(result.peak_bytes, usage.peak_bytes);
+      result.is_peak_of_stage = usage.is_peak_of_stage;
+    }
+    for (int64_t k=0; k<names_throughput.size(); k++) {
+      result.throughputs.push_back(std::make_pair(names_throughput[k], amounts[k] / std::max(1e-9, result.seconds)));
+    }
+    for (const BenchmarkResult& other : results) {
+      if (other.suite == suite && other.name == name && other.size == size) {
+        result.speedup = other.seconds / std::max(1e-9, result.seconds);
+        break;
+      }
+    }
+    results.push_back(result);
+    print(result);
+  }
+
+  const std::vector<BenchmarkResult>& get_results() const { return results; }
+
+  static void print_header()
+  {
+    std::cout << std::left << std::setw(7) << "suite" << std::setw(20) << "benchmark"
+              << std::right << std::setw(5) << "size" << std::setw(9) << "threads"
+              << std::setw(11) << "time (s)" << std::setw(9) << "speedup"
+              << std::setw(16) << "peak RSS (MiB)" << "  throughput" << std::endl;
+  }
+
+private:
+  static void print(const BenchmarkResult& result)
+  {
+    std::cout << std::left << std::setw(7) << result.suite << std::setw(20) << result.name
+              << std::right << std::setw(5) << result.size << std::setw(9) << result.n_threads
+              << std::fixed << std::setprecision(3) << std::setw(11) << result.seconds
+              << std::setprecision(2) << std::setw(9) << result.speedup
+              << std::setprecision(1) << std::setw(16) << result.peak_bytes / 1048576.0;
+    std::cout.unsetf(std::ios::floatfield);
+    for (const auto& throughput : result.throughputs) {
+      std::cout << "  " << throughput.first << " " << std::setprecision(4) << throughput.second;
+    }
+    std::cout << std::setprecision(6) << std::endl;
+  }
+};
+
+static std::vector<int64_t> parse_list(const std::string list)
+{
+  std::vector<int64_t> values;
+  std::istringstream iss(list);
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    const int64_t n = std::atoll(item.c_str());
+    if (n > 0) values.push_back(n);
+  }
+  return values;
+}
+
+static bool write_json(const std::string path,
+                       const std::vector<std::pair<std::string, std::string>>& config,
+                       const std::vector<BenchmarkResult>& results)
+{
+  std::string json = "{\"config\": {";
+  for (int64_t i=0; i<config.size(); i++) {
+    if (i) json += ", ";
+    json += "\"" + config[i].first + "\": " + config[i].second;
+  }
+  json += "},\n \"results\": [\n";
+  for (int64_t i=0; i<results.size(); i++) {
+    const BenchmarkResult& r = results[i];
+    json += "  {\"suite\": \"" + r.suite + "\", \"name\": \"" + r.name + "\", \"size\": ";
+    append_int64(r.size, json);
+    json += ", \"threads\": ";
+    append_int64(r.n_threads, json);
+    json += ", \"seconds\": ";
+    append_double(r.seconds, json);
+    json += ", \"speedup\": ";
+    append_double(r.speedup, json);
+    json += ", \"peak_rss_bytes\": ";
+    append_int64(r.peak_bytes, json);
+    json += ", \"is_peak_of_stage\": ";
+    json += r.is_peak_of_stage ? "true" : "false";
+    for (const auto& throughput : r.throughputs) {
+      json += ", \"" + throughput.first + "\": ";
+      append_double(throughput.second, json);
+    }
+    json += (i + 1 < results.size()) ? "},\n" : "}\n";
+  }
+  json += " ]}\n";
+
+  std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) return false;
+  fout.write(json.data(), json.size());
+  fout.close();
+  return !fout.fail();
+}
+
+int main(int argc, char* argv[]) {
+
+  // handling wide string
+  std::ios_base::sync_with_stdio(false);
+  std::locale default_loc("en_US.UTF-8");
+  std::locale::global(default_loc);
+  std::locale ctype_default(std::locale::classic(), default_loc, std::locale::ctype);
+  std::wcout.imbue(ctype_default);
+  std::wcin.imbue(ctype_default);
+  std::cout.imbue(std::locale::classic());
+
+  // parsing parameters https://github.com/tanakh/cmdline
+  cmdline::parser a;
+  a.add<std::string>("output_path", '\0', "output path of the results (JSON)", true);
+  a.add<std::string>("corpus_path", '\0', "benchmark on this corpus instead of a synthetic one", false);
+  a.add<std::string>("synthetic_path", '\0', "where the synthetic corpus is written", false, "synthetic_corpus.txt");
+  a.add<int64_t>("length", '\0', "number of characters of the synthetic corpus", false, 10000000);
+  a.add<int64_t>("size_alphabet", '\0', "number of distinct characters of the synthetic corpus", false, 6000);
+  a.add<int64_t>("size_vocabulary", '\0', "number of distinct words of the synthetic corpus", false, 100000);
+  a.add<double>("exponent_character", '\0', "exponent of Zipf's law of the characters", false, 1.0);
+  a.add<double>("exponent_word", '\0', "exponent of Zipf's law of the words", false, 1.0);
+  a.add<int64_t>("seed", '\0', "seed", false, 2018);
+  a.add<std::string>("threads", '\0', "comma-separated thread counts of the macro-benchmarks", false, "1,2,4,8");
+  a.add<std::string>("windows", '\0', "comma-separated context windows of the training micro-benchmark", false, "1,2,3,5");
+  a.add<std::string>("suite", '\0', "micro, macro or all", false, "all");
+  a.add<int64_t>("repeat", '\0', "runs of each benchmark, the fastest is kept", false, 1);
+  a.add<int64_t>("max_ngram_size", '\0', "max_ngram_size", false, 4);
+  a.add<double>("support_threshold", '\0', "support threshold", false, 1e-7);
+  a.add<double>("epsilon", '\0', "epsilon", false, 1e-7);
+  a.add<int64_t>("max_word_length", '\0', "max_word_length, also the longest word of a synthetic corpus", false, 4);
+  a.add<int64_t>("embed_num", '\0', "embed_num", false, 100000);
+  a.add<int64_t>("dim_embedding", '\0', "dim_embedding", false, 100);
+  a.add<int64_t>("n_iteration", '\0', "n_iteration", false, 1);
+  a.add<int64_t>("n_negative_sample", '\0', "n_negative_sample", false, 5);
+  a.parse_check(argc, argv);
+  std::string output_path = a.get<std::string>("output_path");
+  std::string corpus_path = a.get<std::string>("corpus_path");
+  std::string synthetic_path = a.get<std::string>("synthetic_path");
+  int64_t length = a.get<int64_t>("length");
+  int64_t size_alphabet = a.get<int64_t>("size_alphabet");
+  int64_t size_vocabulary = a.get<int64_t>("size_vocabulary");
+  double exponent_character = a.get<double>("exponent_character");
+  double exponent_word = a.get<double>("exponent_word");
+  int64_t seed = a.get<int64_t>("seed");
+  std::vector<int64_t> threads = parse_list(a.get<std::string>("threads"));
+  std::vector<int64_t> windows = parse_list(a.get<std::string>("windows"));
+  std::string suite = a.get<std::string>("suite");
+  int64_t repeat = a.get<int64_t>("repeat");
+  int64_t max_ngram_size = a.get<int64_t>("max_ngram_size");
+  double support_threshold = a.get<double>("support_threshold");
+  double epsilon = a.get<double>("epsilon");
+  int64_t max_word_length = a.get<int64_t>("max_word_length");
+  int64_t embed_num = a.get<int64_t>("embed_num");
+  int64_t dim_embedding = a.get<int64_t>("dim_embedding");
+  int64_t n_iteration = a.get<int64_t>("n_iteration");
+  int64_t n_negative_sample = a.get<int64_t>("n_negative_sample");
+
+  const bool is_micro = (suite == "micro" || suite == "all");
+  const bool is_macro = (suite == "macro" || suite == "all");
+  if (!is_micro && !is_macro) {
+    std::cout << "Invalid suite." << std::endl;
+    return 0;
+  }
+  if (threads.empty() || windows.empty() || repeat <= 0) {
+    std::cout << "Invalid thread counts, windows or repeat." << std::endl;
+    return 0;
+  }
+  if (size_alphabet <= 0 || size_alphabet > SyntheticCorpus::max_size_alphabet()) {
+    std::cout << "size_alphabet must be between 1 and " << SyntheticCorpus::max_size_alphabet() << "." << std::endl;
+    return 0;
+  }
+  if (max_word_length <= 0) {
+    std::cout << "max_word_length must be positive." << std::endl;
+    return 0;
+  }
+  const int64_t max_threads = *std::max_element(threads.begin(), threads.end());
+
+  // Corpus and word boundary. A given corpus gets a random word boundary :
+  // it changes the counts of stage 4 but hardly its speed.
+  std::vector<double> word_boundary;
+  if (corpus_path.empty()) {
+    corpus_path = synthetic_path;
+    std::cout << "Generating " << length << " characters to " << corpus_path << std::endl;
+    SyntheticCorpus generator(length, size_alphabet, size_vocabulary, max_word_length,
+                              exponent_character, exponent_word, seed);
+    if (!generator.generate(corpus_path, &word_boundary)) {
+      std::cout << "Invalid file name." << std::endl;
+      return 0;
+    }
+  }
+  CorpusStore corpus;
+  if (!corpus.load(corpus_path, max_threads)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  if (word_boundary.size() != corpus.size()) {
+    std::mt19937_64 engine(seed);
+    word_boundary.resize(corpus.size());
+    for (double& p : word_boundary) p = ZipfSampler::uniform(engine);
+  }
+  const double length_corpus = corpus.size();
+
+  // Vocabulary of stage 5 as the pipeline makes it
+  std::cout << "Preparing the vocabulary" << std::endl;
+  std::vector<std::wstring> vocabulary;
+  std::vector<int64_t> count_vocabulary;
+  {
+    SilentOutput silent;
+    std::unordered_map<std::wstring, int64_t> ngram_occurence;
+    LossyCountingNgram counter(corpus, max_ngram_size, support_threshold, epsilon, max_threads);
+    counter.count_ngram();
+    counter.extract_all_ngram(ngram_occurence);
+    std::vector<std::pair<std::wstring, double>> words;
+    CountingWord wordcounter(corpus, word_boundary, max_word_length, embed_num, max_threads);
+    wordcounter.count_word();
+    wordcounter.extract_top_word(words, embed_num);
+    for (const auto& word : words) {
+      vocabulary.push_back(word.first);
+      const auto it = ngram_occurence.find(word.first);
+      count_vocabulary.push_back((it == ngram_occurence.end()) ? 1 : it->second);
+    }
+  }
+  std::cout << "corpus.size()       : " << corpus.size() << std::endl;
+  std::cout << "size_alphabet       : " << corpus.size_alphabet() << std::endl;
+  std::cout << "vocabulary.size()   : " << vocabulary.size() << std::endl << std::endl;
+
+  Benchmark benchmark(corpus, word_boundary, repeat);
+  Benchmark::print_header();
+
+  auto make_counter = [&](const int64_t n_threads) {
+    return [&, n_threads]() {
+      return std::unique_ptr<LossyCountingNgram>(
+        new LossyCountingNgram(corpus, max_ngram_size, support_threshold, epsilon, n_threads));
+    };
+  };
+  auto make_wordcounter = [&](const int64_t n_threads) {
+    return [&, n_threads]() {
+      return std::unique_ptr<CountingWord>(
+        new CountingWord(corpus, word_boundary, max_word_length, embed_num, n_threads));
+    };
+  };
+  auto make_skipgram = [&](const int64_t n_threads, const int64_t size_window) {
+    return [&, n_threads, size_window]() {
+      return std::unique_ptr<SkipGram>(
+        new SkipGram(corpus, vocabulary, count_vocabulary,
+                     size_window, dim_embedding, seed, n_iteration, n_negative_sample, n_threads,
+                     0.025, 0.0001, 0.75));
+    };
+  };
+  auto run_train = [&](SkipGram& sg) {
+    sg.train();
+    const ThreadStatsSnapshot stats = sg.total_stats();
+    return std::vector<double>{static_cast<double>(stats.n_positions), static_cast<double>(stats.n_pairs)};
+  };
+
+  // Hot loops on one thread : count_ngram_each, count_word_each and train_model_eachthread
+  if (is_micro) {
+    for (int64_t n=1; n<=max_ngram_size; n++) {
+      benchmark.measure("micro", "count_ngram_each", n, 1, {"chars_per_sec"}, make_counter(1),
+                        [&, n](LossyCountingNgram& counter) {
+                          counter.count_ngram_each(n);
+                          return std::vector<double>{length_corpus};
+                        });
+    }
+    for (int64_t n=1; n<=max_word_length; n++) {
+      benchmark.measure("micro", "count_word_each", n, 1, {"chars_per_sec"}, make_wordcounter(1),
+                        [&, n](CountingWord& wordcounter) {
+                          wordcounter.count_word_each(n);
+                          return std::vector<double>{length_corpus};
+                        });
+    }
+    for (const int64_t window : windows) {
+      benchmark.measure("micro", "train_eachthread", window, 1, {"positions_per_sec", "pairs_per_sec"},
+                        make_skipgram(1, window), run_train);
+    }
+  }
+
+  // Whole stages with each thread count
+  if (is_macro) {
+    for (const int64_t n_threads : threads) {
+      benchmark.measure("macro", "load_corpus", 0, n_threads, {"chars_per_sec"},
+                        [&]() { return std::unique_ptr<CorpusStore>(new CorpusStore()); },
+                        [&, n_threads](CorpusStore& store) {
+                          store.load(corpus_path, n_threads);
+                          return std::vector<double>{static_cast<double>(store.size())};
+                        });
+      benchmark.measure("macro", "count_ngram", 0, n_threads, {"chars_per_sec"}, make_counter(n_threads),
+                        [&](LossyCountingNgram& counter) {
+                          counter.count_ngram();
+                          return std::vector<double>{length_corpus};
+                        });
+      benchmark.measure("macro", "count_word", 0, n_threads, {"chars_per_sec"}, make_wordcounter(n_threads),
+                        [&](CountingWord& wordcounter) {
+                          std::vector<std::pair<std::wstring, double>> words;
+                          wordcounter.count_word();
+                          wordcounter.extract_top_word(words, embed_num);
+                          return std::vector<double>{length_corpus};
+                        });
+      benchmark.measure("macro", "train", 0, n_threads, {"positions_per_sec", "pairs_per_sec"},
+                        make_skipgram(n_threads, 1), run_train);
+    }
+  }
+
+  std::vector<std::pair<std::string, std::string>> config;
+  std::string value;
+  auto add_int64 = [&](const std::string key, const int64_t x) { value.clear(); append_int64(x, value); config.push_back({key, value}); };
+  auto add_double = [&](const std::string key, const double x) { value.clear(); append_double(x, value); config.push_back({key, value}); };
+  add_int64("length", corpus.size());
+  add_int64("size_alphabet", corpus.size_alphabet());
+  add_int64("size_vocabulary", vocabulary.size());
+  add_double("exponent_character", exponent_character);
+  add_double("exponent_word", exponent_word);
+  add_int64("seed", seed);
+  add_int64("repeat", repeat);
+  add_int64("max_ngram_size", max_ngram_size);
+  add_int64("max_word_length", max_word_length);
+  add_int64("dim_embedding", dim_embedding);
+  add_int64("n_iteration", n_iteration);
+  add_int64("n_negative_sample", n_negative_sample);
+  add_int64("hardware_concurrency", std::thread::hardware_concurrency());
+
+  std::cout << std::endl << "Saving results to " << output_path << std::endl;
+  if (!write_json(output_path, config, benchmark.get_results())) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  std::cout << "Done" << std::endl;
+
+  return 0;
+}
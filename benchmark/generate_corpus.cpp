@@ -0,0 +1,48 @@
+/*
+    Generate a deterministic synthetic pre-processed corpus for benchmarking
+*/
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "cmdline.h"
+#include "synthetic_corpus.h"
+
+int main(int argc, char* argv[]) {
+
+  // parsing parameters https://github.com/tanakh/cmdline
+  cmdline::parser a;
+  a.add<std::string>("output_path", '\0', "output path of the UTF-8 corpus", true);
+  a.add<int64_t>("length", '\0', "number of characters", false, 10000000);
+  a.add<int64_t>("size_alphabet", '\0', "number of distinct characters", false, 6000);
+  a.add<int64_t>("size_vocabulary", '\0', "number of distinct words", false, 100000);
+  a.add<int64_t>("max_length_word", '\0', "max length of the words", false, 4);
+  a.add<double>("exponent_character", '\0', "exponent of Zipf's law of the characters", false, 1.0);
+  a.add<double>("exponent_word", '\0', "exponent of Zipf's law of the words", false, 1.0);
+  a.add<int64_t>("seed", '\0', "seed", false, 2018);
+  a.parse_check(argc, argv);
+  std::string output_path = a.get<std::string>("output_path");
+  int64_t length = a.get<int64_t>("length");
+  int64_t size_alphabet = a.get<int64_t>("size_alphabet");
+  int64_t size_vocabulary = a.get<int64_t>("size_vocabulary");
+  int64_t max_length_word = a.get<int64_t>("max_length_word");
+  double exponent_character = a.get<double>("exponent_character");
+  double exponent_word = a.get<double>("exponent_word");
+  int64_t seed = a.get<int64_t>("seed");
+
+  if (size_alphabet <= 0 || size_alphabet > SyntheticCorpus::max_size_alphabet()) {
+    std::cout << "size_alphabet must be between 1 and " << SyntheticCorpus::max_size_alphabet() << "." << std::endl;
+    return 0;
+  }
+
+  std::cout << "Generating " << length << " characters to " << output_path << std::endl;
+  SyntheticCorpus generator(length, size_alphabet, size_vocabulary, max_length_word,
+                            exponent_character, exponent_word, seed);
+  if (!generator.generate(output_path, nullptr)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  std::cout << "Done" << std::endl;
+
+  return 0;
+}
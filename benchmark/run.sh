@@ -0,0 +1,16 @@
+#!/bin/bash
+set -e
+make
+# Chinese-sized alphabet, then a corpus store with 4-byte ids
+./benchmark --output_path=../data/benchmark_cjk.json \
+            --synthetic_path=../data/synthetic_corpus.txt \
+            --length=10000000 \
+            --size_alphabet=20000 \
+            --threads=1,2,4,8 \
+            --repeat=3
+./benchmark --output_path=../data/benchmark_wide.json \
+            --synthetic_path=../data/synthetic_corpus.txt \
+            --length=10000000 \
+            --size_alphabet=70000 \
+            --suite=macro \
+            --threads=1,8
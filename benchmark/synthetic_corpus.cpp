@@ -0,0 +1,119 @@
+#include "synthetic_corpus.h"
+
+// Code points used for the alphabet, in this order
+static const uint32_t RANGES_ALPHABET[][2] = {
+  {0x4E00, 0x9FFF},   // CJK Unified Ideographs
+  {0x3400, 0x4DBF},   // CJK Extension A
+  {0xAC00, 0xD7A3},   // Hangul Syllables
+  {0x20000, 0x2A6DF}, // CJK Extension B
+};
+
+ZipfSampler::ZipfSampler(const int64_t n, const double exponent)
+{
+  assert(n > 0);
+  cdf.resize(n);
+  double sum = 0;
+  for (int64_t rank=0; rank<n; rank++) {
+    sum += 1.0 / std::pow(rank + 1, exponent);
+    cdf[rank] = sum;
+  }
+  for (double& c : cdf) c /= sum;
+}
+
+int64_t ZipfSampler::sample(std::mt19937_64& engine) const
+{
+  const int64_t rank = std::upper_bound(cdf.begin(), cdf.end(), uniform(engine)) - cdf.begin();
+  return std::min<int64_t>(rank, cdf.size() - 1);
+}
+
+// Uniform in [0, 1) from the 53 upper bits
+double ZipfSampler::uniform(std::mt19937_64& engine)
+{
+  return (engine() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+SyntheticCorpus::SyntheticCorpus(const int64_t _length,
+                                 const int64_t _size_alphabet,
+                                 const int64_t _size_vocabulary,
+                                 const int64_t _max_length_word,
+                                 const double _exponent_character,
+                                 const double _exponent_word,
+                                 const int64_t _seed)
+  : length(_length),
+    size_alphabet(_size_alphabet),
+    size_vocabulary(_size_vocabulary),
+    max_length_word(_max_length_word),
+    exponent_character(_exponent_character),
+    exponent_word(_exponent_word),
+    seed(_seed)
+{
+  assert(length >= 0);
+  assert(size_alphabet > 0 && size_alphabet <= max_size_alphabet());
+  assert(size_vocabulary > 0);
+  assert(max_length_word > 0);
+  assert(sizeof(wchar_t) >= 4 || size_alphabet <= 0xAC00 - 0x4E00);
+
+  for (const auto& range : RANGES_ALPHABET) {
+    for (uint32_t c=range[0]; c<=range[1] && alphabet.size()<size_alphabet; c++) {
+      alphabet.push_back(static_cast<wchar_t>(c));
+    }
+  }
+
+  std::mt19937_64 engine(seed);
+  const ZipfSampler sampler_character(size_alphabet, exponent_character);
+  vocabulary.resize(size_vocabulary);
+  for (std::wstring& word : vocabulary) {
+    const int64_t length_word = 1 + engine() % max_length_word;
+    for (int64_t i=0; i<length_word; i++) word.push_back(alphabet[sampler_character.sample(engine)]);
+  }
+}
+
+SyntheticCorpus::~SyntheticCorpus() {}
+
+int64_t SyntheticCorpus::max_size_alphabet()
+{
+  int64_t size = 0;
+  for (const auto& range : RANGES_ALPHABET) size += range[1] - range[0] + 1;
+  return size;
+}
+
+bool SyntheticCorpus::generate(const std::string output_path, std::vector<double>* word_boundary) const
+{
+  std::ofstream fout(output_path, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) return false;
+  if (word_boundary != nullptr) {
+    word_boundary->clear();
+    word_boundary->reserve(length);
+  }
+
+  // Separate engine from the vocabulary so that the text only depends on the seed
+  std::mt19937_64 engine(seed + 1);
+  const ZipfSampler sampler_word(size_vocabulary, exponent_word);
+  std::string buffer;
+  int64_t n_written = 0;
+
+  auto append = [&](const wchar_t c, const bool is_head) {
+    append_utf8(c, buffer);
+    if (word_boundary != nullptr) {
+      const double noise = ZipfSampler::uniform(engine);
+      word_boundary->push_back(is_head ? 0.75 + 0.25 * noise : 0.25 * noise);
+    }
+    n_written++;
+  };
+
+  while (n_written < length) {
+    if (n_written > 0) append(VISIBLE_SPACE, true);
+    const int64_t n_words = MIN_WORDS_SENTENCE + engine() % (MAX_WORDS_SENTENCE - MIN_WORDS_SENTENCE + 1);
+    for (int64_t i_word=0; i_word<n_words && n_written<length; i_word++) {
+      const std::wstring& word = vocabulary[sampler_word.sample(engine)];
+      for (int64_t i=0; i<word.size() && n_written<length; i++) append(word[i], i == 0);
+    }
+    if (buffer.size() >= (1 << 20)) {
+      fout.write(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+  }
+  fout.write(buffer.data(), buffer.size());
+  fout.close();
+  return !fout.fail();
+}
@@ -0,0 +1,66 @@
+#ifndef SYNTHETIC_CORPUS_H
+#define SYNTHETIC_CORPUS_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "../common/utf8.h"
+
+#define VISIBLE_SPACE L'\u2423'
+#define MIN_WORDS_SENTENCE 5
+#define MAX_WORDS_SENTENCE 20
+
+// Draws ranks 0, ..., n-1 with probability proportional to 1 / (rank + 1)^exponent.
+// Only the raw output of the engine is used, so the draws are the same on every platform.
+class ZipfSampler {
+private:
+  std::vector<double> cdf;
+
+public:
+  ZipfSampler(const int64_t n, const double exponent);
+  int64_t sample(std::mt19937_64& engine) const;
+  static double uniform(std::mt19937_64& engine);
+};
+
+// Deterministic pre-processed corpus in the format of 1_preprocess : sentences of
+// MIN_WORDS_SENTENCE to MAX_WORDS_SENTENCE words joined by VISIBLE_SPACE.
+// Words are drawn by Zipf's law from a vocabulary of `size_vocabulary` words of 1 to
+// `max_length_word` characters, whose characters are themselves drawn by Zipf's law
+// from an alphabet of `size_alphabet` CJK (then Hangul and CJK extension B) characters.
+// Alphabets larger than 65536 characters make a corpus store use 4-byte ids.
+class SyntheticCorpus {
+private:
+  const int64_t length;
+  const int64_t size_alphabet;
+  const int64_t size_vocabulary;
+  const int64_t max_length_word;
+  const double exponent_character;
+  const double exponent_word;
+  const int64_t seed;
+
+  std::vector<wchar_t> alphabet;
+  std::vector<std::wstring> vocabulary;
+
+public:
+  SyntheticCorpus(const int64_t _length,
+                  const int64_t _size_alphabet,
+                  const int64_t _size_vocabulary,
+                  const int64_t _max_length_word,
+                  const double _exponent_character,
+                  const double _exponent_word,
+                  const int64_t _seed);
+  ~SyntheticCorpus();
+  static int64_t max_size_alphabet();
+  // Writes `length` characters as UTF-8. If `word_boundary` is given, it receives for
+  // every character a noisy probability of being the head of a word, as stage 3 gives.
+  bool generate(const std::string output_path, std::vector<double>* word_boundary) const;
+};
+
+#endif
@@ -0,0 +1,40 @@
+/*
+    Convert a pre-processed UTF-8 corpus into a corpus store
+*/
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "cmdline.h"
+#include "corpus_store.h"
+
+int main(int argc, char* argv[]) {
+
+  // parsing parameters https://github.com/tanakh/cmdline
+  cmdline::parser a;
+  a.add<std::string>("corpus_path", '\0', "corpus path", true);
+  a.add<std::string>("store_path", '\0', "corpus store path", true);
+  a.add<int64_t>("n_core", '\0', "n_core", false, 1);
+  a.parse_check(argc, argv);
+  std::string corpus_path = a.get<std::string>("corpus_path");
+  std::string store_path = a.get<std::string>("store_path");
+  int64_t n_core = a.get<int64_t>("n_core");
+
+  CorpusStore corpus;
+  if (!corpus.load_text(corpus_path, n_core)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  std::cout << "corpus.size()       : " << corpus.size() << std::endl;
+  std::cout << "alphabet size       : " << corpus.size_alphabet() << std::endl;
+  std::cout << "bytes per character : " << corpus.get_width() << std::endl;
+
+  std::cout << "Saving corpus store to " << store_path << std::endl;
+  if (!corpus.save(store_path)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  std::cout << "Done" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,229 @@
+#include "corpus_store.h"
+
+#define SIZE_BMP 0x10000
+#define SIZE_CODE_SPACE 0x200000  // every code point a 4-byte UTF-8 sequence can encode
+
+CorpusStore::CorpusStore()
+  : width(2),
+    length(0),
+    ids16(nullptr),
+    ids32(nullptr),
+    mapped(nullptr),
+    size_mapped(0) {}
+
+CorpusStore::~CorpusStore() {
+  clear();
+}
+
+void CorpusStore::clear()
+{
+  if (mapped != nullptr) munmap(mapped, size_mapped);
+  mapped = nullptr;
+  size_mapped = 0;
+  alphabet.clear();
+  owned_ids16.clear();
+  owned_ids16.shrink_to_fit();
+  owned_ids32.clear();
+  owned_ids32.shrink_to_fit();
+  ids16 = nullptr;
+  ids32 = nullptr;
+  width = 2;
+  length = 0;
+}
+
+bool CorpusStore::is_store(const std::string& path)
+{
+  std::ifstream fin(path, std::ios::binary);
+  if (!fin.is_open()) return false;
+  char magic[sizeof(CORPUS_STORE_MAGIC)];
+  fin.read(magic, sizeof(magic));
+  return fin.gcount() == sizeof(magic)
+      && std::memcmp(magic, CORPUS_STORE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool CorpusStore::load(const std::string& path, const int64_t n_cores)
+{
+  if (is_store(path)) return load_store(path);
+  return load_text(path, n_cores);
+}
+
+bool CorpusStore::load_store(const std::string& path)
+{
+  clear();
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CorpusStoreHeader))) {
+    ::close(fd);
+    return false;
+  }
+  void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) return false;
+  mapped = p;
+  size_mapped = st.st_size;
+
+  // Check file signature and that every section lies within the file
+  const CorpusStoreHeader& h = *static_cast<const CorpusStoreHeader*>(mapped);
+  if (std::memcmp(h.magic, CORPUS_STORE_MAGIC, sizeof(CORPUS_STORE_MAGIC)) != 0
+      || h.version != CORPUS_STORE_VERSION
+      || (h.width != 2 && h.width != 4)
+      || h.length < 0 || h.size_alphabet < 0
+      || h.offset_alphabet + h.size_alphabet * static_cast<int64_t>(sizeof(uint32_t)) > size_mapped
+      || h.offset_ids + h.length * h.width > size_mapped) {
+    clear();
+    return false;
+  }
+
+  const char* base = static_cast<const char*>(mapped);
+  const uint32_t* codes = reinterpret_cast<const uint32_t*>(base + h.offset_alphabet);
+  alphabet.assign(codes, codes + h.size_alphabet);
+  width = h.width;
+  length = h.length;
+  if (width == 2) ids16 = reinterpret_cast<const uint16_t*>(base + h.offset_ids);
+  else ids32 = reinterpret_cast<const uint32_t*>(base + h.offset_ids);
+  return true;
+}
+
+// Splits `data` into `n` ranges whose boundaries never fall inside a UTF-8 sequence
+static std::vector<int64_t> split_utf8(const unsigned char* data, const int64_t size, const int64_t n)
+{
+  std::vector<int64_t> boundaries(n + 1, size);
+  boundaries[0] = 0;
+  for (int64_t k=1; k<n; k++) {
+    int64_t i = std::max(boundaries[k-1], size * k / n);
+    while (i < size && (data[i] & 0xC0) == 0x80) i++;
+    boundaries[k] = i;
+  }
+  return boundaries;
+}
+
+bool CorpusStore::load_text(const std::string& path, const int64_t n_cores)
+{
+  assert(n_cores > 0);
+  clear();
+
+  std::ifstream fin(path, std::ios::binary | std::ios::ate);
+  if (!fin.is_open()) return false;
+  const int64_t size_file = fin.tellg();
+  fin.seekg(0);
+  std::vector<char> buffer(size_file);
+  fin.read(buffer.data(), size_file);
+  fin.close();
+
+  // Decode twice rather than keep 4 bytes per character around : first to count
+  // characters and build the alphabet, then to write ids in place.
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(buffer.data());
+  const int64_t n_jobs = std::max<int64_t>(1, std::min<int64_t>(n_cores, size_file / (1 << 20)));
+  const std::vector<int64_t> boundaries = split_utf8(data, size_file, n_jobs);
+
+  std::vector<std::vector<int64_t>> count_bmp(n_jobs);
+  std::vector<std::unordered_map<uint32_t, int64_t>> count_others(n_jobs);
+  std::vector<int64_t> length_jobs(n_jobs, 0);
+  std::vector<std::thread> vector_threads(n_jobs);
+
+  for (int64_t k=0; k<n_jobs; k++) {
+    vector_threads[k] = std::thread([&, k]() {
+      std::vector<int64_t>& bmp = count_bmp[k];
+      bmp.assign(SIZE_BMP, 0);
+      int64_t n = 0;
+      for (int64_t i=boundaries[k]; i<boundaries[k+1];) {
+        uint32_t code;
+        const int64_t l = next_utf8(data, i, size_file, code);
+        if (l == 0) break;
+        if (l < 0) { i -= l; continue; }
+        if (code < SIZE_BMP) bmp[code]++;
+        else count_others[k][code]++;
+        n++;
+        i += l;
+      }
+      length_jobs[k] = n;
+    });
+  }
+  for (auto& th : vector_threads) th.join();
+
+  // Alphabet sorted by descending frequency, ties broken by code point
+  std::vector<std::pair<uint32_t, int64_t>> frequency;
+  for (uint32_t c=0; c<SIZE_BMP; c++) {
+    int64_t count = 0;
+    for (int64_t k=0; k<n_jobs; k++) count += count_bmp[k][c];
+    if (count) frequency.push_back(std::make_pair(c, count));
+  }
+  std::unordered_map<uint32_t, int64_t> others;
+  for (auto& counter : count_others) for (auto& elem : counter) others[elem.first] += elem.second;
+  frequency.insert(frequency.end(), others.begin(), others.end());
+  std::sort(frequency.begin(), frequency.end(),
+            [](const std::pair<uint32_t, int64_t>& lhs,
+               const std::pair<uint32_t, int64_t>& rhs)
+            { return lhs.second > rhs.second || (lhs.second == rhs.second && lhs.first < rhs.first); });
+  count_bmp.clear();
+  count_others.clear();
+
+  std::vector<uint32_t> id_of_code(SIZE_CODE_SPACE, 0);
+  alphabet.resize(frequency.size());
+  for (int64_t i=0; i<frequency.size(); i++) {
+    alphabet[i] = static_cast<wchar_t>(frequency[i].first);
+    id_of_code[frequency[i].first] = i;
+  }
+
+  std::vector<int64_t> offsets(n_jobs + 1, 0);
+  for (int64_t k=0; k<n_jobs; k++) offsets[k+1] = offsets[k] + length_jobs[k];
+  length = offsets[n_jobs];
+  width = (alphabet.size() <= 0x10000) ? 2 : 4;
+  if (width == 2) owned_ids16.resize(length);
+  else owned_ids32.resize(length);
+
+  for (int64_t k=0; k<n_jobs; k++) {
+    vector_threads[k] = std::thread([&, k]() {
+      int64_t j = offsets[k];
+      for (int64_t i=boundaries[k]; i<boundaries[k+1];) {
+        uint32_t code;
+        const int64_t l = next_utf8(data, i, size_file, code);
+        if (l == 0) break;
+        if (l < 0) { i -= l; continue; }
+        if (width == 2) owned_ids16[j++] = id_of_code[code];
+        else owned_ids32[j++] = id_of_code[code];
+        i += l;
+      }
+    });
+  }
+  for (auto& th : vector_threads) th.join();
+
+  ids16 = owned_ids16.data();
+  ids32 = owned_ids32.data();
+  return true;
+}
+
+bool CorpusStore::save(const std::string& path) const
+{
+  CorpusStoreHeader h;
+  std::memset(&h, 0, sizeof(CorpusStoreHeader));
+  std::memcpy(h.magic, CORPUS_STORE_MAGIC, sizeof(CORPUS_STORE_MAGIC));
+  h.version = CORPUS_STORE_VERSION;
+  h.width = width;
+  h.length = length;
+  h.size_alphabet = alphabet.size();
+  h.offset_alphabet = sizeof(CorpusStoreHeader);
+  const int64_t end_alphabet = h.offset_alphabet + h.size_alphabet * sizeof(uint32_t);
+  h.offset_ids = (end_alphabet + CORPUS_STORE_ALIGNMENT - 1) / CORPUS_STORE_ALIGNMENT * CORPUS_STORE_ALIGNMENT;
+
+  // Write to a temporary file first so that readers never map a partial store
+  const std::string path_tmp = path + ".tmp";
+  std::ofstream fout(path_tmp, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) return false;
+
+  const std::vector<uint32_t> codes(alphabet.begin(), alphabet.end());
+  const std::vector<char> padding(h.offset_ids - end_alphabet, 0);
+  fout.write(reinterpret_cast<const char*>(&h), sizeof(CorpusStoreHeader));
+  fout.write(reinterpret_cast<const char*>(codes.data()), codes.size() * sizeof(uint32_t));
+  fout.write(padding.data(), padding.size());
+  const char* ids = (width == 2) ? reinterpret_cast<const char*>(ids16) : reinterpret_cast<const char*>(ids32);
+  if (length > 0) fout.write(ids, length * width);
+  fout.close();
+  if (!fout) {
+    std::remove(path_tmp.c_str());
+    return false;
+  }
+  return std::rename(path_tmp.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,112 @@
+#ifndef CORPUS_STORE_H
+#define CORPUS_STORE_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utf8.h"
+
+#define CORPUS_STORE_MAGIC "WNECORP"
+#define CORPUS_STORE_VERSION 1
+#define CORPUS_STORE_ALIGNMENT 4096
+
+// Layout of a corpus store file:
+//   header | alphabet (size_alphabet code points as uint32_t) | (padding) | ids
+// Characters are remapped to ids by descending frequency, and ids are stored with
+// 2 bytes each when the alphabet has at most 65536 characters (4 bytes otherwise).
+// The ids start on a page boundary so that the file is used in place through mmap.
+struct CorpusStoreHeader {
+  char magic[8];
+  int64_t version;
+  int64_t width;
+  int64_t length;
+  int64_t size_alphabet;
+  int64_t offset_alphabet;
+  int64_t offset_ids;
+  int64_t reserved;
+};
+
+// Read-only corpus as a sequence of alphabet ids.
+// It is memory-mapped from a corpus store file, or built in memory from a UTF-8 text
+// file, and takes 2 (or 4) bytes per character instead of 4 bytes of std::wstring
+// plus the copies made while decoding through a wifstream.
+class CorpusStore {
+private:
+  std::vector<wchar_t> alphabet;
+  int64_t width;
+  int64_t length;
+  const uint16_t* ids16;
+  const uint32_t* ids32;
+  std::vector<uint16_t> owned_ids16;
+  std::vector<uint32_t> owned_ids32;
+  void* mapped;
+  int64_t size_mapped;
+
+public:
+  CorpusStore();
+  ~CorpusStore();
+  bool load(const std::string& path, const int64_t n_cores);
+  bool load_store(const std::string& path);
+  bool load_text(const std::string& path, const int64_t n_cores);
+  bool save(const std::string& path) const;
+  static bool is_store(const std::string& path);
+
+  int64_t size() const { return length; }
+  int64_t get_width() const { return width; }
+  int64_t size_alphabet() const { return alphabet.size(); }
+
+  inline uint32_t id(const int64_t i) const {
+    return (width == 2) ? ids16[i] : ids32[i];
+  }
+
+  inline wchar_t operator[](const int64_t i) const {
+    return alphabet[id(i)];
+  }
+
+  // Writes the `n` characters from `pos` into `out`, reusing its storage
+  inline void substr(const int64_t pos, const int64_t n, std::wstring& out) const {
+    out.resize(n);
+    if (width == 2) {
+      for (int64_t i=0; i<n; i++) out[i] = alphabet[ids16[pos + i]];
+    } else {
+      for (int64_t i=0; i<n; i++) out[i] = alphabet[ids32[pos + i]];
+    }
+  }
+
+  std::wstring substr(const int64_t pos, const int64_t n) const {
+    std::wstring out;
+    substr(pos, n, out);
+    return out;
+  }
+
+private:
+  CorpusStore(const CorpusStore&);
+  CorpusStore& operator=(const CorpusStore&);
+  void clear();
+};
+
+// Copies `n` characters from `pos` of an in-memory text or of a corpus store into `out`,
+// so that code can be written once for both
+inline void copy_substr(const std::wstring& text, const int64_t pos, const int64_t n, std::wstring& out) {
+  out.assign(text, pos, n);
+}
+
+inline void copy_substr(const CorpusStore& text, const int64_t pos, const int64_t n, std::wstring& out) {
+  text.substr(pos, n, out);
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef COUNTING_PROFILE_H
+#define COUNTING_PROFILE_H
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "resource_usage.h"
+#include "parallel_writer.h"
+
+// What the counting of one n-gram (or word) length did, on the thread counting it
+struct CountingSizeStats {
+  int64_t size;
+  int64_t n_positions;     // positions scanned
+  double seconds_count;    // scan of the corpus, prune passes included
+  double seconds_prune;
+  double seconds_sort;     // sort of the counted entries by count
+  double seconds_merge;    // selection and insertion into the shared results, lock included
+  int64_t n_prunes;        // bucket prune passes
+  int64_t n_evicted;       // entries removed by them
+  int64_t max_entries;     // largest table size, just before a prune or at the end
+  int64_t n_entries;       // table size at the end
+  int64_t n_buckets;       // hash table buckets at the end
+  double load_factor;
+  int64_t bytes_tables;    // estimated memory of the tables at their largest
+  int64_t n_kept;          // entries passed on to the results
+};
+
+// Estimated bytes of an unordered_map<std::wstring, Value> : bucket array, then per entry
+// the node (next pointer, cached hash, key and value) and the characters of keys too long
+// for the small string buffer
+template <class Value>
+inline int64_t estimate_table_bytes(const int64_t n_entries, const int64_t n_buckets, const int64_t length_key)
+{
+  const int64_t length_small = (sizeof(std::wstring) - sizeof(size_t) - sizeof(void*)) / sizeof(wchar_t) - 1;
+  const int64_t bytes_key = (length_key > length_small) ? (length_key + 1) * sizeof(wchar_t) : 0;
+  const int64_t bytes_node = 2 * sizeof(void*) + sizeof(std::wstring) + sizeof(Value) + bytes_key;
+  return n_buckets * sizeof(void*) + n_entries * bytes_node;
+}
+
+// Switchable instrumentation of a counting stage : wall time and peak RSS of each phase
+// and the CountingSizeStats of each length. Disabled, no phase is recorded and the
+// counters keep no statistics; they read the clock per prune pass and per length at
+// most, never per position.
+class CountingProfile {
+private:
+  bool is_profiled;
+  std::vector<StageUsage> phases;
+  std::vector<CountingSizeStats> sizes;
+  std::mutex mtx;
+
+public:
+  CountingProfile() : is_profiled(false) {}
+
+  void set_enabled(const bool _is_profiled) { is_profiled = _is_profiled; }
+  bool is_enabled() const { return is_profiled; }
+
+  void start_phase(const std::string name)
+  {
+    if (!is_profiled) return;
+    phases.push_back(StageUsage(name));
+    phases.back().start();
+  }
+
+  void stop_phase()
+  {
+    if (!is_profiled) return;
+    phases.back().stop();
+  }
+
+  // A phase timed by the caller, such as loading the corpus before the counter exists
+  void add_phase(const StageUsage& phase)
+  {
+    if (is_profiled) phases.push_back(phase);
+  }
+
+  // Called by the counting threads
+  void add_size(const CountingSizeStats& stats)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    sizes.push_back(stats);
+  }
+
+  void print(const std::string stage)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::sort(sizes.begin(), sizes.end(), [](const CountingSizeStats& lhs, const CountingSizeStats& rhs) {
+      return lhs.size < rhs.size;
+    });
+
+    std::cout << std::endl << "###### Profile : " << stage << " ######" << std::endl;
+    std::cout << std::left << std::setw(16) << "phase" << std::right << std::setw(12) << "seconds"
+              << std::setw(16) << "peak RSS (MB)" << std::endl;
+    for (const StageUsage& phase : phases) {
+      std::cout << std::left << std::setw(16) << phase.name << std::right << std::fixed
+                << std::setprecision(3) << std::setw(12) << phase.seconds
+                << std::setprecision(1) << std::setw(15) << phase.peak_bytes / 1e6
+                << (phase.is_peak_of_stage ? " " : "*") << std::endl;
+    }
+
+    std::cout << std::right << std::setw(5) << "size" << std::setw(11) << "count (s)" << std::setw(11) << "prune (s)"
+              << std::setw(10) << "sort (s)" << std::setw(11) << "merge (s)" << std::setw(8) << "prunes"
+              << std::setw(12) << "evicted" << std::setw(12) << "max entries" << std::setw(12) << "entries"
+              << std::setw(12) << "buckets" << std::setw(6) << "load" << std::setw(12) << "table (MB)"
+              << std::setw(12) << "kept" << std::endl;
+    for (const CountingSizeStats& s : sizes) {
+      std::cout << std::setw(5) << s.size << std::fixed << std::setprecision(3)
+                << std::setw(11) << s.seconds_count << std::setw(11) << s.seconds_prune
+                << std::setw(10) << s.seconds_sort << std::setw(11) << s.seconds_merge
+                << std::setw(8) << s.n_prunes << std::setw(12) << s.n_evicted
+                << std::setw(12) << s.max_entries << std::setw(12) << s.n_entries << std::setw(12) << s.n_buckets
+                << std::setprecision(2) << std::setw(6) << s.load_factor
+                << std::setprecision(1) << std::setw(12) << s.bytes_tables / 1e6
+                << std::setw(12) << s.n_kept << std::endl;
+    }
+    std::cout << "Peak RSS : " << std::setprecision(1) << peak_rss() / 1e6 << " MB";
+    for (const StageUsage& phase : phases) {
+      if (!phase.is_peak_of_stage) {
+        std::cout << " (* peak of the process, the peak of a phase could not be reset)";
+        break;
+      }
+    }
+    std::cout << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+  }
+
+  bool save_json(const std::string path, const std::string stage)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+    if (!fout.is_open()) return false;
+
+    std::string json = "{\"stage\": \"" + stage + "\", \"phases\": [";
+    for (int64_t i=0; i<phases.size(); i++) {
+      if (i) json += ", ";
+      json += "{\"name\": \"" + phases[i].name + "\", \"seconds\": ";
+      append_double(phases[i].seconds, json);
+      json += ", \"peak_rss_bytes\": ";
+      append_int64(phases[i].peak_bytes, json);
+      json += ", \"is_peak_of_stage\": ";
+      json += phases[i].is_peak_of_stage ? "true" : "false";
+      json += "}";
+    }
+    json += "], \"sizes\": [";
+    for (int64_t i=0; i<sizes.size(); i++) {
+      const CountingSizeStats& s = sizes[i];
+      if (i) json += ", ";
+      json += "{\"size\": ";
+      append_int64(s.size, json);
+      json += ", \"positions\": ";
+      append_int64(s.n_positions, json);
+      json += ", \"count_seconds\": ";
+      append_double(s.seconds_count, json);
+      json += ", \"prune_seconds\": ";
+      append_double(s.seconds_prune, json);
+      json += ", \"sort_seconds\": ";
+      append_double(s.seconds_sort, json);
+      json += ", \"merge_seconds\": ";
+      append_double(s.seconds_merge, json);
+      json += ", \"prunes\": ";
+      append_int64(s.n_prunes, json);
+      json += ", \"evicted\": ";
+      append_int64(s.n_evicted, json);
+      json += ", \"max_entries\": ";
+      append_int64(s.max_entries, json);
+      json += ", \"entries\": ";
+      append_int64(s.n_entries, json);
+      json += ", \"buckets\": ";
+      append_int64(s.n_buckets, json);
+      json += ", \"load_factor\": ";
+      append_double(s.load_factor, json);
+      json += ", \"table_bytes\": ";
+      append_int64(s.bytes_tables, json);
+      json += ", \"kept\": ";
+      append_int64(s.n_kept, json);
+      json += "}";
+    }
+    json += "], \"peak_rss_bytes\": ";
+    append_int64(peak_rss(), json);
+    json += "}\n";
+    fout.write(json.data(), json.size());
+    fout.close();
+    return !fout.fail();
+  }
+
+  // Seconds since `t_start`, for the counters
+  static double seconds_since(const std::chrono::steady_clock::time_point t_start)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+  }
+
+private:
+  CountingProfile(const CountingProfile&);
+  CountingProfile& operator=(const CountingProfile&);
+};
+
+#endif
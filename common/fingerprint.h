@@ -0,0 +1,172 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <locale>
+#include <vector>
+#include <thread>
+#include <utility>
+#include <algorithm>
+
+#include "mapped_file.h"
+
+#define SIZE_HASH_BLOCK (1 << 22)
+
+// 64-bit non-cryptographic hash of a byte range, 8 bytes at a time
+inline uint64_t hash_bytes(const char* data, const int64_t size, uint64_t seed)
+{
+  const uint64_t m1 = 0x9E3779B97F4A7C15ULL;
+  const uint64_t m2 = 0xC2B2AE3D27D4EB4FULL;
+  uint64_t h = seed ^ (static_cast<uint64_t>(size) * m1);
+  int64_t i = 0;
+  for (; i+8<=size; i+=8) {
+    uint64_t w;
+    std::memcpy(&w, data + i, 8);
+    w *= m2;
+    w = (w << 31) | (w >> 33);
+    h ^= w * m1;
+    h = ((h << 27) | (h >> 37)) * 5 + 0x52DCE729;
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, data + i, size - i);
+  h ^= tail * m2;
+  // splitmix64 finalizer
+  h ^= h >> 30; h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 27; h *= 0x94D049BB133111EBULL;
+  h ^= h >> 31;
+  return h;
+}
+
+// Hash of a whole file. Blocks of SIZE_HASH_BLOCK bytes are hashed in parallel and then
+// combined in order, so the result does not depend on n_cores.
+inline bool hash_file(const std::string path, const int64_t n_cores, uint64_t& hash)
+{
+  MappedFile file;
+  if (!file.open(path)) return false;
+  const int64_t size = file.size();
+  const int64_t n_blocks = (size + SIZE_HASH_BLOCK - 1) / SIZE_HASH_BLOCK;
+  std::vector<uint64_t> hashes_block(n_blocks);
+
+  const int64_t n_jobs = std::max<int64_t>(1, std::min<int64_t>(n_cores, n_blocks));
+  std::vector<std::thread> vector_threads(n_jobs);
+  for (int64_t k=0; k<n_jobs; k++) {
+    vector_threads[k] = std::thread([&, k]() {
+      for (int64_t b=k; b<n_blocks; b+=n_jobs) {
+        const int64_t offset = b * SIZE_HASH_BLOCK;
+        hashes_block[b] = hash_bytes(file.data() + offset, std::min<int64_t>(SIZE_HASH_BLOCK, size - offset), b);
+      }
+    });
+  }
+  for (auto& th : vector_threads) th.join();
+
+  hash = hash_bytes(reinterpret_cast<const char*>(hashes_block.data()), n_blocks * sizeof(uint64_t), size);
+  return true;
+}
+
+// Inputs and parameters of a stage, saved as "key<TAB>value" lines next to its output
+// together with the hashes of the output files. A rerun with the same fingerprint can
+// reuse the outputs as long as they have not been modified since.
+class Fingerprint {
+private:
+  std::vector<std::pair<std::string, std::string>> entries;
+
+public:
+  explicit Fingerprint(const std::string stage) { add("stage", stage); }
+
+  void add(const std::string key, const std::string value)
+  {
+    entries.push_back(std::make_pair(key, value));
+  }
+
+  void add(const std::string key, const int64_t value)
+  {
+    add(key, format(value));
+  }
+
+  void add(const std::string key, const double value)
+  {
+    add(key, format(value));
+  }
+
+  bool add_file(const std::string key, const std::string path, const int64_t n_cores)
+  {
+    uint64_t hash;
+    if (!hash_file(path, n_cores, hash)) return false;
+    std::ostringstream oss;
+    oss.imbue(std::locale::classic());
+    oss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    add(key, oss.str());
+    return true;
+  }
+
+  bool operator==(const Fingerprint& other) const { return entries == other.entries; }
+  bool operator!=(const Fingerprint& other) const { return entries != other.entries; }
+
+  static std::string path_of(const std::string output_path) { return output_path + ".fingerprint"; }
+
+  // True if the fingerprint saved for `outputs` (name, path) is this one and the
+  // outputs still have the hashes recorded at that time
+  bool is_cached(const std::vector<std::pair<std::string, std::string>>& outputs, const int64_t n_cores) const
+  {
+    Fingerprint saved("");
+    if (!saved.load(path_of(outputs[0].second))) return false;
+    Fingerprint expected(*this);
+    for (const auto& output : outputs) {
+      if (!expected.add_file("output_" + output.first, output.second, n_cores)) return false;
+    }
+    return saved == expected;
+  }
+
+  // Forgets the fingerprint of `output_path` before it is overwritten
+  static void invalidate(const std::string output_path) { std::remove(path_of(output_path).c_str()); }
+
+  bool save(const std::vector<std::pair<std::string, std::string>>& outputs, const int64_t n_cores) const
+  {
+    Fingerprint result(*this);
+    for (const auto& output : outputs) {
+      if (!result.add_file("output_" + output.first, output.second, n_cores)) return false;
+    }
+    const std::string path = path_of(outputs[0].second);
+    const std::string path_tmp = path + ".tmp";
+    std::ofstream fout(path_tmp);
+    if (!fout.is_open()) return false;
+    fout.imbue(std::locale::classic());
+    for (const auto& entry : result.entries) fout << entry.first << '\t' << entry.second << '\n';
+    fout.close();
+    if (fout.fail()) return false;
+    return std::rename(path_tmp.c_str(), path.c_str()) == 0;
+  }
+
+private:
+  bool load(const std::string path)
+  {
+    std::ifstream fin(path);
+    if (!fin.is_open()) return false;
+    entries.clear();
+    std::string line;
+    while (std::getline(fin, line)) {
+      const size_t tab = line.find('\t');
+      if (tab == std::string::npos) return false;
+      add(line.substr(0, tab), line.substr(tab + 1));
+    }
+    return true;
+  }
+
+  // Written without the thousands separators of the global locale
+  template <class T>
+  static std::string format(const T value)
+  {
+    std::ostringstream oss;
+    oss.imbue(std::locale::classic());
+    oss << std::setprecision(17) << value;
+    return oss.str();
+  }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+// An empty file is opened successfully with data() == nullptr.
+class MappedFile {
+private:
+  void* mapped;
+  int64_t size_mapped;
+
+public:
+  MappedFile() : mapped(nullptr), size_mapped(0) {}
+  ~MappedFile() { close(); }
+
+  bool open(const std::string& path)
+  {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    if (st.st_size > 0) {
+      void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        return false;
+      }
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      mapped = p;
+      size_mapped = st.st_size;
+    }
+    ::close(fd);
+    return true;
+  }
+
+  void close()
+  {
+    if (mapped != nullptr) munmap(mapped, size_mapped);
+    mapped = nullptr;
+    size_mapped = 0;
+  }
+
+  const char* data() const { return static_cast<const char*>(mapped); }
+  int64_t size() const { return size_mapped; }
+
+private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef PARALLEL_RANGES_H
+#define PARALLEL_RANGES_H
+
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Runs body(begin, end) on up to n_threads contiguous ranges of [0, n), each of at least
+// `min_size_range` items unless there is a single range
+template <class Body>
+inline void run_ranges(const int64_t n, const int64_t n_threads, Body body, const int64_t min_size_range = 1)
+{
+  const int64_t n_jobs = std::max<int64_t>(1, std::min<int64_t>(n_threads, n / min_size_range));
+  std::vector<std::thread> vector_threads(n_jobs);
+  for (int64_t k=0; k<n_jobs; k++) {
+    vector_threads[k] = std::thread(body, n * k / n_jobs, n * (k + 1) / n_jobs);
+  }
+  for (auto& t : vector_threads) t.join();
+}
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef PARALLEL_WRITER_H
+#define PARALLEL_WRITER_H
+
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <thread>
+
+#include "utf8.h"
+
+#define SIZE_BATCH_PARALLEL_WRITER 65536
+
+// Appends `x` in decimal without thousands separators
+inline void append_int64(const int64_t x, std::string& out)
+{
+  char buffer[24];
+  char* p = buffer + sizeof(buffer);
+  uint64_t u = (x < 0) ? 0 - static_cast<uint64_t>(x) : static_cast<uint64_t>(x);
+  do {
+    *--p = static_cast<char>('0' + u % 10);
+    u /= 10;
+  } while (u);
+  if (x < 0) *--p = '-';
+  out.append(p, buffer + sizeof(buffer) - p);
+}
+
+// Returns x * 10^shift rounded half to even. For |shift| <= 22 the power of 10 is exact
+// and the rounding error of the product is recovered with fma, so ties are decided on
+// the exact value as printf does.
+inline uint64_t round_scaled(const double x, const int shift)
+{
+  double scaled, residual = 0;
+  if (shift >= 0 && shift <= 22) {
+    const double p = std::pow(10.0, shift);
+    scaled = x * p;
+    residual = std::fma(x, p, -scaled);
+  } else if (shift < 0 && shift >= -22) {
+    const double p = std::pow(10.0, -shift);
+    scaled = x / p;
+    residual = -std::fma(scaled, p, -x) / p;
+  } else if (shift > 300) {
+    scaled = x * 1e300 * std::pow(10.0, shift - 300);
+  } else {
+    scaled = x * std::pow(10.0, shift);
+  }
+
+  const double floor_scaled = std::floor(scaled);
+  uint64_t rounded = static_cast<uint64_t>(floor_scaled);
+  double fraction = (scaled - floor_scaled) + residual;
+  if (fraction < 0) {
+    rounded--;
+    fraction += 1;
+  } else if (fraction >= 1) {
+    rounded++;
+    fraction -= 1;
+  }
+  if (fraction > 0.5 || (fraction == 0.5 && rounded % 2 == 1)) rounded++;
+  return rounded;
+}
+
+// Appends `x` formatted like printf("%g") (6 significant digits, which is also what
+// an unadorned std::ostream prints) independently of the global locale
+inline void append_double(double x, std::string& out)
+{
+  if (std::isnan(x)) {
+    out += "nan";
+    return;
+  }
+  if (std::signbit(x)) {
+    out += '-';
+    x = -x;
+  }
+  if (std::isinf(x)) {
+    out += "inf";
+    return;
+  }
+  if (x == 0) {
+    out += '0';
+    return;
+  }
+
+  // Round to 6 significant digits : x ~= mantissa * 10^(exponent-5), 10^5 <= mantissa < 10^6
+  int exponent = static_cast<int>(std::floor(std::log10(x)));
+  uint64_t mantissa = round_scaled(x, 5 - exponent);
+  if (mantissa < 100000) { // log10 rounded up
+    exponent--;
+    mantissa = round_scaled(x, 5 - exponent);
+  }
+  if (mantissa >= 1000000) { // rounded up to the next power of 10
+    exponent++;
+    mantissa = round_scaled(x, 5 - exponent);
+  }
+
+  char digits[6];
+  for (int i=5; i>=0; i--) {
+    digits[i] = static_cast<char>('0' + mantissa % 10);
+    mantissa /= 10;
+  }
+  int n_digits = 6;
+  while (n_digits > 1 && digits[n_digits - 1] == '0') n_digits--;
+
+  if (exponent < -4 || exponent >= 6) {
+    out += digits[0];
+    if (n_digits > 1) {
+      out += '.';
+      out.append(digits + 1, n_digits - 1);
+    }
+    out += (exponent < 0) ? "e-" : "e+";
+    const int e = std::abs(exponent);
+    if (e < 10) out += '0';
+    append_int64(e, out);
+  } else if (exponent >= 0) {
+    out.append(digits, std::min(n_digits, exponent + 1));
+    out.append(std::max(0, exponent + 1 - n_digits), '0');
+    if (n_digits > exponent + 1) {
+      out += '.';
+      out.append(digits + exponent + 1, n_digits - exponent - 1);
+    }
+  } else {
+    out += "0.";
+    out.append(-exponent - 1, '0');
+    out.append(digits, n_digits);
+  }
+}
+
+inline void append_number(const int64_t x, std::string& out) { append_int64(x, out); }
+inline void append_number(const double x, std::string& out) { append_double(x, out); }
+
+// Appends the header of a NumPy .npy (version 1.0) file holding a C-ordered float32
+// matrix, padded so that the data starts on a 64-byte boundary
+inline void append_npy_header(const int64_t n_rows, const int64_t dim, std::string& out)
+{
+  std::string dict = "{'descr': '<f4', 'fortran_order': False, 'shape': (";
+  append_int64(n_rows, dict);
+  dict += ", ";
+  append_int64(dim, dict);
+  dict += "), }";
+  const int64_t length_preamble = 10;
+  const int64_t length_header = (length_preamble + dict.size() + 1 + 63) / 64 * 64 - length_preamble;
+  dict.append(length_header - dict.size() - 1, ' ');
+  dict += '\n';
+  out.append("\x93NUMPY\x01\x00", 8);
+  out += static_cast<char>(length_header & 0xFF);
+  out += static_cast<char>(length_header >> 8);
+  out += dict;
+}
+
+// Writes `n_rows` rows to `fout` in order. Rows are formatted by `format_row(i_row, buffer)`
+// in batches, each batch split among `n_threads` threads with their own buffers,
+// and every buffer is written with a single call.
+template <class FormatRow>
+void write_rows_parallel(std::ofstream& fout,
+                         const int64_t n_rows,
+                         const int64_t n_threads,
+                         const FormatRow& format_row)
+{
+  const int64_t n_workers = std::max<int64_t>(1, n_threads);
+  std::vector<std::string> buffers(n_workers);
+  std::vector<std::thread> vector_threads(n_workers);
+
+  for (int64_t i_batch=0; i_batch<n_rows; i_batch+=SIZE_BATCH_PARALLEL_WRITER) {
+    const int64_t n_rows_batch = std::min<int64_t>(SIZE_BATCH_PARALLEL_WRITER, n_rows - i_batch);
+    const int64_t n_rows_worker = (n_rows_batch + n_workers - 1) / n_workers;
+
+    for (int64_t id_thread=0; id_thread<n_workers; id_thread++) {
+      vector_threads.at(id_thread) = std::thread([&, id_thread]() {
+        std::string& buffer = buffers[id_thread];
+        buffer.clear();
+        const int64_t i_begin = i_batch + std::min(n_rows_batch, id_thread * n_rows_worker);
+        const int64_t i_end = i_batch + std::min(n_rows_batch, (id_thread + 1) * n_rows_worker);
+        for (int64_t i=i_begin; i<i_end; i++) format_row(i, buffer);
+      });
+    }
+    for (int64_t id_thread=0; id_thread<n_workers; id_thread++) {
+      vector_threads.at(id_thread).join();
+      fout.write(buffers[id_thread].data(), buffers[id_thread].size());
+    }
+  }
+}
+
+// Writes "word\tnumber\n" rows in UTF-8, the format of the n-gram and word counts
+// of stages 2 and 4. Numbers are written without thousands separators whatever the
+// global locale.
+template <class Number>
+bool write_tsv_parallel(const std::string path,
+                        const std::vector<std::pair<std::wstring, Number>>& rows,
+                        const int64_t n_threads)
+{
+  std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) return false;
+  write_rows_parallel(fout, rows.size(), n_threads, [&rows](const int64_t i, std::string& buffer) {
+    append_utf8(rows[i].first, buffer);
+    buffer += '\t';
+    append_number(rows[i].second, buffer);
+    buffer += '\n';
+  });
+  fout.close();
+  return !fout.fail();
+}
+
+#endif
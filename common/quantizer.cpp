@@ -0,0 +1,367 @@
+#include "quantizer.h"
+
+static float squared_distance(const float* a, const float* b, const int64_t n)
+{
+  float sum = 0;
+  for (int64_t i=0; i<n; i++) sum += (a[i] - b[i]) * (a[i] - b[i]);
+  return sum;
+}
+
+QuantizedMatrix::QuantizedMatrix()
+  : type(0), n_rows(0), dim(0), n_subspaces(0), size_codebook(0),
+    scales(nullptr), codes_int8(nullptr), centroids(nullptr), codes_pq(nullptr)
+{
+}
+
+QuantizedMatrix::~QuantizedMatrix() {}
+
+void QuantizedMatrix::quantize_int8(const double* matrix, const int64_t _n_rows, const int64_t _dim, const int64_t n_cores)
+{
+  assert(_dim > 0);
+  type = QUANTIZED_INT8;
+  n_rows = _n_rows;
+  dim = _dim;
+  n_subspaces = 0;
+  size_codebook = 0;
+  scales_owned.resize(n_rows);
+  codes_int8_owned.resize(n_rows * dim);
+
+  run_ranges(n_rows, n_cores, [&](const int64_t begin, const int64_t end) {
+    for (int64_t i=begin; i<end; i++) {
+      const double* x = matrix + i * dim;
+      double max_abs = 0;
+      for (int64_t j=0; j<dim; j++) max_abs = std::max(max_abs, std::fabs(x[j]));
+      const double scale = max_abs / 127;
+      scales_owned[i] = scale;
+      for (int64_t j=0; j<dim; j++) {
+        codes_int8_owned[i*dim + j] = (scale > 0) ? static_cast<int8_t>(std::lround(x[j] / scale)) : 0;
+      }
+    }
+  });
+
+  file.close();
+  scales = scales_owned.data();
+  codes_int8 = codes_int8_owned.data();
+  compute_inverse_norms(n_cores);
+}
+
+void QuantizedMatrix::quantize_pq(const double* matrix,
+                                  const int64_t _n_rows,
+                                  const int64_t _dim,
+                                  const int64_t _n_subspaces,
+                                  const int64_t n_iteration,
+                                  const int64_t seed,
+                                  const int64_t n_cores)
+{
+  assert(_n_rows > 0);
+  assert(_n_subspaces > 0 && _n_subspaces <= _dim);
+  assert(n_iteration >= 0);
+  type = QUANTIZED_PQ;
+  n_rows = _n_rows;
+  dim = _dim;
+  n_subspaces = _n_subspaces;
+  size_codebook = std::min<int64_t>(SIZE_PQ_CODEBOOK, n_rows);
+
+  // Training rows, in random order so that the first size_codebook seed the centroids
+  std::vector<int64_t> ids(n_rows);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::mt19937_64 engine(seed);
+  std::shuffle(ids.begin(), ids.end(), engine);
+  const int64_t n_train = std::min<int64_t>(SIZE_PQ_TRAIN, n_rows);
+  std::vector<float> train(n_train * dim);
+  for (int64_t t=0; t<n_train; t++) {
+    for (int64_t j=0; j<dim; j++) train[t*dim + j] = matrix[ids[t]*dim + j];
+  }
+
+  // k-means, one subspace at a time on each thread
+  centroids_owned.assign(size_codebook * dim, 0);
+  std::atomic<int64_t> m_next(0);
+  std::vector<std::thread> vector_threads(std::min(n_cores, n_subspaces));
+  for (auto& thread : vector_threads) {
+    thread = std::thread([&]() {
+      for (int64_t m=m_next++; m<n_subspaces; m=m_next++) {
+        const int64_t begin = begin_subspace(m);
+        const int64_t dim_sub = begin_subspace(m + 1) - begin;
+        float* c = centroids_owned.data() + size_codebook * begin;
+        std::vector<float> x(n_train * dim_sub);
+        for (int64_t t=0; t<n_train; t++) {
+          std::copy(&train[t*dim + begin], &train[t*dim + begin + dim_sub], &x[t*dim_sub]);
+        }
+        std::copy(x.begin(), x.begin() + size_codebook * dim_sub, c);
+
+        std::mt19937_64 engine_sub(seed + m);
+        std::vector<float> sums(size_codebook * dim_sub);
+        std::vector<int64_t> counts(size_codebook);
+        for (int64_t iteration=0; iteration<n_iteration; iteration++) {
+          std::fill(sums.begin(), sums.end(), 0);
+          std::fill(counts.begin(), counts.end(), 0);
+          for (int64_t t=0; t<n_train; t++) {
+            int64_t best = 0;
+            float distance_best = INFINITY;
+            for (int64_t k=0; k<size_codebook; k++) {
+              const float distance = squared_distance(&x[t*dim_sub], c + k*dim_sub, dim_sub);
+              if (distance < distance_best) {
+                distance_best = distance;
+                best = k;
+              }
+            }
+            counts[best]++;
+            for (int64_t j=0; j<dim_sub; j++) sums[best*dim_sub + j] += x[t*dim_sub + j];
+          }
+          // An empty cluster restarts from a random training subvector
+          for (int64_t k=0; k<size_codebook; k++) {
+            if (counts[k] > 0) {
+              for (int64_t j=0; j<dim_sub; j++) c[k*dim_sub + j] = sums[k*dim_sub + j] / counts[k];
+            } else {
+              const int64_t t = engine_sub() % n_train;
+              std::copy(&x[t*dim_sub], &x[t*dim_sub] + dim_sub, c + k*dim_sub);
+            }
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread : vector_threads) thread.join();
+  centroids = centroids_owned.data();
+
+  // Encode every row
+  codes_pq_owned.resize(n_rows * n_subspaces);
+  run_ranges(n_rows, n_cores, [&](const int64_t begin_row, const int64_t end_row) {
+    std::vector<float> row(dim);
+    for (int64_t i=begin_row; i<end_row; i++) {
+      for (int64_t j=0; j<dim; j++) row[j] = matrix[i*dim + j];
+      for (int64_t m=0; m<n_subspaces; m++) {
+        const int64_t begin = begin_subspace(m);
+        const int64_t dim_sub = begin_subspace(m + 1) - begin;
+        const float* c = centroids + size_codebook * begin;
+        int64_t best = 0;
+        float distance_best = INFINITY;
+        for (int64_t k=0; k<size_codebook; k++) {
+          const float distance = squared_distance(row.data() + begin, c + k*dim_sub, dim_sub);
+          if (distance < distance_best) {
+            distance_best = distance;
+            best = k;
+          }
+        }
+        codes_pq_owned[i*n_subspaces + m] = best;
+      }
+    }
+  });
+
+  file.close();
+  codes_pq = codes_pq_owned.data();
+  compute_inverse_norms(n_cores);
+}
+
+void QuantizedMatrix::compute_inverse_norms(const int64_t n_cores)
+{
+  inverse_norms.resize(n_rows);
+  run_ranges(n_rows, n_cores, [this](const int64_t begin, const int64_t end) {
+    std::vector<float> row(dim);
+    for (int64_t i=begin; i<end; i++) {
+      double sum = 0;
+      if (type == QUANTIZED_INT8) {
+        // The scale cancels out of the cosine, so only the codes are normalized
+        for (int64_t j=0; j<dim; j++) sum += codes_int8[i*dim + j] * codes_int8[i*dim + j];
+      } else {
+        decode(i, row.data());
+        for (int64_t j=0; j<dim; j++) sum += row[j] * row[j];
+      }
+      inverse_norms[i] = (sum > 0) ? 1 / std::sqrt(sum) : 0;
+    }
+  });
+}
+
+void QuantizedMatrix::decode(const int64_t id, float* out) const
+{
+  if (type == QUANTIZED_INT8) {
+    for (int64_t j=0; j<dim; j++) out[j] = codes_int8[id*dim + j] * scales[id];
+    return;
+  }
+  for (int64_t m=0; m<n_subspaces; m++) {
+    const int64_t begin = begin_subspace(m);
+    const int64_t dim_sub = begin_subspace(m + 1) - begin;
+    const float* c = centroids + size_codebook * begin + codes_pq[id*n_subspaces + m] * dim_sub;
+    std::copy(c, c + dim_sub, out + begin);
+  }
+}
+
+void QuantizedMatrix::prepare(const float* query, std::vector<float>& prepared) const
+{
+  if (type == QUANTIZED_INT8) {
+    prepared.assign(query, query + dim);
+    return;
+  }
+  prepared.resize(n_subspaces * size_codebook);
+  for (int64_t m=0; m<n_subspaces; m++) {
+    const int64_t begin = begin_subspace(m);
+    const int64_t dim_sub = begin_subspace(m + 1) - begin;
+    const float* c = centroids + size_codebook * begin;
+    for (int64_t k=0; k<size_codebook; k++) {
+      float sum = 0;
+      for (int64_t j=0; j<dim_sub; j++) sum += query[begin + j] * c[k*dim_sub + j];
+      prepared[m*size_codebook + k] = sum;
+    }
+  }
+}
+
+bool QuantizedMatrix::save(const std::string path, const std::vector<std::string>& words) const
+{
+  assert(words.size() == n_rows);
+  std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) return false;
+  const int64_t header[] = {type, n_rows, dim, n_subspaces, size_codebook};
+  fout.write(QUANTIZED_MAGIC, 8);
+  fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+  if (type == QUANTIZED_INT8) {
+    fout.write(reinterpret_cast<const char*>(scales), n_rows * sizeof(float));
+    fout.write(reinterpret_cast<const char*>(codes_int8), n_rows * dim);
+  } else {
+    fout.write(reinterpret_cast<const char*>(centroids), size_codebook * dim * sizeof(float));
+    fout.write(reinterpret_cast<const char*>(codes_pq), n_rows * n_subspaces);
+  }
+  std::string buffer;
+  for (const std::string& word : words) {
+    buffer += word;
+    buffer += '\n';
+  }
+  fout.write(buffer.data(), buffer.size());
+  fout.close();
+  return !fout.fail();
+}
+
+bool QuantizedMatrix::load(const std::string path, const int64_t n_cores, std::vector<std::string>& words)
+{
+  if (!file.open(path)) return false;
+  const char* p = file.data();
+  const char* end = p + file.size();
+  int64_t header[5];
+  if (file.size() < 8 + static_cast<int64_t>(sizeof(header)) || std::memcmp(p, QUANTIZED_MAGIC, 8) != 0) return false;
+  std::memcpy(header, p + 8, sizeof(header));
+  p += 8 + sizeof(header);
+  type = header[0];
+  n_rows = header[1];
+  dim = header[2];
+  n_subspaces = header[3];
+  size_codebook = header[4];
+  // n_rows and dim are bounded by the size of the file before being multiplied, so that
+  // a corrupt header cannot overflow past the checks below
+  const int64_t size_left = end - p;
+  if (n_rows < 0 || dim <= 0 || dim > size_left) return false;
+
+  // The header is 48 bytes long, so the float arrays are aligned in the mapping
+  if (type == QUANTIZED_INT8) {
+    if (n_rows > size_left / (static_cast<int64_t>(sizeof(float)) + dim)) return false;
+    scales = reinterpret_cast<const float*>(p);
+    p += n_rows * sizeof(float);
+    codes_int8 = reinterpret_cast<const int8_t*>(p);
+    p += n_rows * dim;
+  } else if (type == QUANTIZED_PQ) {
+    if (n_subspaces <= 0 || n_subspaces > dim || size_codebook <= 0 || size_codebook > SIZE_PQ_CODEBOOK) return false;
+    const int64_t size_centroids = size_codebook * dim * static_cast<int64_t>(sizeof(float));
+    if (size_centroids > size_left || n_rows > (size_left - size_centroids) / n_subspaces) return false;
+    centroids = reinterpret_cast<const float*>(p);
+    p += size_centroids;
+    codes_pq = reinterpret_cast<const uint8_t*>(p);
+    p += n_rows * n_subspaces;
+    for (int64_t i=0; i<n_rows*n_subspaces; i++) {
+      if (codes_pq[i] >= size_codebook) return false;
+    }
+  } else {
+    return false;
+  }
+
+  words.resize(n_rows);
+  for (int64_t i=0; i<n_rows; i++) {
+    if (p >= end) return false;
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    words[i].assign(p, eol);
+    p = eol + 1;
+  }
+  compute_inverse_norms(n_cores);
+  return true;
+}
+
+void evaluate_quantization(const double* matrix,
+                           const QuantizedMatrix& quantized,
+                           const int64_t n_queries,
+                           const int64_t k,
+                           const int64_t seed,
+                           const int64_t n_cores,
+                           QuantizationReport& report)
+{
+  const int64_t n_rows = quantized.size();
+  const int64_t dim = quantized.get_dim();
+
+  // Reconstruction error and norms of the full-precision rows
+  std::vector<double> norms(n_rows);
+  std::vector<double> errors(n_rows);
+  run_ranges(n_rows, n_cores, [&](const int64_t begin, const int64_t end) {
+    std::vector<float> decoded(dim);
+    for (int64_t i=begin; i<end; i++) {
+      quantized.decode(i, decoded.data());
+      double sum = 0;
+      double error = 0;
+      for (int64_t j=0; j<dim; j++) {
+        sum += matrix[i*dim + j] * matrix[i*dim + j];
+        error += (matrix[i*dim + j] - decoded[j]) * (matrix[i*dim + j] - decoded[j]);
+      }
+      norms[i] = std::sqrt(sum);
+      errors[i] = error;
+    }
+  });
+  const double sum_squared_norm = std::inner_product(norms.begin(), norms.end(), norms.begin(), 0.0);
+  report.relative_error = std::accumulate(errors.begin(), errors.end(), 0.0) / std::max(1e-300, sum_squared_norm);
+
+  // Neighbours of sampled rows, by full-precision and by quantized similarity
+  std::vector<int64_t> ids(n_rows);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::mt19937_64 engine(seed);
+  std::shuffle(ids.begin(), ids.end(), engine);
+  ids.resize(std::min(n_queries, n_rows));
+  report.n_queries = ids.size();
+  report.k = std::min(k, n_rows - 1);
+
+  std::vector<int64_t> n_found(ids.size());
+  std::vector<double> sum_rank(ids.size());
+  run_ranges(ids.size(), n_cores, [&](const int64_t begin, const int64_t end) {
+    std::vector<std::pair<double, int64_t>> exact(n_rows);
+    std::vector<float> similarities(n_rows);
+    std::vector<float> query(dim);
+    std::vector<float> prepared;
+    for (int64_t q=begin; q<end; q++) {
+      const int64_t id_query = ids[q];
+      const double* x = matrix + id_query * dim;
+      const double inverse_norm = (norms[id_query] > 0) ? 1 / norms[id_query] : 0;
+      for (int64_t j=0; j<dim; j++) query[j] = x[j] * inverse_norm;
+      quantized.prepare(query.data(), prepared);
+
+      for (int64_t i=0; i<n_rows; i++) {
+        double sum = 0;
+        for (int64_t j=0; j<dim; j++) sum += x[j] * matrix[i*dim + j];
+        exact[i] = std::make_pair((norms[i] > 0) ? sum * inverse_norm / norms[i] : 0, i);
+        similarities[i] = quantized.similarity(prepared.data(), i);
+      }
+      // The query itself is left out
+      exact[id_query].first = -INFINITY;
+      similarities[id_query] = -INFINITY;
+      const int64_t k_query = report.k;
+      std::partial_sort(exact.begin(), exact.begin() + k_query, exact.end(),
+                        std::greater<std::pair<double, int64_t>>());
+
+      // Rank of each exact neighbour among the quantized similarities
+      for (int64_t r=0; r<k_query; r++) {
+        const float s = similarities[exact[r].second];
+        int64_t rank = 1;
+        for (int64_t i=0; i<n_rows; i++) rank += (similarities[i] > s);
+        sum_rank[q] += rank;
+        n_found[q] += (rank <= k_query);
+      }
+    }
+  });
+
+  const double n_neighbours = std::max<double>(1, report.n_queries * report.k);
+  report.recall = std::accumulate(n_found.begin(), n_found.end(), static_cast<int64_t>(0)) / n_neighbours;
+  report.mean_rank = std::accumulate(sum_rank.begin(), sum_rank.end(), 0.0) / n_neighbours;
+}
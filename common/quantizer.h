@@ -0,0 +1,169 @@
+#ifndef QUANTIZER_H
+#define QUANTIZER_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "mapped_file.h"
+#include "parallel_ranges.h"
+
+#define QUANTIZED_MAGIC "WNEQUANT"
+#define QUANTIZED_INT8 1
+#define QUANTIZED_PQ 2
+#define SIZE_PQ_CODEBOOK 256
+#define SIZE_PQ_TRAIN 65536
+
+// Inner product of float32 and int8 vectors, with AVX2 when the compiler targets it
+// and SSE2 otherwise
+inline float dot_int8(const float* a, const int8_t* b, const int64_t n)
+{
+  int64_t i = 0;
+  float sum = 0;
+#if defined(__AVX2__)
+  __m256 acc = _mm256_setzero_ps();
+  for (; i+8<=n; i+=8) {
+    const __m256i b32 = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i)));
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_cvtepi32_ps(b32)));
+  }
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  sum = _mm_cvtss_f32(s);
+#elif defined(__SSE2__)
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  for (; i+8<=n; i+=8) {
+    // Sign-extend 8 int8 to two vectors of 4 int32
+    const __m128i b8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i));
+    const __m128i b16 = _mm_srai_epi16(_mm_unpacklo_epi8(b8, b8), 8);
+    const __m128i b32_low = _mm_srai_epi32(_mm_unpacklo_epi16(b16, b16), 16);
+    const __m128i b32_high = _mm_srai_epi32(_mm_unpackhi_epi16(b16, b16), 16);
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_cvtepi32_ps(b32_low)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_cvtepi32_ps(b32_high)));
+  }
+  __m128 s = _mm_add_ps(acc0, acc1);
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  sum = _mm_cvtss_f32(s);
+#endif
+  for (; i<n; i++) sum += a[i] * b[i];
+  return sum;
+}
+
+// Embeddings compressed for serving, compared with float queries without decoding them.
+//  int8 : each row as int8 codes times a float scale, 1 byte per dimension
+//  pq   : product quantization; the dimensions are split into n_subspaces contiguous
+//         subspaces and each subvector is replaced by the id of the nearest of 256
+//         centroids trained by k-means, 1 byte per subspace
+// A loaded matrix keeps its file mapped and reads the codes from it.
+class QuantizedMatrix {
+private:
+  int64_t type;
+  int64_t n_rows;
+  int64_t dim;
+  int64_t n_subspaces;
+  int64_t size_codebook;
+
+  MappedFile file;
+  std::vector<float> scales_owned;
+  std::vector<int8_t> codes_int8_owned;
+  std::vector<float> centroids_owned;
+  std::vector<uint8_t> codes_pq_owned;
+  const float* scales;
+  const int8_t* codes_int8;
+  // Centroid c of subspace m starts at size_codebook * begin(m) + c * (end(m) - begin(m))
+  const float* centroids;
+  const uint8_t* codes_pq;
+  // Inverse norm of each decoded row
+  std::vector<float> inverse_norms;
+
+public:
+  QuantizedMatrix();
+  ~QuantizedMatrix();
+
+  void quantize_int8(const double* matrix, const int64_t _n_rows, const int64_t _dim, const int64_t n_cores);
+  // Trains the codebooks on up to SIZE_PQ_TRAIN sampled rows with n_iteration rounds of
+  // k-means, then encodes every row
+  void quantize_pq(const double* matrix,
+                   const int64_t _n_rows,
+                   const int64_t _dim,
+                   const int64_t _n_subspaces,
+                   const int64_t n_iteration,
+                   const int64_t seed,
+                   const int64_t n_cores);
+  // The words follow the codes, one UTF-8 word per line
+  bool save(const std::string path, const std::vector<std::string>& words) const;
+  bool load(const std::string path, const int64_t n_cores, std::vector<std::string>& words);
+
+  int64_t get_type() const { return type; }
+  int64_t size() const { return n_rows; }
+  int64_t get_dim() const { return dim; }
+  int64_t bytes_per_row() const { return (type == QUANTIZED_INT8) ? dim + sizeof(float) : n_subspaces; }
+  void decode(const int64_t id, float* out) const;
+
+  // Per-query state of similarity() : the query itself for int8, and for pq the inner
+  // products of each of its subvectors with each centroid
+  void prepare(const float* query, std::vector<float>& prepared) const;
+  // Cosine similarity of a unit-length query to the decoded row `id`
+  float similarity(const float* prepared, const int64_t id) const
+  {
+    if (type == QUANTIZED_INT8) return dot_int8(prepared, codes_int8 + id * dim, dim) * inverse_norms[id];
+    // Independent sums, so that the table lookups overlap
+    const uint8_t* c = codes_pq + id * n_subspaces;
+    float sums[4] = {0, 0, 0, 0};
+    int64_t m = 0;
+    for (; m+4<=n_subspaces; m+=4) {
+      sums[0] += prepared[m * size_codebook + c[m]];
+      sums[1] += prepared[(m + 1) * size_codebook + c[m + 1]];
+      sums[2] += prepared[(m + 2) * size_codebook + c[m + 2]];
+      sums[3] += prepared[(m + 3) * size_codebook + c[m + 3]];
+    }
+    for (; m<n_subspaces; m++) sums[0] += prepared[m * size_codebook + c[m]];
+    return (sums[0] + sums[1] + sums[2] + sums[3]) * inverse_norms[id];
+  }
+
+private:
+  int64_t begin_subspace(const int64_t m) const { return m * dim / n_subspaces; }
+  void compute_inverse_norms(const int64_t n_cores);
+
+  QuantizedMatrix(const QuantizedMatrix&);
+  QuantizedMatrix& operator=(const QuantizedMatrix&);
+};
+
+// How far quantization moves the embeddings and their nearest neighbours
+struct QuantizationReport {
+  double relative_error;  // squared reconstruction error over squared norm, summed over rows
+  int64_t n_queries;
+  int64_t k;
+  double recall;          // share of the exact cosine top-k also in the top-k of the codes
+  double mean_rank;       // mean rank among the codes of the exact top-k, (k + 1) / 2 if unchanged
+};
+
+// Compares `quantized` with the full-precision matrix it was made from, on the
+// neighbours of n_queries sampled rows
+void evaluate_quantization(const double* matrix,
+                           const QuantizedMatrix& quantized,
+                           const int64_t n_queries,
+                           const int64_t k,
+                           const int64_t seed,
+                           const int64_t n_cores,
+                           QuantizationReport& report);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef RESOURCE_USAGE_H
+#define RESOURCE_USAGE_H
+
+#include <fstream>
+#include <string>
+#include <cstdint>
+#include <chrono>
+
+#include <sys/resource.h>
+
+// Resident set size of the process in bytes, read from /proc/self/status.
+// `field` is "VmRSS:" for the current size and "VmHWM:" for the peak size.
+inline int64_t read_rss(const std::string field)
+{
+  std::ifstream fin("/proc/self/status");
+  std::string line;
+  while (std::getline(fin, line)) {
+    if (line.compare(0, field.size(), field) == 0) {
+      return std::stoll(line.substr(field.size())) * 1024;
+    }
+  }
+  // Fall back on getrusage, which only knows the peak
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+}
+
+inline int64_t current_rss() { return read_rss("VmRSS:"); }
+inline int64_t peak_rss() { return read_rss("VmHWM:"); }
+
+// Resets the peak to the current RSS so that the peak of each stage can be measured.
+// Returns false when the kernel does not support it, in which case peak_rss() stays the
+// peak of the whole process.
+inline bool reset_peak_rss()
+{
+  std::ofstream fout("/proc/self/clear_refs");
+  if (!fout.is_open()) return false;
+  fout << "5";
+  fout.close();
+  return !fout.fail();
+}
+
+// Wall time and peak RSS of a stage
+class StageUsage {
+private:
+  std::chrono::steady_clock::time_point t_start;
+
+public:
+  std::string name;
+  double seconds;
+  int64_t peak_bytes;
+  bool is_peak_of_stage;  // false if the peak could not be reset at the start
+
+  explicit StageUsage(const std::string _name) : name(_name), seconds(0), peak_bytes(0), is_peak_of_stage(false) {}
+
+  void start()
+  {
+    is_peak_of_stage = reset_peak_rss();
+    t_start = std::chrono::steady_clock::now();
+  }
+
+  void stop()
+  {
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+    peak_bytes = peak_rss();
+  }
+};
+
+#endif
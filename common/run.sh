@@ -0,0 +1,8 @@
+#!/bin/bash
+set -e
+CORPUS="../data/sample_processed.txt"
+STORE="../data/sample_processed.corpus"
+make
+./convert_corpus --corpus_path=$CORPUS \
+                 --store_path=$STORE \
+                 --n_core=8
@@ -0,0 +1,105 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <string>
+#include <cstdint>
+
+// Appends `wc` encoded in UTF-8
+inline void append_utf8(const wchar_t wc, std::string& out)
+{
+  const uint32_t c = static_cast<uint32_t>(wc);
+  if (c < 0x80) {
+    out += static_cast<char>(c);
+  } else if (c < 0x800) {
+    out += static_cast<char>(0xC0 | (c >> 6));
+    out += static_cast<char>(0x80 | (c & 0x3F));
+  } else if (c < 0x10000) {
+    out += static_cast<char>(0xE0 | (c >> 12));
+    out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (c & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (c >> 18));
+    out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (c & 0x3F));
+  }
+}
+
+// Appends `str` encoded in UTF-8
+inline void append_utf8(const std::wstring& str, std::string& out)
+{
+  for (wchar_t wc : str) append_utf8(wc, out);
+}
+
+// Number of bytes of `c` in UTF-8
+inline int64_t length_utf8(const wchar_t c)
+{
+  const uint32_t u = static_cast<uint32_t>(c);
+  return (u < 0x80) ? 1 : (u < 0x800) ? 2 : (u < 0x10000) ? 3 : 4;
+}
+
+// Decodes one character starting at data[i] into `code` and returns its length in bytes.
+// Returns 0 for a sequence cut by `size` that may still be completed, and a negative
+// number of bytes to skip for an ill-formed sequence. Overlong forms, surrogates and
+// code points above U+10FFFF are ill-formed, as in Python's decoder, and only the
+// maximal valid prefix is skipped so that decoding resumes at the next lead byte.
+inline int64_t next_utf8(const unsigned char* data, const int64_t i, const int64_t size, uint32_t& code)
+{
+  const unsigned char c = data[i];
+  int64_t length;
+  unsigned char lower = 0x80, upper = 0xBF;  // range of the second byte
+  if (c < 0x80) {
+    code = c;
+    return 1;
+  } else if (c >= 0xC2 && c <= 0xDF) {
+    length = 2;
+    code = c & 0x1F;
+  } else if (c >= 0xE0 && c <= 0xEF) {
+    length = 3;
+    code = c & 0x0F;
+    if (c == 0xE0) lower = 0xA0;
+    if (c == 0xED) upper = 0x9F;
+  } else if (c >= 0xF0 && c <= 0xF4) {
+    length = 4;
+    code = c & 0x07;
+    if (c == 0xF0) lower = 0x90;
+    if (c == 0xF4) upper = 0x8F;
+  } else {
+    return -1;
+  }
+
+  for (int64_t j=1; j<length; j++) {
+    if (i + j >= size) return 0;
+    const unsigned char b = data[i+j];
+    if (b < lower || b > upper) return -j;
+    code = (code << 6) | (b & 0x3F);
+    lower = 0x80;
+    upper = 0xBF;
+  }
+  return length;
+}
+
+// Decodes complete sequences of `data` into `out` and returns the number of bytes
+// consumed, which stops short of `size` only for a sequence cut at the end.
+// Invalid bytes are skipped.
+inline int64_t decode_utf8(const char* data, const int64_t size, std::wstring& out)
+{
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  int64_t i = 0;
+  out.reserve(out.size() + size);
+
+  while (i < size) {
+    uint32_t code;
+    const int64_t length = next_utf8(p, i, size, code);
+    if (length == 0) return i;
+    if (length < 0) {
+      i -= length;
+      continue;
+    }
+    out += static_cast<wchar_t>(code);
+    i += length;
+  }
+  return i;
+}
+
+#endif
@@ -0,0 +1,238 @@
+/*
+    Vectors of unsegmented texts composed from the embeddings of 5_SGNS_WNE
+*/
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdint>
+#include <chrono>
+#include <numeric>
+#include <vector>
+
+#include "cmdline.h"
+#include "text_encoder.h"
+#include "../query/embedding_table.h"
+#include "../common/mapped_file.h"
+#include "../common/parallel_writer.h"
+
+static std::vector<int64_t> parse_list(const std::string list)
+{
+  std::vector<int64_t> values;
+  std::istringstream iss(list);
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    const int64_t n = std::atoll(item.c_str());
+    if (n > 0) values.push_back(n);
+  }
+  return values;
+}
+
+static double percentile(std::vector<double> values, const double p)
+{
+  if (values.empty()) return 0;
+  const int64_t i = std::min<int64_t>(values.size() - 1, static_cast<int64_t>(p * values.size()));
+  std::nth_element(values.begin(), values.begin() + i, values.end());
+  return values[i];
+}
+
+// One text per line, pointing into the mapped file
+static void split_lines(const MappedFile& file, std::vector<TextSpan>& texts)
+{
+  const char* p = file.data();
+  const char* end = p + file.size();
+  while (p < end) {
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    int64_t size = eol - p;
+    if (size > 0 && p[size - 1] == '\r') size--;
+    texts.push_back(TextSpan{p, size});
+    p = eol + 1;
+  }
+}
+
+// Throughput and per-batch latency of the encoder for each thread count and batch size
+static void run_benchmark(const TextEncoder& encoder,
+                          const std::vector<TextSpan>& texts,
+                          const bool is_normalized,
+                          const std::vector<int64_t>& batch_sizes,
+                          const std::vector<int64_t>& threads)
+{
+  int64_t n_bytes = 0;
+  for (const TextSpan& text : texts) n_bytes += text.size;
+
+  std::cout << std::endl << "###### Benchmark : " << texts.size() << " texts, " << n_bytes << " bytes ######" << std::endl;
+  std::cout << std::right << std::setw(9) << "threads" << std::setw(12) << "batch_size"
+            << std::setw(11) << "mean (ms)" << std::setw(10) << "p50 (ms)" << std::setw(10) << "p99 (ms)"
+            << std::setw(12) << "texts/sec" << std::setw(8) << "MB/sec" << std::endl;
+
+  std::vector<float> vectors;
+  std::vector<int64_t> n_matches;
+  for (const int64_t n_threads : threads) {
+    for (const int64_t batch_size : batch_sizes) {
+      std::vector<double> latencies;
+      std::vector<TextSpan> batch;
+      const auto t1 = std::chrono::steady_clock::now();
+      for (int64_t begin=0; begin<texts.size(); begin+=batch_size) {
+        const auto t_batch = std::chrono::steady_clock::now();
+        batch.assign(texts.begin() + begin, texts.begin() + std::min<int64_t>(texts.size(), begin + batch_size));
+        encoder.encode(batch, is_normalized, n_threads, vectors, n_matches);
+        latencies.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - t_batch).count());
+      }
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+      const double mean = std::accumulate(latencies.begin(), latencies.end(), 0.0) / std::max<int64_t>(1, latencies.size());
+
+      std::cout << std::setw(9) << n_threads << std::setw(12) << batch_size
+                << std::fixed << std::setprecision(3) << std::setw(11) << 1000 * mean
+                << std::setw(10) << 1000 * percentile(latencies, 0.5)
+                << std::setw(10) << 1000 * percentile(latencies, 0.99)
+                << std::setprecision(0) << std::setw(12) << texts.size() / std::max(1e-9, seconds)
+                << std::setprecision(1) << std::setw(8) << n_bytes / std::max(1e-9, seconds) / 1e6 << std::endl;
+      std::cout.unsetf(std::ios::floatfield);
+      std::cout << std::setprecision(6);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  // parsing parameters with https://github.com/tanakh/cmdline
+  cmdline::parser a;
+  a.add<std::string>("embedding_path", '\0', "embeddings saved by 5_SGNS_WNE", true);
+  a.add<std::string>("embedding_format", '\0', "format of the embeddings (text, binary, npy, int8 or pq)", false, "text");
+  a.add<std::string>("word_data_path", '\0', "expected word frequencies of 4_count_expected_word_frequency, to weight the n-grams", false);
+  a.add<double>("smoothing", '\0', "weight a / (a + p(w)) of an n-gram with share p(w) of the expected word frequencies", false, 1e-3);
+  a.add("normalize", '\0', "scale the text vectors to unit length");
+
+  a.add<std::string>("input_path", '\0', "texts, one per line", true);
+  a.add<std::string>("output_path", '\0', "vectors of the texts, one row per line of --input_path", false);
+  a.add<std::string>("output_format", '\0', "output format (text or npy)", false, "text");
+  a.add<int64_t>("batch_size", '\0', "texts encoded and written at a time", false, 10000);
+  a.add<int64_t>("n_cores", '\0', "n_cores", false, 1);
+
+  a.add("benchmark", '\0', "measure throughput and latency on the texts of --input_path");
+  a.add<int64_t>("n_benchmark_text", '\0', "texts of --input_path used by --benchmark", false, 100000);
+  a.add<std::string>("batch_sizes", '\0', "comma-separated batch sizes of --benchmark", false, "1,16,256,4096");
+  a.add<std::string>("threads", '\0', "comma-separated thread counts of --benchmark", false, "1,2,4,8");
+  a.parse_check(argc, argv);
+
+  std::string embedding_path = a.get<std::string>("embedding_path");
+  std::string embedding_format = a.get<std::string>("embedding_format");
+  std::string word_data_path = a.get<std::string>("word_data_path");
+  double smoothing = a.get<double>("smoothing");
+  bool is_normalized = a.exist("normalize");
+
+  std::string input_path = a.get<std::string>("input_path");
+  std::string output_path = a.get<std::string>("output_path");
+  std::string output_format = a.get<std::string>("output_format");
+  int64_t batch_size = a.get<int64_t>("batch_size");
+  int64_t n_cores = a.get<int64_t>("n_cores");
+
+  bool benchmark = a.exist("benchmark");
+  int64_t n_benchmark_text = a.get<int64_t>("n_benchmark_text");
+  std::vector<int64_t> batch_sizes = parse_list(a.get<std::string>("batch_sizes"));
+  std::vector<int64_t> threads = parse_list(a.get<std::string>("threads"));
+
+  if (output_format != "text" && output_format != "npy") {
+    std::cout << "Invalid output format." << std::endl;
+    return 0;
+  }
+  if (batch_size <= 0 || n_cores <= 0 || smoothing <= 0) {
+    std::cout << "--batch_size, --n_cores and --smoothing must be positive." << std::endl;
+    return 0;
+  }
+  if (!benchmark && output_path.empty()) {
+    std::cout << "--output_path is needed unless --benchmark is given." << std::endl;
+    return 0;
+  }
+
+  // Load embeddings and weights
+  EmbeddingTable table;
+  if (!table.load(embedding_path, embedding_format, n_cores)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  std::cout << "Loaded " << table.size() << " embeddings of dimension " << table.get_dim() << std::endl;
+  TextEncoder encoder(table);
+  if (!word_data_path.empty() && !encoder.load_weights(word_data_path, smoothing)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+
+  MappedFile file_input;
+  if (!file_input.open(input_path)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  std::vector<TextSpan> texts;
+  split_lines(file_input, texts);
+  const int64_t n_texts = texts.size();
+  const int64_t dim = encoder.get_dim();
+
+  if (benchmark) {
+    if (batch_sizes.empty() || threads.empty() || n_benchmark_text <= 0) {
+      std::cout << "Invalid benchmark settings." << std::endl;
+      return 0;
+    }
+    texts.resize(std::min(n_texts, n_benchmark_text));
+    run_benchmark(encoder, texts, is_normalized, batch_sizes, threads);
+    return 0;
+  }
+
+  // Encode and write batch by batch
+  std::ofstream fout(output_path, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  std::cout << "Saving vectors of " << n_texts << " texts to " << output_path << std::endl;
+  std::string header;
+  if (output_format == "npy") {
+    append_npy_header(n_texts, dim, header);
+  } else {
+    append_int64(n_texts, header);
+    header += ' ';
+    append_int64(dim, header);
+    header += '\n';
+  }
+  fout.write(header.data(), header.size());
+
+  std::vector<float> vectors;
+  std::vector<int64_t> n_matches;
+  std::vector<TextSpan> batch;
+  int64_t n_matches_total = 0;
+  int64_t n_texts_unmatched = 0;
+  const auto t1 = std::chrono::steady_clock::now();
+  for (int64_t begin=0; begin<n_texts; begin+=batch_size) {
+    batch.assign(texts.begin() + begin, texts.begin() + std::min(n_texts, begin + batch_size));
+    encoder.encode(batch, is_normalized, n_cores, vectors, n_matches);
+    for (const int64_t n : n_matches) {
+      n_matches_total += n;
+      n_texts_unmatched += (n == 0);
+    }
+
+    if (output_format == "npy") {
+      fout.write(reinterpret_cast<const char*>(vectors.data()), vectors.size() * sizeof(float));
+    } else {
+      write_rows_parallel(fout, batch.size(), n_cores, [&vectors, dim](const int64_t i, std::string& buffer) {
+        for (int64_t j=0; j<dim; j++) {
+          if (j > 0) buffer += ' ';
+          append_double(vectors[i * dim + j], buffer);
+        }
+        buffer += '\n';
+      });
+    }
+  }
+  fout.close();
+  const auto t2 = std::chrono::steady_clock::now();
+
+  std::cout << "Encoding took " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count()
+            << " milliseconds, " << static_cast<double>(n_matches_total) / std::max<int64_t>(1, n_texts)
+            << " n-grams matched per text, " << n_texts_unmatched << " texts without any" << std::endl;
+  std::cout << "Done" << std::endl;
+
+  return 0;
+}
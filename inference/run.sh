@@ -0,0 +1,19 @@
+#!/bin/bash
+set -e
+EMBEDDINGS="../data/embeddings.txt"
+make
+./main --embedding_path=$EMBEDDINGS \
+       --embedding_format=text \
+       --word_data_path=../data/ewf.csv \
+       --input_path=../data/texts.txt \
+       --benchmark \
+       --batch_sizes=1,16,256,4096 \
+       --threads=1,2,4,8
+./main --embedding_path=$EMBEDDINGS \
+       --embedding_format=text \
+       --word_data_path=../data/ewf.csv \
+       --input_path=../data/texts.txt \
+       --output_path=../data/text_vectors.npy \
+       --output_format=npy \
+       --normalize \
+       --n_cores=8
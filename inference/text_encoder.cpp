@@ -0,0 +1,159 @@
+#include "text_encoder.h"
+
+std::vector<std::string> TextEncoder::words_of(const EmbeddingTable& table)
+{
+  std::vector<std::string> words(table.size());
+  for (int64_t id=0; id<table.size(); id++) words[id] = table.word(id);
+  return words;
+}
+
+TextEncoder::TextEncoder(const EmbeddingTable& table_param)
+  : table(table_param), vocabulary(words_of(table_param)), dim(table_param.get_dim()), max_length_word(0)
+{
+  assert(dim > 0);
+  weights.assign(table.size(), 1);
+
+  // Longer n-grams cannot be in the vocabulary
+  for (int64_t id=0; id<table.size(); id++) {
+    const std::string& word = table.word(id);
+    const int64_t length = std::count_if(word.begin(), word.end(), [](const char c) {
+      return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    });
+    max_length_word = std::max(max_length_word, length);
+  }
+}
+
+// Parses the frequency after the tab, which may be written with thousands separators
+static double parse_frequency(const char* p, const char* end)
+{
+  std::string number;
+  for (; p < end; p++) {
+    if (*p != ',' && *p != ' ' && *p != '\t' && *p != '\r') number += *p;
+  }
+  return std::strtod(number.c_str(), nullptr);
+}
+
+bool TextEncoder::load_weights(const std::string word_data_path, const double smoothing)
+{
+  assert(smoothing > 0);
+  MappedFile file;
+  if (!file.open(word_data_path)) return false;
+  const char* p = file.data();
+  const char* end = p + file.size();
+
+  std::vector<double> frequencies(table.size(), -1);
+  while (p < end) {
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    const char* tab = static_cast<const char*>(std::memchr(p, '\t', eol - p));
+    if (tab != nullptr) {
+      const int64_t id = vocabulary.find(p, tab - p);
+      if (id >= 0) frequencies[id] = std::max(0.0, parse_frequency(tab + 1, eol));
+    }
+    p = eol + 1;
+  }
+
+  double sum_frequency = 0;
+  for (const double f : frequencies) sum_frequency += std::max(0.0, f);
+  if (sum_frequency <= 0) return true;
+  for (int64_t id=0; id<table.size(); id++) {
+    if (frequencies[id] < 0) continue;
+    weights[id] = static_cast<float>(smoothing / (smoothing + frequencies[id] / sum_frequency));
+  }
+  return true;
+}
+
+// Byte offset of each character of well-formed `data`, then its size
+static void scan_characters(const char* data, const int64_t size, std::vector<int64_t>& starts)
+{
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(data);
+  starts.clear();
+  for (int64_t i=0; i<size;) {
+    uint32_t code;
+    const int64_t length = next_utf8(u, i, size, code);
+    if (length <= 0) break;
+    starts.push_back(i);
+    i += length;
+  }
+  starts.push_back(size);
+}
+
+int64_t TextEncoder::encode(const TextSpan text, const bool is_normalized, float* out, EncoderWorkspace& workspace) const
+{
+  std::fill(out, out + dim, 0.0f);
+
+  // Training only saw the corpus written by 1_preprocess, so the text is matched in
+  // the same form : a space or a newline can only match as part of a '␣' n-gram
+  std::string& processed = workspace.text_processed;
+  Preprocessor::preprocess_text(text.data, text.size, processed);
+  const char* data = processed.data();
+  std::vector<int64_t>& starts = workspace.starts;
+  scan_characters(data, processed.size(), starts);
+
+  const int64_t n_chars = starts.size() - 1;
+  int64_t n_matches = 0;
+  float sum_weight = 0;
+  if (table.is_quantized()) workspace.row.resize(dim);
+  for (int64_t i=0; i<n_chars; i++) {
+    for (int64_t length_word=1; length_word<=max_length_word; length_word++) {
+      if (i + length_word > n_chars) break;
+      const int64_t id = vocabulary.find(data + starts[i], starts[i + length_word] - starts[i]);
+      if (id < 0) continue;
+
+      const float w = weights[id];
+      const float* v;
+      if (table.is_quantized()) {
+        table.get_quantized().decode(id, workspace.row.data());
+        v = workspace.row.data();
+      } else {
+        v = table.row(id);
+      }
+      for (int64_t j=0; j<dim; j++) out[j] += w * v[j];
+      sum_weight += w;
+      n_matches++;
+    }
+  }
+  if (n_matches == 0) return 0;
+
+  float scale = 1 / sum_weight;
+  if (is_normalized) {
+    float norm = 0;
+    for (int64_t j=0; j<dim; j++) norm += out[j] * out[j];
+    scale = (norm > 0) ? 1 / std::sqrt(norm) : 0;
+  }
+  for (int64_t j=0; j<dim; j++) out[j] *= scale;
+  return n_matches;
+}
+
+void TextEncoder::encode(const std::vector<TextSpan>& texts,
+                         const bool is_normalized,
+                         const int64_t n_threads,
+                         std::vector<float>& vectors,
+                         std::vector<int64_t>& n_matches) const
+{
+  const int64_t n_texts = texts.size();
+  vectors.resize(n_texts * dim);
+  n_matches.resize(n_texts);
+
+  // Starting threads costs more than encoding a few short texts
+  const int64_t n_chunks = (n_texts + SIZE_CHUNK_ENCODER - 1) / SIZE_CHUNK_ENCODER;
+  const int64_t n_workers = std::max<int64_t>(1, std::min(n_threads, n_chunks / 2));
+  std::atomic<int64_t> i_chunk_next(0);
+  auto work = [&]() {
+    EncoderWorkspace workspace;
+    for (int64_t i_chunk=i_chunk_next++; i_chunk<n_chunks; i_chunk=i_chunk_next++) {
+      const int64_t i_end = std::min(n_texts, (i_chunk + 1) * SIZE_CHUNK_ENCODER);
+      for (int64_t i=i_chunk*SIZE_CHUNK_ENCODER; i<i_end; i++) {
+        n_matches[i] = encode(texts[i], is_normalized, vectors.data() + i * dim, workspace);
+      }
+    }
+  };
+
+  if (n_workers == 1) {
+    work();
+    return;
+  }
+  std::vector<std::thread> vector_threads(n_workers);
+  for (auto& t : vector_threads) t = std::thread(work);
+  for (auto& t : vector_threads) t.join();
+}
@@ -0,0 +1,79 @@
+#ifndef TEXT_ENCODER_H
+#define TEXT_ENCODER_H
+
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../query/embedding_table.h"
+#include "../5_SGNS_WNE/vocabulary_loader.h"
+#include "../1_preprocess/preprocessor.h"
+#include "../common/mapped_file.h"
+#include "../common/utf8.h"
+
+// Texts handed out to a thread at a time
+#define SIZE_CHUNK_ENCODER 16
+
+// Unsegmented UTF-8 text, not owned
+struct TextSpan {
+  const char* data;
+  int64_t size;
+};
+
+// Buffers reused across the texts encoded by one thread
+struct EncoderWorkspace {
+  std::vector<int64_t> starts;  // byte offset of each character, then the end of the text
+  std::string text_processed;   // the text as 1_preprocess writes it
+  std::vector<float> row;       // decoded row of quantized embeddings
+};
+
+// Composes a vector for arbitrary text from the embeddings of 5_SGNS_WNE.
+// A text is first normalized as 1_preprocess does for the corpus : stripped, every run
+// of whitespace as a single '␣' and ill-formed bytes dropped. As in training, every n-gram of up to max_length_word characters starting at every
+// character is looked up in the vocabulary; the text vector is the weighted mean of
+// the vectors of the n-grams found, and zero when none is. Weights are 1, or
+// a / (a + p(w)) after load_weights(), p(w) being the share of w in the expected
+// word frequencies of 4_count_expected_word_frequency (smooth inverse frequency).
+class TextEncoder {
+private:
+  const EmbeddingTable& table;
+  const VocabularyTable vocabulary;
+  int64_t dim;
+  int64_t max_length_word;
+  std::vector<float> weights;
+
+public:
+  explicit TextEncoder(const EmbeddingTable& table_param);
+
+  // Reads "word\tewf" lines; words of the embeddings missing from the file keep weight 1
+  bool load_weights(const std::string word_data_path, const double smoothing);
+
+  int64_t get_dim() const { return dim; }
+  int64_t get_max_length_word() const { return max_length_word; }
+
+  // Writes the vector of texts[i] to vectors[i * dim, (i + 1) * dim) and its number of
+  // matched n-grams to n_matches[i]. Batches of a few chunks stay on the calling thread.
+  void encode(const std::vector<TextSpan>& texts,
+              const bool is_normalized,
+              const int64_t n_threads,
+              std::vector<float>& vectors,
+              std::vector<int64_t>& n_matches) const;
+  // Encodes one text into `out` and returns its number of matched n-grams
+  int64_t encode(const TextSpan text, const bool is_normalized, float* out, EncoderWorkspace& workspace) const;
+
+private:
+  static std::vector<std::string> words_of(const EmbeddingTable& table);
+
+  TextEncoder(const TextEncoder&);
+  TextEncoder& operator=(const TextEncoder&);
+};
+
+#endif
@@ -0,0 +1,371 @@
+#include "boundary_predictor.h"
+
+#define VISIBLE_SPACE L'\u2423'  // ␣
+
+// Characters of str.isspace(), stripped at both ends of a sentence
+static bool is_space(const wchar_t c)
+{
+  return (c >= 0x09 && c <= 0x0D) || (c >= 0x1C && c <= 0x20) || c == 0x85 || c == 0xA0
+      || c == 0x1680 || (c >= 0x2000 && c <= 0x200A) || c == 0x2028 || c == 0x2029
+      || c == 0x202F || c == 0x205F || c == 0x3000;
+}
+
+// Whitespace replaced with '␣' by clean() of main.py
+static bool is_visualized_space(const wchar_t c)
+{
+  return c == 0x09 || c == 0x0A || c == 0x0B || c == 0x0C || c == 0x20 || c == 0x85 || c == 0xA0
+      || (c >= 0x2000 && c <= 0x200A) || c == 0x2028 || c == 0x2029
+      || c == 0x202F || c == 0x205F || c == 0x3000;
+}
+
+// Lines of a UTF-8 file as Python reads them, with universal newlines
+static bool read_lines(const std::string path, std::vector<std::wstring>& lines)
+{
+  MappedFile file;
+  if (!file.open(path)) return false;
+  std::wstring text;
+  decode_utf8(file.data(), file.size(), text);
+
+  int64_t begin = 0;
+  for (int64_t i=0; i<text.size(); i++) {
+    if (text[i] != L'\n' && text[i] != L'\r') continue;
+    lines.push_back(text.substr(begin, i - begin));
+    if (text[i] == L'\r' && i + 1 < text.size() && text[i+1] == L'\n') i++;
+    begin = i + 1;
+  }
+  if (begin < text.size()) lines.push_back(text.substr(begin));
+  return true;
+}
+
+// clean(sentence.strip() + '␣') of main.py
+static std::wstring clean(const std::wstring& line)
+{
+  int64_t begin = 0, end = line.size();
+  while (begin < end && is_space(line[begin])) begin++;
+  while (end > begin && is_space(line[end-1])) end--;
+
+  std::wstring cleaned;
+  for (int64_t i=begin; i<=end; i++) {
+    const wchar_t c = (i == end || is_visualized_space(line[i])) ? VISIBLE_SPACE : line[i];
+    if (c == VISIBLE_SPACE && !cleaned.empty() && cleaned.back() == VISIBLE_SPACE) continue;
+    cleaned += c;
+  }
+  return cleaned;
+}
+
+// Labels 1 for the characters of `sentence` which start a word of `segmented`,
+// as main.py does; returns false if the two sentences do not match
+static bool label_sentence(const std::wstring& sentence, const std::wstring& segmented, std::vector<double>& labels)
+{
+  if (sentence.empty() || segmented.size() < sentence.size() || sentence[0] != segmented[0]) return false;
+
+  int64_t gap = 0;
+  double is_new_word = 1;
+  for (int64_t j=0; j<sentence.size(); j++) {
+    const wchar_t c = sentence[j];
+    if (j + gap < 0 || j + gap >= segmented.size()) return false;
+    wchar_t c_segmented = segmented[j+gap];
+    if (c == VISIBLE_SPACE) {
+      is_new_word = 1;
+      labels.push_back(is_new_word);
+      if (c != c_segmented) gap -= 1;
+      continue;
+    }
+    while (c != c_segmented) {
+      gap += 1;
+      is_new_word = 1;
+      if (j + gap >= segmented.size()) return false;
+      c_segmented = segmented[j+gap];
+    }
+    labels.push_back(is_new_word);
+    is_new_word = 0;
+  }
+  return true;
+}
+
+// Solves A x = b for a symmetric positive definite A (Cholesky), overwriting b with x
+static void solve_cholesky(std::vector<double> A, std::vector<double>& b)
+{
+  const int64_t n = b.size();
+  for (int64_t j=0; j<n; j++) {
+    double d = A[j*n+j];
+    for (int64_t k=0; k<j; k++) d -= A[j*n+k] * A[j*n+k];
+    d = std::sqrt(std::max(d, 1e-300));
+    A[j*n+j] = d;
+    for (int64_t i=j+1; i<n; i++) {
+      double s = A[i*n+j];
+      for (int64_t k=0; k<j; k++) s -= A[i*n+k] * A[j*n+k];
+      A[i*n+j] = s / d;
+    }
+  }
+  for (int64_t i=0; i<n; i++) {
+    double s = b[i];
+    for (int64_t k=0; k<i; k++) s -= A[i*n+k] * b[k];
+    b[i] = s / A[i*n+i];
+  }
+  for (int64_t i=n-1; i>=0; i--) {
+    double s = b[i];
+    for (int64_t k=i+1; k<n; k++) s -= A[k*n+i] * b[k];
+    b[i] = s / A[i*n+i];
+  }
+}
+
+BoundaryPredictor::BoundaryPredictor(const std::unordered_map<std::wstring, int64_t>& _ngram_occurence,
+                                     const int64_t _max_n,
+                                     const int64_t _n_cores)
+  : ngram_occurence(_ngram_occurence),
+    max_n(_max_n),
+    n_cores(_n_cores),
+    length_corpus(1)
+{
+  assert(max_n > 0);
+  assert(n_cores > 0);
+  n_features = max_n * max_n;
+  weights.assign(n_features + 1, 0);
+}
+
+BoundaryPredictor::~BoundaryPredictor() {}
+
+int64_t BoundaryPredictor::occurence(const std::wstring& ngram) const
+{
+  const auto it = ngram_occurence.find(ngram);
+  return (it == ngram_occurence.end()) ? 1 : it->second;
+}
+
+template <class Text>
+void BoundaryPredictor::compute_features(const Text& text, const int64_t i,
+                                         std::vector<std::wstring>& lefts,
+                                         std::vector<std::wstring>& rights,
+                                         std::wstring& joined,
+                                         double* x) const
+{
+  const int64_t length_text = text.size();
+  std::vector<double> occurence_rights(max_n);
+  for (int64_t b=1; b<=max_n; b++) {
+    copy_substr(text, i, std::min(b, length_text - i), rights[b-1]);
+    occurence_rights[b-1] = occurence(rights[b-1]);
+  }
+  for (int64_t a=1; a<=max_n; a++) {
+    // As with Python slices, there is no left context before the head of the text
+    if (i - a >= 0) copy_substr(text, i - a, a, lefts[a-1]);
+    else lefts[a-1].clear();
+    const double occurence_left = occurence(lefts[a-1]);
+    for (int64_t b=1; b<=max_n; b++) {
+      joined = lefts[a-1];
+      joined += rights[b-1];
+      x[(a-1)*max_n + (b-1)] = std::log((occurence(joined) * length_corpus) / (occurence_left * occurence_rights[b-1]));
+    }
+  }
+}
+
+double BoundaryPredictor::predict_proba(const double* x) const
+{
+  double z = weights[n_features];
+  for (int64_t j=0; j<n_features; j++) z += weights[j] * x[j];
+  return 1.0 / (1.0 + std::exp(-z));
+}
+
+bool BoundaryPredictor::train(const CorpusStore& corpus,
+                              const std::string raw_corpus_path,
+                              const std::string segmented_corpus_path,
+                              const double usage_ratio,
+                              const int64_t seed)
+{
+  length_corpus = corpus.size();
+
+  // prepare data for training predictor
+  std::vector<std::wstring> sentences, segmented_sentences;
+  if (!read_lines(raw_corpus_path, sentences) || !read_lines(segmented_corpus_path, segmented_sentences)) {
+    std::cout << "Invalid file name." << std::endl;
+    return false;
+  }
+  if (sentences.size() != segmented_sentences.size()) {
+    std::cout << "Corpus and segmented corpus have different numbers of lines." << std::endl;
+    return false;
+  }
+
+  // randomly use the part of corpus
+  std::mt19937_64 generator(seed);
+  const int64_t usage_sentence_num = static_cast<int64_t>(sentences.size() * usage_ratio);
+  const int64_t n_candidates = sentences.size() - usage_sentence_num;
+  const int64_t index = (n_candidates > 0) ? std::uniform_int_distribution<int64_t>(0, n_candidates - 1)(generator) : 0;
+  std::cout << "Train predictor with " << static_cast<int64_t>(usage_ratio * 100) << "% of the corpus ("
+            << usage_sentence_num << " sentences)" << std::endl;
+
+  std::wstring concat_sentence;
+  std::vector<double> labels;
+  for (int64_t i=index; i<index+usage_sentence_num; i++) {
+    const std::wstring sentence = clean(sentences[i]);
+    if (!label_sentence(sentence, clean(segmented_sentences[i]), labels)) {
+      std::cout << "Segmented corpus does not match the corpus at line " << i + 1 << "." << std::endl;
+      return false;
+    }
+    concat_sentence += sentence;
+  }
+  assert(labels.size() == concat_sentence.size());
+  std::vector<std::wstring>().swap(sentences);
+  std::vector<std::wstring>().swap(segmented_sentences);
+
+  // build X, Y for predictor
+  const int64_t i_begin = max_n;
+  const int64_t i_end = static_cast<int64_t>(concat_sentence.size()) - (max_n - 1);
+  const int64_t n_rows = std::max<int64_t>(0, i_end - i_begin);
+  if (n_rows == 0) {
+    std::cout << "Not enough sentences to train the predictor." << std::endl;
+    return false;
+  }
+  std::vector<double> X(n_rows * n_features);
+  std::vector<double> Y(labels.begin() + i_begin, labels.begin() + i_end);
+
+  std::vector<std::thread> vector_threads(n_cores);
+  for (int64_t k=0; k<n_cores; k++) {
+    vector_threads[k] = std::thread([&, k]() {
+      std::vector<std::wstring> lefts(max_n), rights(max_n);
+      std::wstring joined;
+      for (int64_t r=k*n_rows/n_cores; r<(k+1)*n_rows/n_cores; r++) {
+        compute_features(concat_sentence, i_begin + r, lefts, rights, joined, &X[r*n_features]);
+      }
+    });
+  }
+  for (auto& th : vector_threads) th.join();
+
+  // 90% of the positions, shuffled, train the model and the rest measures it
+  std::vector<int64_t> rows(n_rows);
+  for (int64_t r=0; r<n_rows; r++) rows[r] = r;
+  std::shuffle(rows.begin(), rows.end(), generator);
+  const int64_t n_test = static_cast<int64_t>(std::ceil(0.1 * n_rows));
+  const std::vector<int64_t> rows_train(rows.begin(), rows.end() - n_test);
+  const std::vector<int64_t> rows_test(rows.end() - n_test, rows.end());
+
+  fit(X, Y, rows_train);
+
+  int64_t n_correct = 0;
+  for (int64_t r : rows_test) {
+    if ((predict_proba(&X[r*n_features]) > 0.5) == (Y[r] > 0.5)) n_correct++;
+  }
+  std::cout << "Accuracy on held-out positions : "
+            << static_cast<double>(n_correct) / std::max<int64_t>(1, n_test) << std::endl;
+  return true;
+}
+
+double BoundaryPredictor::accumulate_newton(const std::vector<double>& X, const std::vector<double>& Y,
+                                            const std::vector<int64_t>& rows,
+                                            std::vector<double>& gradient, std::vector<double>& hessian) const
+{
+  const int64_t d = n_features + 1;
+  const int64_t n_rows = rows.size();
+  std::vector<std::vector<double>> gradients(n_cores, std::vector<double>(d, 0));
+  std::vector<std::vector<double>> hessians(n_cores, std::vector<double>(d * d, 0));
+  std::vector<double> losses(n_cores, 0);
+
+  std::vector<std::thread> vector_threads(n_cores);
+  for (int64_t k=0; k<n_cores; k++) {
+    vector_threads[k] = std::thread([&, k]() {
+      std::vector<double>& g = gradients[k];
+      std::vector<double>& H = hessians[k];
+      std::vector<double> x(d, 1);
+      for (int64_t r=k*n_rows/n_cores; r<(k+1)*n_rows/n_cores; r++) {
+        const double* row = &X[rows[r] * n_features];
+        std::copy(row, row + n_features, x.begin());
+        double z = 0;
+        for (int64_t j=0; j<d; j++) z += weights[j] * x[j];
+        const double p = 1.0 / (1.0 + std::exp(-z));
+        const double y = Y[rows[r]];
+        losses[k] += std::max(z, 0.0) + std::log1p(std::exp(-std::fabs(z))) - y * z;
+        const double residual = p - y;
+        const double s = p * (1 - p);
+        for (int64_t i=0; i<d; i++) {
+          g[i] += residual * x[i];
+          for (int64_t j=0; j<=i; j++) H[i*d+j] += s * x[i] * x[j];
+        }
+      }
+    });
+  }
+  for (auto& th : vector_threads) th.join();
+
+  gradient.assign(d, 0);
+  hessian.assign(d * d, 0);
+  double loss = 0;
+  for (int64_t k=0; k<n_cores; k++) {
+    loss += losses[k];
+    for (int64_t i=0; i<d; i++) gradient[i] += gradients[k][i];
+    for (int64_t i=0; i<d*d; i++) hessian[i] += hessians[k][i];
+  }
+  for (int64_t i=0; i<d; i++) {
+    for (int64_t j=0; j<i; j++) hessian[j*d+i] = hessian[i*d+j];
+  }
+
+  // L2 penalty with C = 1 on the coefficients, not on the intercept
+  for (int64_t j=0; j<n_features; j++) {
+    loss += 0.5 * weights[j] * weights[j];
+    gradient[j] += weights[j];
+    hessian[j*d+j] += 1;
+  }
+  return loss;
+}
+
+void BoundaryPredictor::fit(const std::vector<double>& X, const std::vector<double>& Y, const std::vector<int64_t>& rows)
+{
+  // Same objective as LogisticRegression() of scikit-learn, minimized with Newton's method;
+  // the step is halved while it increases the loss
+  const int64_t d = n_features + 1;
+  weights.assign(d, 0);
+  std::vector<double> gradient, hessian, step(d, 0), weights_previous(weights);
+  double loss_previous = INFINITY;
+  int64_t n_halving = 0;
+
+  for (int64_t iteration=0; iteration<MAX_ITERATION_NEWTON; iteration++) {
+    const double loss = accumulate_newton(X, Y, rows, gradient, hessian);
+    if (loss > loss_previous && n_halving < 30) {
+      n_halving++;
+      for (int64_t j=0; j<d; j++) {
+        step[j] *= 0.5;
+        weights[j] = weights_previous[j] - step[j];
+      }
+      continue;
+    }
+    n_halving = 0;
+
+    step = gradient;
+    solve_cholesky(hessian, step);
+    weights_previous = weights;
+    loss_previous = loss;
+    double max_step = 0, max_weight = 0;
+    for (int64_t j=0; j<d; j++) {
+      weights[j] -= step[j];
+      max_step = std::max(max_step, std::fabs(step[j]));
+      max_weight = std::max(max_weight, std::fabs(weights[j]));
+    }
+    if (max_step <= 1e-10 * (1 + max_weight)) break;
+  }
+
+  std::cout << "Coefficients :";
+  for (int64_t j=0; j<n_features; j++) std::cout << " " << weights[j];
+  std::cout << std::endl << "Intercept : " << weights[n_features] << std::endl;
+}
+
+void BoundaryPredictor::predict(const CorpusStore& corpus, std::vector<double>& word_boundary) const
+{
+  const int64_t length = corpus.size();
+  std::cout << "Prediction of word boundary starts (corpus length:" << length << ")" << std::endl;
+  word_boundary.assign(length, 1);
+
+  std::vector<std::thread> vector_threads(n_cores);
+  for (int64_t k=0; k<n_cores; k++) {
+    vector_threads[k] = std::thread([&, k]() {
+      std::vector<std::wstring> lefts(max_n), rights(max_n);
+      std::wstring joined;
+      std::vector<double> x(n_features);
+      const int64_t i_begin = std::max<int64_t>(1, k * length / n_cores);
+      for (int64_t i=i_begin; i<(k+1)*length/n_cores; i++) {
+        compute_features(corpus, i, lefts, rights, joined, x.data());
+        word_boundary[i] = predict_proba(x.data());
+      }
+    });
+  }
+  for (auto& th : vector_threads) th.join();
+
+  std::cout << "Calculation done. Word boundary samples from the head :";
+  for (int64_t i=0; i<std::min<int64_t>(10, length); i++) std::cout << " " << word_boundary[i];
+  std::cout << std::endl;
+}
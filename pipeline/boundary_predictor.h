@@ -0,0 +1,65 @@
+#ifndef BOUNDARY_PREDICTOR_H
+#define BOUNDARY_PREDICTOR_H
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <unordered_map>
+#include <random>
+#include <vector>
+#include <thread>
+
+#include "../common/utf8.h"
+#include "../common/mapped_file.h"
+#include "../common/corpus_store.h"
+
+#define MAX_ITERATION_NEWTON 100
+
+// C++ port of 3_logistic_regression/main.py : probabilistic predictor of word boundary.
+// The explanatory variables of position i are the associations
+//   log(count(s_a + t_b) * length_corpus / (count(s_a) * count(t_b)))
+// between the a characters before i and the b characters from i, for 1 <= a, b <= max_n,
+// with counts of the n-grams from stage 2 (1 when missing). A logistic regression trained
+// on a segmented sample of the corpus gives the probability that a word starts at i.
+class BoundaryPredictor {
+private:
+  const std::unordered_map<std::wstring, int64_t>& ngram_occurence;
+  const int64_t max_n;
+  const int64_t n_cores;
+
+  double length_corpus;
+  int64_t n_features;
+  std::vector<double> weights;  // n_features coefficients, then the intercept
+
+public:
+  BoundaryPredictor(const std::unordered_map<std::wstring, int64_t>& _ngram_occurence,
+                    const int64_t _max_n,
+                    const int64_t _n_cores);
+  ~BoundaryPredictor();
+  bool train(const CorpusStore& corpus,
+             const std::string raw_corpus_path,
+             const std::string segmented_corpus_path,
+             const double usage_ratio,
+             const int64_t seed);
+  void predict(const CorpusStore& corpus, std::vector<double>& word_boundary) const;
+
+private:
+  template <class Text>
+  void compute_features(const Text& text, const int64_t i,
+                        std::vector<std::wstring>& lefts,
+                        std::vector<std::wstring>& rights,
+                        std::wstring& joined,
+                        double* x) const;
+  int64_t occurence(const std::wstring& ngram) const;
+  void fit(const std::vector<double>& X, const std::vector<double>& Y, const std::vector<int64_t>& rows);
+  double accumulate_newton(const std::vector<double>& X, const std::vector<double>& Y,
+                           const std::vector<int64_t>& rows,
+                           std::vector<double>& gradient, std::vector<double>& hessian) const;
+  double predict_proba(const double* x) const;
+};
+
+#endif
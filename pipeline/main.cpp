@@ -0,0 +1,271 @@
+/*
+    Run stages 2 to 5 in one process : n-gram counting, word boundary prediction,
+    expected word frequency and SGNS-WNE, handing data over in memory
+*/
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <locale>
+#include <codecvt>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include "H5Cpp.h"
+#include "cmdline.h"
+#include "boundary_predictor.h"
+#include "../common/corpus_store.h"
+#include "../common/resource_usage.h"
+#include "../2_count_ngram_frequency/lossycounting.h"
+#include "../4_count_expected_word_frequency/counting_word.h"
+#include "../5_SGNS_WNE/skipgram.h"
+
+// Reads the "word_boundary" dataset written by 3_logistic_regression/main.py
+static bool load_word_boundary(const std::string path, std::vector<double>& word_boundary)
+{
+  try {
+    H5::H5File file(path, H5F_ACC_RDONLY);
+    H5::DataSet dataset = file.openDataSet("word_boundary");
+    H5::DataSpace dataspace = dataset.getSpace();
+    if (dataset.getTypeClass() != H5T_FLOAT || dataspace.getSimpleExtentNdims() != 1) return false;
+    hsize_t dims[1];
+    dataspace.getSimpleExtentDims(dims, NULL);
+    word_boundary.resize(dims[0]);
+    dataset.read(word_boundary.data(), H5::PredType::NATIVE_DOUBLE);
+    file.close();
+  } catch (const H5::Exception&) {
+    return false;
+  }
+  return true;
+}
+
+static bool save_word_boundary(const std::string path, const std::vector<double>& word_boundary)
+{
+  try {
+    H5::H5File file(path, H5F_ACC_TRUNC);
+    hsize_t dims[1] = {word_boundary.size()};
+    H5::DataSpace dataspace(1, dims);
+    H5::DataSet dataset = file.createDataSet("word_boundary", H5::PredType::IEEE_F64LE, dataspace);
+    dataset.write(word_boundary.data(), H5::PredType::NATIVE_DOUBLE);
+    file.close();
+  } catch (const H5::Exception&) {
+    return false;
+  }
+  return true;
+}
+
+static void print_usage(const std::vector<StageUsage>& usages)
+{
+  std::cout << std::endl << "###### Resource usage ######" << std::endl;
+  std::cout << std::left << std::setw(32) << "stage"
+            << std::right << std::setw(12) << "time (s)"
+            << std::setw(18) << "peak RSS (MiB)" << std::endl;
+  for (const StageUsage& usage : usages) {
+    std::cout << std::left << std::setw(32) << usage.name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(2) << usage.seconds
+              << std::setw(18) << std::setprecision(1) << usage.peak_bytes / 1048576.0
+              << (usage.is_peak_of_stage ? "" : " (process)") << std::endl;
+  }
+  std::cout.unsetf(std::ios::floatfield);
+}
+
+int main(int argc, char* argv[]) {
+
+  // handling wide string
+  std::ios_base::sync_with_stdio(false);
+  std::locale default_loc("en_US.UTF-8");
+  std::locale::global(default_loc);
+  std::locale ctype_default(std::locale::classic(), default_loc, std::locale::ctype);
+  std::wcout.imbue(ctype_default);
+  std::wcin.imbue(ctype_default);
+
+  // parsing parameters https://github.com/tanakh/cmdline
+  cmdline::parser a;
+  a.add<std::string>("corpus_path", '\0', "pre-processed corpus path (UTF-8 text or corpus store)", true);
+  a.add<std::string>("output_path", '\0', "output path of the embeddings", true);
+  a.add<int64_t>("n_core", '\0', "n_core", true);
+  // 2_count_ngram_frequency
+  a.add<int64_t>("max_ngram_size", '\0', "max_ngram_size", false, 4);
+  a.add<double>("support_threshold", '\0', "support threshold", false, 1e-7);
+  a.add<double>("epsilon", '\0', "epsilon", false, 1e-7);
+  // 3_logistic_regression
+  a.add<std::string>("raw_corpus_path", '\0', "corpus before pre-processing, one sentence per line", false);
+  a.add<std::string>("segmented_corpus_path", '\0', "segmented sentences of raw_corpus_path", false);
+  a.add<std::string>("boundary_path", '\0', "precomputed word boundary (HDF5) used instead of training a predictor", false);
+  a.add<double>("usage_ratio", '\0', "ratio of sentences used to train the predictor", false, 0.1);
+  a.add<int64_t>("random_seed", '\0', "seed of the predictor", false, 2018);
+  a.add<int64_t>("max_n", '\0', "length of the n-grams the predictor looks at", false, 4);
+  // 4_count_expected_word_frequency
+  a.add<int64_t>("max_word_length", '\0', "max_word_length", false, 4);
+  a.add<int64_t>("extract_num", '\0', "extract_num", false, 1000000);
+  // 5_SGNS_WNE
+  a.add<int64_t>("embed_num", '\0', "embed_num", false, 1000000);
+  a.add<int64_t>("size_window", '\0', "size_window", false, 1);
+  a.add<int64_t>("dim_embedding", '\0', "dim_embedding", false, 200);
+  a.add<int64_t>("seed", '\0', "seed", false, 2018);
+  a.add<int64_t>("n_iteration", '\0', "n_iteration", false, 10);
+  a.add<int64_t>("n_negative_sample", '\0', "n_negative_sample", false, 5);
+  a.add<double>("learning_rate", '\0', "learning_rate", false, 0.025);
+  a.add<double>("rate_sample", '\0', "rate_sample", false, 0.0001);
+  a.add<double>("power_unigram_table", '\0', "power_unigram_table", false, 0.75);
+  a.add<std::string>("output_format", '\0', "text (word2vec), binary (word2vec), npy, int8 or pq", false, "text");
+  a.add<int64_t>("pq_subspaces", '\0', "subspaces of the pq output format (0: one per 4 dimensions)", false, 0);
+  a.add<int64_t>("pq_iteration", '\0', "k-means iterations of the pq output format", false, 10);
+  a.add<int64_t>("quantization_report_query", '\0', "words whose neighbours are compared after int8 or pq quantization (0: no report)", false, 100);
+  a.add("save_contexts", '\0', "also save the left and right context embeddings");
+  // Intermediate results, written only on request
+  a.add<std::string>("save_ngram_count_path", '\0', "write the counted n-grams as 2_count_ngram_frequency does", false);
+  a.add<std::string>("save_boundary_path", '\0', "write the word boundary as 3_logistic_regression does", false);
+  a.add<std::string>("save_word_count_path", '\0', "write the word-like n-grams as 4_count_expected_word_frequency does", false);
+  a.parse_check(argc, argv);
+  std::string corpus_path = a.get<std::string>("corpus_path");
+  std::string output_path = a.get<std::string>("output_path");
+  int64_t n_core = a.get<int64_t>("n_core");
+  int64_t max_ngram_size = a.get<int64_t>("max_ngram_size");
+  double support_threshold = a.get<double>("support_threshold");
+  double epsilon = a.get<double>("epsilon");
+  std::string raw_corpus_path = a.get<std::string>("raw_corpus_path");
+  std::string segmented_corpus_path = a.get<std::string>("segmented_corpus_path");
+  std::string boundary_path = a.get<std::string>("boundary_path");
+  double usage_ratio = a.get<double>("usage_ratio");
+  int64_t random_seed = a.get<int64_t>("random_seed");
+  int64_t max_n = a.get<int64_t>("max_n");
+  int64_t max_word_length = a.get<int64_t>("max_word_length");
+  int64_t extract_num = a.get<int64_t>("extract_num");
+  int64_t embed_num = a.get<int64_t>("embed_num");
+  int64_t size_window = a.get<int64_t>("size_window");
+  int64_t dim_embedding = a.get<int64_t>("dim_embedding");
+  int64_t seed = a.get<int64_t>("seed");
+  int64_t n_iteration = a.get<int64_t>("n_iteration");
+  int64_t n_negative_sample = a.get<int64_t>("n_negative_sample");
+  double learning_rate = a.get<double>("learning_rate");
+  double rate_sample = a.get<double>("rate_sample");
+  double power_unigram_table = a.get<double>("power_unigram_table");
+  std::string output_format = a.get<std::string>("output_format");
+  bool save_contexts = a.exist("save_contexts");
+  int64_t pq_subspaces = a.get<int64_t>("pq_subspaces");
+  int64_t pq_iteration = a.get<int64_t>("pq_iteration");
+  int64_t quantization_report_query = a.get<int64_t>("quantization_report_query");
+  std::string save_ngram_count_path = a.get<std::string>("save_ngram_count_path");
+  std::string save_boundary_path = a.get<std::string>("save_boundary_path");
+  std::string save_word_count_path = a.get<std::string>("save_word_count_path");
+
+  if (!SkipGram::is_valid_output_format(output_format)) {
+    std::cout << "Invalid output format." << std::endl;
+    return 0;
+  }
+  if (pq_subspaces < 0 || pq_subspaces > dim_embedding || pq_iteration < 0 || quantization_report_query < 0) {
+    std::cout << "Invalid quantization settings." << std::endl;
+    return 0;
+  }
+  if (boundary_path.empty() && (raw_corpus_path.empty() || segmented_corpus_path.empty())) {
+    std::cout << "Either boundary_path or raw_corpus_path and segmented_corpus_path are needed." << std::endl;
+    return 0;
+  }
+
+  std::vector<StageUsage> usages;
+
+  // Load corpus once for every stage
+  usages.push_back(StageUsage("load corpus"));
+  usages.back().start();
+  CorpusStore corpus;
+  if (!corpus.load(corpus_path, n_core)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  usages.back().stop();
+
+  // 2. Extract frequently-used n-grams using lossy counting algorithm
+  usages.push_back(StageUsage("2 count n-grams"));
+  usages.back().start();
+  std::unordered_map<std::wstring, int64_t> ngram_occurence;
+  {
+    LossyCountingNgram counter(corpus, max_ngram_size, support_threshold, epsilon, n_core);
+    counter.count_ngram();
+    if (!save_ngram_count_path.empty()) counter.extract_all_ngram_to_csv(save_ngram_count_path);
+    counter.extract_all_ngram(ngram_occurence);
+  }
+  usages.back().stop();
+
+  // 3. Predict word boundary
+  usages.push_back(StageUsage("3 predict word boundary"));
+  usages.back().start();
+  std::vector<double> word_boundary;
+  if (!boundary_path.empty()) {
+    if (!load_word_boundary(boundary_path, word_boundary)) {
+      std::cout << "Invalid file name." << std::endl;
+      return 0;
+    }
+  } else {
+    BoundaryPredictor predictor(ngram_occurence, max_n, n_core);
+    if (!predictor.train(corpus, raw_corpus_path, segmented_corpus_path, usage_ratio, random_seed)) return 0;
+    predictor.predict(corpus, word_boundary);
+  }
+  if (word_boundary.size() != corpus.size()) {
+    std::cout << "Word boundary does not match the corpus." << std::endl;
+    return 0;
+  }
+  if (!save_boundary_path.empty()) {
+    std::cout << "Saving word boundary to " << save_boundary_path << std::endl;
+    if (!save_word_boundary(save_boundary_path, word_boundary)) {
+      std::cout << "Invalid file name." << std::endl;
+      return 0;
+    }
+    std::cout << "Done" << std::endl;
+  }
+  usages.back().stop();
+
+  // 4. Count expected word frequency and extract word-like n-grams
+  usages.push_back(StageUsage("4 count expected word freq."));
+  usages.back().start();
+  std::vector<std::pair<std::wstring, double>> words;
+  {
+    CountingWord wordcounter(corpus, word_boundary, max_word_length, extract_num, n_core);
+    wordcounter.count_word();
+    wordcounter.extract_top_word(words, extract_num);
+    if (!save_word_count_path.empty()) {
+      std::cout << "Saving word-like ngrams to " << save_word_count_path << std::endl;
+      if (!CountingWord::write_word_to_csv(save_word_count_path, words, n_core)) {
+        std::cout << "Invalid file name." << std::endl;
+        return 0;
+      }
+      std::cout << "Done" << std::endl;
+    }
+  }
+  std::vector<double>().swap(word_boundary);
+  usages.back().stop();
+
+  // 5. Word embedding of the top `embed_num` words, counted as in the n-gram table
+  usages.push_back(StageUsage("5 SGNS-WNE"));
+  usages.back().start();
+  std::vector<std::wstring> vocabulary;
+  std::vector<int64_t> count_vocabulary;
+  for (int64_t i=0; i<std::min<int64_t>(embed_num, words.size()); i++) {
+    vocabulary.push_back(words[i].first);
+    const auto it = ngram_occurence.find(words[i].first);
+    count_vocabulary.push_back((it == ngram_occurence.end()) ? 1 : it->second);
+  }
+  std::vector<std::pair<std::wstring, double>>().swap(words);
+  std::unordered_map<std::wstring, int64_t>().swap(ngram_occurence);
+  {
+    SkipGram sg(corpus, vocabulary, count_vocabulary,
+                size_window, dim_embedding, seed,
+                n_iteration, n_negative_sample, n_core,
+                learning_rate, rate_sample, power_unigram_table);
+    sg.set_quantization(pq_subspaces, pq_iteration, quantization_report_query);
+    sg.train();
+    sg.save_vector(output_path, output_format);
+    if (save_contexts) {
+      sg.save_context_vector(output_path, output_format);
+    }
+  }
+  usages.back().stop();
+
+  print_usage(usages);
+
+  return 0;
+}
@@ -0,0 +1,30 @@
+#!/bin/bash
+set -e
+K=100000
+CORPUS="../data/sample_processed.txt"
+RAW="../data/sample.txt"
+SEGMENTED="../data/sample_segmented.txt"
+OUTPUT="../data/embeddings.txt"
+make
+./main --corpus_path=$CORPUS \
+       --raw_corpus_path=$RAW \
+       --segmented_corpus_path=$SEGMENTED \
+       --output_path=$OUTPUT \
+       --max_ngram_size=4 \
+       --support_threshold=1e-7 \
+       --epsilon=1e-7 \
+       --usage_ratio=0.1 \
+       --random_seed=2018 \
+       --max_n=4 \
+       --max_word_length=4 \
+       --extract_num=$K \
+       --embed_num=$K \
+       --size_window=1 \
+       --dim_embedding=50 \
+       --seed=2018 \
+       --n_iteration=5 \
+       --n_negative_sample=10 \
+       --n_core=8 \
+       --learning_rate=0.05 \
+       --rate_sample=0.0001 \
+       --power_unigram_table=0.75
@@ -0,0 +1,185 @@
+#include "embedding_table.h"
+
+// "n dim\n" at the head of the text and binary formats
+static const char* parse_header(const char* p, const char* end, int64_t& n_rows, int64_t& dim)
+{
+  const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+  if (eol == nullptr) return nullptr;
+  char* q;
+  n_rows = std::strtoll(p, &q, 10);
+  dim = std::strtoll(q, &q, 10);
+  if (q != eol || n_rows < 0 || dim <= 0) return nullptr;
+  return eol + 1;
+}
+
+EmbeddingTable::EmbeddingTable() : matrix(nullptr), n_rows(0), dim(0), is_quantized_table(false) {}
+
+EmbeddingTable::~EmbeddingTable() {}
+
+bool EmbeddingTable::load(const std::string path, const std::string format, const int64_t n_threads)
+{
+  if (format == "int8" || format == "pq") {
+    const int64_t type = (format == "int8") ? QUANTIZED_INT8 : QUANTIZED_PQ;
+    if (!quantized.load(path, n_threads, words) || quantized.get_type() != type) return false;
+    is_quantized_table = true;
+    n_rows = quantized.size();
+    dim = quantized.get_dim();
+    index_words();
+    return true;
+  }
+
+  if (!file.open(path) || file.size() == 0) return false;
+  bool is_valid = false;
+  if (format == "text") is_valid = parse_text(n_threads);
+  else if (format == "binary") is_valid = parse_binary();
+  else if (format == "npy") is_valid = parse_npy(path);
+  if (!is_valid) return false;
+
+  inverse_norms.resize(n_rows);
+  run_ranges(n_rows, n_threads, [this](const int64_t begin, const int64_t end) {
+    for (int64_t i=begin; i<end; i++) {
+      const float norm = std::sqrt(dot(row(i), row(i), dim));
+      inverse_norms[i] = (norm > 0) ? 1 / norm : 0;
+    }
+  }, SIZE_RANGE_PARSE);
+  index_words();
+  return true;
+}
+
+bool EmbeddingTable::parse_text(const int64_t n_threads)
+{
+  const char* data = file.data();
+  const char* end = data + file.size();
+  // Every row ends with a newline, which bounds the scans of the words and values
+  if (end[-1] != '\n') return false;
+  const char* p = parse_header(data, end, n_rows, dim);
+  if (p == nullptr) return false;
+
+  std::vector<const char*> starts;
+  starts.reserve(n_rows + 1);
+  while (p < end && starts.size() < n_rows) {
+    starts.push_back(p);
+    p = static_cast<const char*>(std::memchr(p, '\n', end - p)) + 1;
+  }
+  if (starts.size() != n_rows) return false;
+  starts.push_back(p);
+
+  matrix_owned.resize(n_rows * dim);
+  words.resize(n_rows);
+  std::vector<char> is_row_valid(n_rows, 1);
+  run_ranges(n_rows, n_threads, [&](const int64_t begin, const int64_t end) {
+    for (int64_t i=begin; i<end; i++) {
+      const char* q = starts[i];
+      const char* space = q;
+      while (*space != ' ' && *space != '\n') space++;
+      words[i].assign(q, space);
+      float* v = matrix_owned.data() + i * dim;
+      const char* eol = starts[i+1] - 1;
+      char* r = const_cast<char*>(space);
+      for (int64_t j=0; j<dim; j++) {
+        // strtof would skip the newline and read the next row, or past the mapping
+        // after the last one : a short row ends here
+        while (r < eol && (*r == ' ' || *r == '\t' || *r == '\r')) r++;
+        char* next;
+        if (r >= eol || (v[j] = std::strtof(r, &next), next == r)) {
+          is_row_valid[i] = 0;
+          break;
+        }
+        r = next;
+      }
+    }
+  }, SIZE_RANGE_PARSE);
+  if (std::find(is_row_valid.begin(), is_row_valid.end(), 0) != is_row_valid.end()) return false;
+  matrix = matrix_owned.data();
+  return true;
+}
+
+bool EmbeddingTable::parse_binary()
+{
+  const char* data = file.data();
+  const char* end = data + file.size();
+  const char* p = parse_header(data, end, n_rows, dim);
+  if (p == nullptr) return false;
+
+  // The float32 values may contain any byte, so the rows are found one after another
+  const int64_t size_vector = dim * sizeof(float);
+  matrix_owned.resize(n_rows * dim);
+  words.resize(n_rows);
+  for (int64_t i=0; i<n_rows; i++) {
+    const char* space = static_cast<const char*>(std::memchr(p, ' ', end - p));
+    if (space == nullptr || end - (space + 1) < size_vector) return false;
+    words[i].assign(p, space);
+    std::memcpy(matrix_owned.data() + i * dim, space + 1, size_vector);
+    p = space + 1 + size_vector;
+    if (p < end && *p == '\n') p++;
+  }
+  matrix = matrix_owned.data();
+  return true;
+}
+
+bool EmbeddingTable::parse_npy(const std::string path)
+{
+  const char* data = file.data();
+  const int64_t size = file.size();
+  if (size < 10 || std::memcmp(data, "\x93NUMPY\x01\x00", 8) != 0) return false;
+  const int64_t length_header = static_cast<unsigned char>(data[8]) | (static_cast<unsigned char>(data[9]) << 8);
+  if (10 + length_header > size) return false;
+  const std::string dict(data + 10, length_header);
+  if (dict.find("'<f4'") == std::string::npos || dict.find("'fortran_order': False") == std::string::npos) return false;
+  const size_t pos_shape = dict.find("'shape': (");
+  if (pos_shape == std::string::npos) return false;
+  char* q;
+  n_rows = std::strtoll(dict.c_str() + pos_shape + 10, &q, 10);
+  if (*q != ',') return false;
+  dim = std::strtoll(q + 1, &q, 10);
+  if (n_rows < 0 || dim <= 0 || 10 + length_header + n_rows * dim * static_cast<int64_t>(sizeof(float)) > size) return false;
+  // The header is padded to 64 bytes, so the rows are aligned in the mapping
+  matrix = reinterpret_cast<const float*>(data + 10 + length_header);
+
+  MappedFile file_vocab;
+  if (!file_vocab.open(path + ".vocab")) return false;
+  const char* p = file_vocab.data();
+  const char* end = p + file_vocab.size();
+  words.resize(n_rows);
+  for (int64_t i=0; i<n_rows; i++) {
+    if (p >= end) return false;
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    words[i].assign(p, eol);
+    p = eol + 1;
+  }
+  return true;
+}
+
+void EmbeddingTable::index_words()
+{
+  word2id.reserve(n_rows);
+  // A word listed twice maps to its last id, as in the VocabularyTable of training and inference
+  for (int64_t i=0; i<n_rows; i++) word2id[words[i]] = i;
+}
+
+int64_t EmbeddingTable::find(const std::string& word) const
+{
+  const auto it = word2id.find(word);
+  return (it == word2id.end()) ? -1 : it->second;
+}
+
+void EmbeddingTable::normalized_row(const int64_t id, float* out) const
+{
+  if (is_quantized_table) {
+    quantized.decode(id, out);
+    const float norm = std::sqrt(dot(out, out, dim));
+    for (int64_t j=0; j<dim; j++) out[j] = (norm > 0) ? out[j] / norm : 0;
+    return;
+  }
+  const float* v = row(id);
+  const float scale = inverse_norms[id];
+  for (int64_t j=0; j<dim; j++) out[j] = v[j] * scale;
+}
+
+uint64_t EmbeddingTable::hash_words() const
+{
+  uint64_t h = hash_bytes(reinterpret_cast<const char*>(&dim), sizeof(dim), n_rows);
+  for (const std::string& word : words) h = hash_bytes(word.data(), word.size(), h);
+  return h;
+}
@@ -0,0 +1,72 @@
+#ifndef EMBEDDING_TABLE_H
+#define EMBEDDING_TABLE_H
+
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+
+#include "simd_dot.h"
+#include "../common/mapped_file.h"
+#include "../common/fingerprint.h"
+#include "../common/quantizer.h"
+#include "../common/parallel_ranges.h"
+
+// Rows parsed by a thread at least
+#define SIZE_RANGE_PARSE 1024
+
+// Embeddings written by SkipGram::save_vector, as float32 rows with UTF-8 words.
+// The npy format is used in place from the memory-mapped file; text and binary
+// (word2vec) files are mapped and parsed in parallel into an owned matrix.
+// The int8 and pq formats stay quantized : row() is not available and queries are
+// compared with the codes through get_quantized().
+class EmbeddingTable {
+private:
+  MappedFile file;
+  std::vector<float> matrix_owned;
+  const float* matrix;
+  int64_t n_rows;
+  int64_t dim;
+  std::vector<std::string> words;
+  std::vector<float> inverse_norms;
+  std::unordered_map<std::string, int64_t> word2id;
+  QuantizedMatrix quantized;
+  bool is_quantized_table;
+
+public:
+  EmbeddingTable();
+  ~EmbeddingTable();
+  // `format` is "text", "binary", "npy", "int8" or "pq" as in --output_format of 5_SGNS_WNE
+  bool load(const std::string path, const std::string format, const int64_t n_threads);
+
+  int64_t size() const { return n_rows; }
+  int64_t get_dim() const { return dim; }
+  const float* row(const int64_t id) const { return matrix + id * dim; }
+  float inverse_norm(const int64_t id) const { return inverse_norms[id]; }
+  const std::string& word(const int64_t id) const { return words[id]; }
+  bool is_quantized() const { return is_quantized_table; }
+  const QuantizedMatrix& get_quantized() const { return quantized; }
+  // -1 if `word` is not in the table
+  int64_t find(const std::string& word) const;
+  // Copies row `id` scaled to unit length into `out`
+  void normalized_row(const int64_t id, float* out) const;
+  // Identifies the vocabulary, to check that an index was built on this table
+  uint64_t hash_words() const;
+
+private:
+  bool parse_text(const int64_t n_threads);
+  bool parse_binary();
+  bool parse_npy(const std::string path);
+  void index_words();
+
+  EmbeddingTable(const EmbeddingTable&);
+  EmbeddingTable& operator=(const EmbeddingTable&);
+};
+
+#endif
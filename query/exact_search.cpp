@@ -0,0 +1,40 @@
+#include "exact_search.h"
+
+void search_exact(const EmbeddingTable& table,
+                  const float* queries,
+                  const int64_t n_queries,
+                  const int64_t* ids_excluded,
+                  const int64_t k,
+                  std::vector<std::vector<Neighbor>>& results)
+{
+  const int64_t dim = table.get_dim();
+  const int64_t n_rows = table.size();
+  results.resize(n_queries);
+
+  for (int64_t begin=0; begin<n_queries; begin+=SIZE_TILE_QUERY) {
+    const int64_t n_tile = std::min<int64_t>(SIZE_TILE_QUERY, n_queries - begin);
+    std::vector<TopK> tops(n_tile, TopK(k));
+    if (table.is_quantized()) {
+      const QuantizedMatrix& quantized = table.get_quantized();
+      std::vector<std::vector<float>> prepared(n_tile);
+      for (int64_t t=0; t<n_tile; t++) quantized.prepare(queries + (begin + t) * dim, prepared[t]);
+      for (int64_t id=0; id<n_rows; id++) {
+        for (int64_t t=0; t<n_tile; t++) {
+          const float similarity = quantized.similarity(prepared[t].data(), id);
+          if (similarity >= tops[t].threshold() && id != ids_excluded[begin + t]) tops[t].push(id, similarity);
+        }
+      }
+      for (int64_t t=0; t<n_tile; t++) tops[t].extract(results[begin + t]);
+      continue;
+    }
+    for (int64_t id=0; id<n_rows; id++) {
+      const float* v = table.row(id);
+      const float inverse_norm = table.inverse_norm(id);
+      for (int64_t t=0; t<n_tile; t++) {
+        const float similarity = dot(queries + (begin + t) * dim, v, dim) * inverse_norm;
+        if (similarity >= tops[t].threshold() && id != ids_excluded[begin + t]) tops[t].push(id, similarity);
+      }
+    }
+    for (int64_t t=0; t<n_tile; t++) tops[t].extract(results[begin + t]);
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef EXACT_SEARCH_H
+#define EXACT_SEARCH_H
+
+#include <cmath>
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+#include "embedding_table.h"
+
+// Number of queries compared with each row while it is in cache
+#define SIZE_TILE_QUERY 8
+
+struct Neighbor {
+  int64_t id;
+  float similarity;
+};
+
+inline bool is_more_similar(const Neighbor& a, const Neighbor& b)
+{
+  return a.similarity > b.similarity || (a.similarity == b.similarity && a.id < b.id);
+}
+
+// Keeps the k most similar rows seen so far
+class TopK {
+private:
+  const int64_t k;
+  std::vector<Neighbor> heap;  // ordered by is_more_similar : the least similar is at the front
+
+public:
+  explicit TopK(const int64_t _k) : k(_k)
+  {
+    assert(k > 0);
+    heap.reserve(k + 1);
+  }
+
+  // Lowest similarity a new row needs to enter
+  float threshold() const { return (heap.size() < k) ? -INFINITY : heap.front().similarity; }
+
+  void push(const int64_t id, const float similarity)
+  {
+    if (heap.size() == k && !is_more_similar(Neighbor{id, similarity}, heap.front())) return;
+    heap.push_back(Neighbor{id, similarity});
+    std::push_heap(heap.begin(), heap.end(), is_more_similar);
+    if (heap.size() > k) {
+      std::pop_heap(heap.begin(), heap.end(), is_more_similar);
+      heap.pop_back();
+    }
+  }
+
+  // Most similar first
+  void extract(std::vector<Neighbor>& result)
+  {
+    result = heap;
+    std::sort(result.begin(), result.end(), is_more_similar);
+  }
+};
+
+// Cosine top-k of n_queries unit-length queries (row-major, table.get_dim() wide) by a
+// full scan of the table, on the codes when it is quantized. Row `ids_excluded[i]` (-1 for none) is left out of the
+// results of query i, e.g. the query word itself.
+void search_exact(const EmbeddingTable& table,
+                  const float* queries,
+                  const int64_t n_queries,
+                  const int64_t* ids_excluded,
+                  const int64_t k,
+                  std::vector<std::vector<Neighbor>>& results);
+
+#endif
@@ -0,0 +1,329 @@
+#include "hnsw_index.h"
+
+HnswIndex::HnswIndex(const EmbeddingTable& _table)
+  : table(_table),
+    dim(_table.get_dim()),
+    M(0),
+    max_links0(0),
+    ef_construction(0),
+    entry_point(-1),
+    max_level(-1),
+    is_building(false)
+{
+  assert(table.size() < INT32_MAX);
+}
+
+HnswIndex::~HnswIndex() {}
+
+int32_t* HnswIndex::links(const int64_t id, const int64_t level)
+{
+  if (level == 0) return links0.data() + id * (1 + max_links0);
+  return links_upper[id].data() + (level - 1) * (1 + M);
+}
+
+const int32_t* HnswIndex::links(const int64_t id, const int64_t level) const
+{
+  if (level == 0) return links0.data() + id * (1 + max_links0);
+  return links_upper[id].data() + (level - 1) * (1 + M);
+}
+
+void HnswIndex::read_links(const int64_t id, const int64_t level, std::vector<int32_t>& out) const
+{
+  std::unique_lock<std::mutex> lock;
+  if (is_building) lock = std::unique_lock<std::mutex>(mtx_links[id]);
+  const int32_t* l = links(id, level);
+  out.assign(l + 1, l + 1 + l[0]);
+}
+
+void HnswIndex::build(const int64_t _M, const int64_t _ef_construction, const int64_t seed, const int64_t n_threads)
+{
+  assert(_M > 1);
+  assert(_ef_construction > 0);
+  assert(n_threads > 0);
+  const int64_t n_rows = table.size();
+  M = _M;
+  max_links0 = 2 * M;
+  ef_construction = _ef_construction;
+
+  // P(level >= l) = M^-l
+  std::mt19937_64 engine(seed);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  const double mult_level = 1 / std::log(static_cast<double>(M));
+  levels.resize(n_rows);
+  links_upper.assign(n_rows, std::vector<int32_t>());
+  for (int64_t id=0; id<n_rows; id++) {
+    levels[id] = static_cast<int32_t>(-std::log(1 - uniform(engine)) * mult_level);
+    links_upper[id].assign(levels[id] * (1 + M), 0);
+  }
+  links0.assign(n_rows * (1 + max_links0), 0);
+  if (n_rows == 0) return;
+
+  mtx_links.reset(new std::mutex[n_rows]);
+  is_building = true;
+  entry_point = 0;
+  max_level = levels[0];
+
+  std::atomic<int64_t> id_next(1);
+  std::vector<std::thread> vector_threads(n_threads);
+  for (auto& t : vector_threads) {
+    t = std::thread([&]() {
+      VisitedSet visited(n_rows);
+      std::vector<float> query(dim);
+      for (int64_t id=id_next++; id<n_rows; id=id_next++) insert(id, visited, query);
+    });
+  }
+  for (auto& t : vector_threads) t.join();
+  is_building = false;
+  mtx_links.reset();
+}
+
+void HnswIndex::insert(const int64_t id, VisitedSet& visited, std::vector<float>& query)
+{
+  table.normalized_row(id, query.data());
+  const int64_t level = levels[id];
+
+  // A row above the top layer becomes the entry point; other such rows wait for it
+  std::unique_lock<std::mutex> lock_entry(mtx_entry);
+  const int64_t level_top = max_level;
+  int64_t id_current = entry_point;
+  if (level <= level_top) lock_entry.unlock();
+
+  if (level_top > level) id_current = search_greedy(query.data(), id_current, level_top, level + 1);
+  std::vector<Neighbor> found;
+  for (int64_t l=std::min(level, level_top); l>=0; l--) {
+    search_layer(query.data(), id_current, ef_construction, l, visited, found);
+    id_current = found[0].id;
+    select_neighbors(found, M);
+    link(id, l, found);
+  }
+
+  if (level > level_top) {
+    entry_point = id;
+    max_level = level;
+  }
+}
+
+int64_t HnswIndex::search_greedy(const float* query, int64_t id_entry, const int64_t level_top, const int64_t level_bottom) const
+{
+  float similarity_current = similarity(query, id_entry);
+  std::vector<int32_t> neighbors;
+  for (int64_t l=level_top; l>=level_bottom; l--) {
+    bool is_changed = true;
+    while (is_changed) {
+      is_changed = false;
+      read_links(id_entry, l, neighbors);
+      for (const int32_t n : neighbors) {
+        const float s = similarity(query, n);
+        if (s > similarity_current) {
+          similarity_current = s;
+          id_entry = n;
+          is_changed = true;
+        }
+      }
+    }
+  }
+  return id_entry;
+}
+
+void HnswIndex::search_layer(const float* query,
+                             const int64_t id_entry,
+                             const int64_t ef,
+                             const int64_t level,
+                             VisitedSet& visited,
+                             std::vector<Neighbor>& found) const
+{
+  typedef std::pair<float, int64_t> Item;
+  // Rows to expand, most similar on top, and the ef best rows, least similar on top
+  std::priority_queue<Item> candidates;
+  std::priority_queue<Item, std::vector<Item>, std::greater<Item>> best;
+
+  visited.clear();
+  visited.visit(id_entry);
+  const float similarity_entry = similarity(query, id_entry);
+  candidates.emplace(similarity_entry, id_entry);
+  best.emplace(similarity_entry, id_entry);
+
+  std::vector<int32_t> neighbors;
+  while (!candidates.empty()) {
+    const Item c = candidates.top();
+    if (c.first < best.top().first && best.size() >= ef) break;
+    candidates.pop();
+    read_links(c.second, level, neighbors);
+    for (const int32_t n : neighbors) {
+      if (!visited.visit(n)) continue;
+      const float s = similarity(query, n);
+      if (best.size() < ef || s > best.top().first) {
+        candidates.emplace(s, n);
+        best.emplace(s, n);
+        if (best.size() > ef) best.pop();
+      }
+    }
+  }
+
+  found.resize(best.size());
+  for (int64_t i=best.size()-1; i>=0; i--) {
+    found[i] = Neighbor{best.top().second, best.top().first};
+    best.pop();
+  }
+}
+
+void HnswIndex::select_neighbors(std::vector<Neighbor>& candidates, const int64_t m) const
+{
+  if (candidates.size() <= m) return;
+  std::vector<Neighbor> kept;
+  kept.reserve(m);
+  for (const Neighbor& c : candidates) {
+    if (kept.size() >= m) break;
+    bool is_diverse = true;
+    for (const Neighbor& r : kept) {
+      const float s = similarity_rows(c.id, r.id);
+      if (s > c.similarity) {
+        is_diverse = false;
+        break;
+      }
+    }
+    if (is_diverse) kept.push_back(c);
+  }
+  candidates.swap(kept);
+}
+
+void HnswIndex::link(const int64_t id, const int64_t level, const std::vector<Neighbor>& neighbors)
+{
+  const int64_t max_links = (level == 0) ? max_links0 : M;
+  {
+    std::lock_guard<std::mutex> lock(mtx_links[id]);
+    int32_t* l = links(id, level);
+    l[0] = neighbors.size();
+    for (int64_t i=0; i<neighbors.size(); i++) l[1+i] = neighbors[i].id;
+  }
+
+  std::vector<Neighbor> candidates;
+  for (const Neighbor& neighbor : neighbors) {
+    const int64_t n = neighbor.id;
+    std::lock_guard<std::mutex> lock(mtx_links[n]);
+    int32_t* l = links(n, level);
+    if (l[0] < max_links) {
+      l[1+l[0]] = id;
+      l[0]++;
+      continue;
+    }
+
+    // The list of n is full : keep the best max_links of it and `id`
+    candidates.clear();
+    candidates.push_back(neighbor);
+    candidates.back().id = id;
+    for (int64_t i=0; i<l[0]; i++) {
+      candidates.push_back(Neighbor{l[1+i], similarity_rows(n, l[1+i])});
+    }
+    std::sort(candidates.begin(), candidates.end(), is_more_similar);
+    select_neighbors(candidates, max_links);
+    l[0] = candidates.size();
+    for (int64_t i=0; i<candidates.size(); i++) l[1+i] = candidates[i].id;
+  }
+}
+
+void HnswIndex::search(const float* query,
+                       const int64_t k,
+                       const int64_t ef_search,
+                       const int64_t id_excluded,
+                       VisitedSet& visited,
+                       std::vector<Neighbor>& result) const
+{
+  result.clear();
+  if (empty()) return;
+  int64_t id_current = entry_point;
+  if (max_level > 0) id_current = search_greedy(query, id_current, max_level, 1);
+  search_layer(query, id_current, std::max(ef_search, k + (id_excluded >= 0)), 0, visited, result);
+
+  result.erase(std::remove_if(result.begin(), result.end(),
+                              [id_excluded](const Neighbor& n) { return n.id == id_excluded; }),
+               result.end());
+  if (result.size() > k) result.resize(k);
+}
+
+bool HnswIndex::save(const std::string path) const
+{
+  std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) return false;
+  const int64_t header[] = {table.size(), dim, M, max_links0, ef_construction, entry_point, max_level};
+  const uint64_t hash = table.hash_words();
+  fout.write(HNSW_MAGIC, 8);
+  fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+  fout.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+  fout.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(int32_t));
+  fout.write(reinterpret_cast<const char*>(links0.data()), links0.size() * sizeof(int32_t));
+  for (const auto& l : links_upper) {
+    fout.write(reinterpret_cast<const char*>(l.data()), l.size() * sizeof(int32_t));
+  }
+  fout.close();
+  return !fout.fail();
+}
+
+bool HnswIndex::load(const std::string path)
+{
+  std::ifstream fin(path, std::ios::binary);
+  if (!fin.is_open()) return false;
+  char magic[8];
+  int64_t header[7];
+  uint64_t hash;
+  fin.read(magic, 8);
+  fin.read(reinterpret_cast<char*>(header), sizeof(header));
+  fin.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+  if (!fin || std::memcmp(magic, HNSW_MAGIC, 8) != 0) return false;
+  if (header[0] != table.size() || header[1] != dim || hash != table.hash_words()) {
+    std::cout << path << " was built on other embeddings." << std::endl;
+    return false;
+  }
+
+  // Checked before anything is sized or followed from them : build() writes
+  // max_links0 = 2M, and an entry point on the top layer unless the table is empty
+  const int64_t n_rows = header[0];
+  M = header[2];
+  max_links0 = header[3];
+  ef_construction = header[4];
+  entry_point = header[5];
+  max_level = header[6];
+  const bool is_empty = (n_rows == 0 && entry_point == -1 && max_level == -1);
+  if (M < 2 || M > HNSW_MAX_M || max_links0 != 2 * M || ef_construction <= 0
+      || (!is_empty && (entry_point < 0 || entry_point >= n_rows || max_level < 0 || max_level > HNSW_MAX_LEVEL))) {
+    std::cout << path << " is not a valid index." << std::endl;
+    return false;
+  }
+  levels.resize(n_rows);
+  links0.resize(n_rows * (1 + max_links0));
+  links_upper.assign(n_rows, std::vector<int32_t>());
+  fin.read(reinterpret_cast<char*>(levels.data()), levels.size() * sizeof(int32_t));
+  fin.read(reinterpret_cast<char*>(links0.data()), links0.size() * sizeof(int32_t));
+  for (int64_t id=0; id<n_rows && fin; id++) {
+    if (levels[id] < 0 || levels[id] > max_level) break;
+    links_upper[id].resize(levels[id] * (1 + M));
+    fin.read(reinterpret_cast<char*>(links_upper[id].data()), links_upper[id].size() * sizeof(int32_t));
+  }
+  if (!fin || !is_valid_graph()) {
+    std::cout << path << " is not a valid index." << std::endl;
+    levels.clear();
+    links0.clear();
+    links_upper.clear();
+    return false;
+  }
+  return true;
+}
+
+// Every row is on the layers its level says, the entry point on the top one, and
+// every list of links fits its slot and points to rows of the table
+bool HnswIndex::is_valid_graph() const
+{
+  const int64_t n_rows = levels.size();
+  if (n_rows > 0 && levels[entry_point] != max_level) return false;
+  for (int64_t id=0; id<n_rows; id++) {
+    if (levels[id] < 0 || levels[id] > max_level) return false;
+    for (int64_t level=0; level<=levels[id]; level++) {
+      const int32_t* l = links(id, level);
+      if (l[0] < 0 || l[0] > ((level == 0) ? max_links0 : M)) return false;
+      for (int64_t i=1; i<=l[0]; i++) {
+        if (l[i] < 0 || l[i] >= n_rows || levels[l[i]] < level) return false;
+      }
+    }
+  }
+  return true;
+}
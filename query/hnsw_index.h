@@ -0,0 +1,133 @@
+#ifndef HNSW_INDEX_H
+#define HNSW_INDEX_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "embedding_table.h"
+#include "exact_search.h"
+
+#define HNSW_MAGIC "WNEHNSW1"
+// Bounds of a loaded index; levels above 64 have probability M^-64
+#define HNSW_MAX_M 4096
+#define HNSW_MAX_LEVEL 64
+
+// Marks the rows already reached by one search, cleared in O(1) between searches
+class VisitedSet {
+private:
+  std::vector<uint32_t> marks;
+  uint32_t mark;
+
+public:
+  explicit VisitedSet(const int64_t n) : marks(n, 0), mark(0) {}
+
+  void clear()
+  {
+    if (++mark == 0) {
+      std::fill(marks.begin(), marks.end(), 0);
+      mark = 1;
+    }
+  }
+  // true the first time `id` is visited since clear()
+  bool visit(const int64_t id)
+  {
+    if (marks[id] == mark) return false;
+    marks[id] = mark;
+    return true;
+  }
+};
+
+// Hierarchical navigable small world graph (Malkov and Yashunin, 2016) over the rows of
+// an EmbeddingTable, for approximate cosine top-k. Every layer links each row to at most
+// M (2M on the bottom layer) neighbours chosen with the diversity heuristic of the paper.
+// The graph is saved with the size and a hash of the words of the table it was built
+// on, and can only be loaded back with that table.
+class HnswIndex {
+private:
+  const EmbeddingTable& table;
+  const int64_t dim;
+  int64_t M;
+  int64_t max_links0;
+  int64_t ef_construction;
+  int64_t entry_point;
+  int64_t max_level;
+
+  std::vector<int32_t> levels;
+  // Bottom layer : for each row, the number of links and max_links0 ids
+  std::vector<int32_t> links0;
+  // Layers 1 to levels[id] of row id, each as the number of links and M ids
+  std::vector<std::vector<int32_t>> links_upper;
+
+  // Guard the links of each row and the entry point while building
+  std::unique_ptr<std::mutex[]> mtx_links;
+  std::mutex mtx_entry;
+  bool is_building;
+
+public:
+  explicit HnswIndex(const EmbeddingTable& _table);
+  ~HnswIndex();
+
+  // Inserts the rows with n_threads threads; the graph only depends on `seed` with one thread
+  void build(const int64_t _M, const int64_t _ef_construction, const int64_t seed, const int64_t n_threads);
+  // Top-k of a unit-length query, leaving out row id_excluded (-1 for none).
+  // A larger ef_search (at least k) trades speed for recall.
+  void search(const float* query,
+              const int64_t k,
+              const int64_t ef_search,
+              const int64_t id_excluded,
+              VisitedSet& visited,
+              std::vector<Neighbor>& result) const;
+
+  bool save(const std::string path) const;
+  bool load(const std::string path);
+
+  bool empty() const { return levels.empty(); }
+  int64_t get_M() const { return M; }
+  int64_t get_max_level() const { return max_level; }
+
+private:
+  int32_t* links(const int64_t id, const int64_t level);
+  const int32_t* links(const int64_t id, const int64_t level) const;
+  float similarity(const float* query, const int64_t id) const
+  {
+    return dot(query, table.row(id), dim) * table.inverse_norm(id);
+  }
+  float similarity_rows(const int64_t a, const int64_t b) const
+  {
+    return dot(table.row(a), table.row(b), dim) * table.inverse_norm(a) * table.inverse_norm(b);
+  }
+
+  void insert(const int64_t id, VisitedSet& visited, std::vector<float>& query);
+  int64_t search_greedy(const float* query, int64_t id_entry, const int64_t level_top, const int64_t level_bottom) const;
+  // Up to ef rows of `level` closest to query, most similar first
+  void search_layer(const float* query,
+                    const int64_t id_entry,
+                    const int64_t ef,
+                    const int64_t level,
+                    VisitedSet& visited,
+                    std::vector<Neighbor>& found) const;
+  // Keeps at most m of `candidates` (most similar first), skipping those closer to a
+  // neighbour already kept than to the row itself
+  void select_neighbors(std::vector<Neighbor>& candidates, const int64_t m) const;
+  void link(const int64_t id, const int64_t level, const std::vector<Neighbor>& neighbors);
+  void read_links(const int64_t id, const int64_t level, std::vector<int32_t>& out) const;
+  bool is_valid_graph() const;
+
+  HnswIndex(const HnswIndex&);
+  HnswIndex& operator=(const HnswIndex&);
+};
+
+#endif
@@ -0,0 +1,277 @@
+/*
+    Nearest neighbours of words in the embeddings of 5_SGNS_WNE
+*/
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <locale>
+#include <cstdint>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+#include "cmdline.h"
+#include "embedding_table.h"
+#include "exact_search.h"
+#include "hnsw_index.h"
+#include "query_engine.h"
+
+static std::vector<int64_t> parse_list(const std::string list)
+{
+  std::vector<int64_t> values;
+  std::istringstream iss(list);
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    const int64_t n = std::atoll(item.c_str());
+    if (n > 0) values.push_back(n);
+  }
+  return values;
+}
+
+static double percentile(std::vector<double> values, const double p)
+{
+  if (values.empty()) return 0;
+  const int64_t i = std::min<int64_t>(values.size() - 1, static_cast<int64_t>(p * values.size()));
+  std::nth_element(values.begin(), values.begin() + i, values.end());
+  return values[i];
+}
+
+// Recall@k and latency of the index against exact search, for queries sampled from the table
+static void run_benchmark(const EmbeddingTable& table,
+                          const QueryEngine& engine,
+                          const int64_t n_queries,
+                          const int64_t k,
+                          const std::vector<int64_t>& list_ef_search,
+                          const std::vector<int64_t>& threads,
+                          const int64_t seed)
+{
+  std::vector<int64_t> ids(table.size());
+  std::iota(ids.begin(), ids.end(), 0);
+  std::mt19937_64 engine_random(seed);
+  std::shuffle(ids.begin(), ids.end(), engine_random);
+  ids.resize(std::min<int64_t>(n_queries, ids.size()));
+  std::vector<float> queries;
+  engine.queries_of_rows(ids, queries);
+
+  std::cout << std::endl << "###### Benchmark : " << ids.size() << " queries, k = " << k << " ######" << std::endl;
+  std::cout << std::right << std::setw(6) << "method" << std::setw(10) << "ef_search" << std::setw(9) << "threads"
+            << std::setw(11) << "recall@k" << std::setw(11) << "mean (ms)" << std::setw(10) << "p50 (ms)"
+            << std::setw(10) << "p99 (ms)" << std::setw(12) << "queries/sec" << std::endl;
+
+  std::vector<std::vector<Neighbor>> results_exact;
+  auto measure = [&](const bool is_exact, const int64_t ef_search, const int64_t n_threads) {
+    std::vector<std::vector<Neighbor>> results;
+    std::vector<double> latencies;
+    const auto t1 = std::chrono::steady_clock::now();
+    engine.search(queries, ids, is_exact, k, ef_search, n_threads, results, &latencies);
+    const auto t2 = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(t2 - t1).count();
+    if (is_exact && results_exact.empty()) results_exact = results;
+
+    int64_t n_found = 0;
+    int64_t n_relevant = 0;
+    for (int64_t i=0; i<ids.size(); i++) {
+      std::unordered_set<int64_t> relevant;
+      for (const Neighbor& n : results_exact[i]) relevant.insert(n.id);
+      for (const Neighbor& n : results[i]) n_found += relevant.count(n.id);
+      n_relevant += relevant.size();
+    }
+    const double mean = std::accumulate(latencies.begin(), latencies.end(), 0.0) / std::max<int64_t>(1, latencies.size());
+
+    std::cout << std::setw(6) << (is_exact ? "exact" : "hnsw");
+    if (is_exact) std::cout << std::setw(10) << "-";
+    else std::cout << std::setw(10) << ef_search;
+    std::cout << std::setw(9) << n_threads
+              << std::fixed << std::setprecision(4) << std::setw(11) << n_found / std::max<double>(1, n_relevant)
+              << std::setprecision(3) << std::setw(11) << 1000 * mean
+              << std::setw(10) << 1000 * percentile(latencies, 0.5)
+              << std::setw(10) << 1000 * percentile(latencies, 0.99)
+              << std::setprecision(0) << std::setw(12) << ids.size() / std::max(1e-9, seconds) << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+  };
+
+  for (const int64_t n_threads : threads) measure(true, 0, n_threads);
+  for (const int64_t ef_search : list_ef_search) {
+    for (const int64_t n_threads : threads) measure(false, ef_search, n_threads);
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  // parsing parameters with https://github.com/tanakh/cmdline
+  cmdline::parser a;
+  a.add<std::string>("embedding_path", '\0', "embeddings saved by 5_SGNS_WNE", true);
+  a.add<std::string>("embedding_format", '\0', "format of the embeddings (text, binary, npy, int8 or pq)", false, "text");
+  a.add<std::string>("index_path", '\0', "HNSW index, loaded unless --build_index is given", false);
+  a.add("build_index", '\0', "build the HNSW index and save it to --index_path");
+  a.add<std::string>("method", '\0', "search method (hnsw or exact)", false, "hnsw");
+
+  a.add<std::string>("query", '\0', "query word", false);
+  a.add<std::string>("query_path", '\0', "file of query words, one per line", false);
+  a.add<std::string>("output_path", '\0', "TSV of the neighbours (query, rank, word, similarity); stdout by default", false);
+  a.add<int64_t>("k", '\0', "neighbours per query", false, 10);
+  a.add<int64_t>("n_cores", '\0', "n_cores", false, 1);
+
+  a.add<int64_t>("M", '\0', "links per row and layer of the index", false, 16);
+  a.add<int64_t>("ef_construction", '\0', "candidates per insertion while building the index", false, 200);
+  a.add<int64_t>("ef_search", '\0', "candidates per query of the index", false, 64);
+  a.add<int64_t>("seed", '\0', "seed", false, 2018);
+
+  a.add("benchmark", '\0', "compare recall@k and latency of the index with exact search");
+  a.add<int64_t>("n_benchmark_query", '\0', "queries sampled from the embeddings for --benchmark", false, 1000);
+  a.add<std::string>("ef_search_list", '\0', "comma-separated ef_search of --benchmark", false, "16,32,64,128,256");
+  a.add<std::string>("threads", '\0', "comma-separated thread counts of --benchmark", false, "1,2,4,8");
+  a.parse_check(argc, argv);
+
+  std::string embedding_path = a.get<std::string>("embedding_path");
+  std::string embedding_format = a.get<std::string>("embedding_format");
+  std::string index_path = a.get<std::string>("index_path");
+  bool build_index = a.exist("build_index");
+  std::string method = a.get<std::string>("method");
+
+  std::string query = a.get<std::string>("query");
+  std::string query_path = a.get<std::string>("query_path");
+  std::string output_path = a.get<std::string>("output_path");
+  int64_t k = a.get<int64_t>("k");
+  int64_t n_cores = a.get<int64_t>("n_cores");
+
+  int64_t M = a.get<int64_t>("M");
+  int64_t ef_construction = a.get<int64_t>("ef_construction");
+  int64_t ef_search = a.get<int64_t>("ef_search");
+  int64_t seed = a.get<int64_t>("seed");
+
+  bool benchmark = a.exist("benchmark");
+  int64_t n_benchmark_query = a.get<int64_t>("n_benchmark_query");
+  std::vector<int64_t> list_ef_search = parse_list(a.get<std::string>("ef_search_list"));
+  std::vector<int64_t> threads = parse_list(a.get<std::string>("threads"));
+
+  if (method != "hnsw" && method != "exact") {
+    std::cout << "Invalid method." << std::endl;
+    return 0;
+  }
+  if (k <= 0 || n_cores <= 0 || M <= 1 || ef_construction <= 0 || ef_search <= 0) {
+    std::cout << "--k, --n_cores, --ef_construction and --ef_search must be positive and --M above 1." << std::endl;
+    return 0;
+  }
+  if (build_index && index_path.empty()) {
+    std::cout << "--build_index needs --index_path." << std::endl;
+    return 0;
+  }
+
+  // Load embeddings
+  EmbeddingTable table;
+  if (!table.load(embedding_path, embedding_format, n_cores)) {
+    std::cout << "Invalid file name." << std::endl;
+    return 0;
+  }
+  std::cout << "Loaded " << table.size() << " embeddings of dimension " << table.get_dim() << std::endl;
+  if (table.is_quantized() && (method == "hnsw" || benchmark)) {
+    std::cout << "Quantized embeddings only support --method=exact without --benchmark." << std::endl;
+    return 0;
+  }
+
+  // Build or load the index
+  HnswIndex index(table);
+  if (method == "hnsw" || benchmark) {
+    if (build_index || index_path.empty()) {
+      std::cout << "Building index" << std::endl;
+      const auto t1 = std::chrono::steady_clock::now();
+      index.build(M, ef_construction, seed, n_cores);
+      const auto t2 = std::chrono::steady_clock::now();
+      std::cout << "Building index took " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count()
+                << " milliseconds, " << index.get_max_level() + 1 << " layers" << std::endl;
+      if (!index_path.empty()) {
+        std::cout << "Saving index to " << index_path << std::endl;
+        if (!index.save(index_path)) {
+          std::cout << "Invalid file name." << std::endl;
+          return 0;
+        }
+        std::cout << "Done" << std::endl;
+      }
+    } else if (!index.load(index_path)) {
+      std::cout << "Invalid file name." << std::endl;
+      return 0;
+    }
+  }
+  QueryEngine engine(table, &index);
+
+  if (benchmark) {
+    if (list_ef_search.empty() || threads.empty() || n_benchmark_query <= 0) {
+      std::cout << "Invalid benchmark settings." << std::endl;
+      return 0;
+    }
+    run_benchmark(table, engine, n_benchmark_query, k, list_ef_search, threads, seed);
+    return 0;
+  }
+
+  // Read query words
+  std::vector<std::string> words;
+  if (!query.empty()) words.push_back(query);
+  if (!query_path.empty()) {
+    std::ifstream fin(query_path);
+    if (!fin.is_open()) {
+      std::cout << "Invalid file name." << std::endl;
+      return 0;
+    }
+    std::string line;
+    while (std::getline(fin, line)) {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (!line.empty()) words.push_back(line);
+    }
+  }
+  std::vector<std::string> words_found;
+  std::vector<int64_t> ids;
+  for (const std::string& word : words) {
+    const int64_t id = table.find(word);
+    if (id < 0) {
+      std::cout << "Unknown word : " << word << std::endl;
+      continue;
+    }
+    words_found.push_back(word);
+    ids.push_back(id);
+  }
+  if (ids.empty()) {
+    std::cout << "No query." << std::endl;
+    return 0;
+  }
+
+  // Search
+  std::vector<float> queries;
+  std::vector<std::vector<Neighbor>> results;
+  engine.queries_of_rows(ids, queries);
+  const auto t1 = std::chrono::steady_clock::now();
+  engine.search(queries, ids, method == "exact", k, ef_search, n_cores, results, nullptr);
+  const auto t2 = std::chrono::steady_clock::now();
+  std::cout << ids.size() << " queries took "
+            << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() << " microseconds" << std::endl;
+
+  std::ofstream fout;
+  if (!output_path.empty()) {
+    fout.open(output_path, std::ios::binary | std::ios::trunc);
+    if (!fout.is_open()) {
+      std::cout << "Invalid file name." << std::endl;
+      return 0;
+    }
+    std::cout << "Saving neighbours to " << output_path << std::endl;
+  }
+  std::ostream& out = output_path.empty() ? std::cout : fout;
+  out.imbue(std::locale::classic());
+  out << std::setprecision(6);
+  out << "query\trank\tword\tsimilarity\n";
+  for (int64_t i=0; i<ids.size(); i++) {
+    for (int64_t r=0; r<results[i].size(); r++) {
+      out << words_found[i] << '\t' << r + 1 << '\t' << table.word(results[i][r].id) << '\t' << results[i][r].similarity << '\n';
+    }
+  }
+  out.flush();
+  if (!output_path.empty()) std::cout << "Done" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include "query_engine.h"
+
+QueryEngine::QueryEngine(const EmbeddingTable& _table, const HnswIndex* _index)
+  : table(_table),
+    index(_index)
+{
+}
+
+QueryEngine::~QueryEngine() {}
+
+void QueryEngine::search(const std::vector<float>& queries,
+                         const std::vector<int64_t>& ids_excluded,
+                         const bool is_exact,
+                         const int64_t k,
+                         const int64_t ef_search,
+                         const int64_t n_threads,
+                         std::vector<std::vector<Neighbor>>& results,
+                         std::vector<double>* latencies) const
+{
+  assert(is_exact || index != nullptr);
+  assert(n_threads > 0);
+  const int64_t dim = table.get_dim();
+  const int64_t n_queries = ids_excluded.size();
+  assert(queries.size() == n_queries * dim);
+  results.assign(n_queries, std::vector<Neighbor>());
+  if (latencies != nullptr) latencies->assign(n_queries, 0);
+
+  std::atomic<int64_t> begin_next(0);
+  auto worker = [&]() {
+    VisitedSet visited(is_exact ? 0 : table.size());
+    std::vector<std::vector<Neighbor>> results_tile;
+    for (int64_t begin=begin_next.fetch_add(SIZE_TILE_QUERY); begin<n_queries;
+         begin=begin_next.fetch_add(SIZE_TILE_QUERY)) {
+      const int64_t end = std::min<int64_t>(begin + SIZE_TILE_QUERY, n_queries);
+      if (is_exact) {
+        const auto t1 = std::chrono::steady_clock::now();
+        search_exact(table, queries.data() + begin * dim, end - begin, ids_excluded.data() + begin, k, results_tile);
+        const auto t2 = std::chrono::steady_clock::now();
+        for (int64_t i=begin; i<end; i++) {
+          results[i].swap(results_tile[i - begin]);
+          if (latencies != nullptr) (*latencies)[i] = std::chrono::duration<double>(t2 - t1).count();
+        }
+      } else {
+        for (int64_t i=begin; i<end; i++) {
+          const auto t1 = std::chrono::steady_clock::now();
+          index->search(queries.data() + i * dim, k, ef_search, ids_excluded[i], visited, results[i]);
+          const auto t2 = std::chrono::steady_clock::now();
+          if (latencies != nullptr) (*latencies)[i] = std::chrono::duration<double>(t2 - t1).count();
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> vector_threads(std::min<int64_t>(n_threads, (n_queries + SIZE_TILE_QUERY - 1) / SIZE_TILE_QUERY));
+  for (auto& t : vector_threads) t = std::thread(worker);
+  for (auto& t : vector_threads) t.join();
+}
+
+void QueryEngine::queries_of_rows(const std::vector<int64_t>& ids, std::vector<float>& queries) const
+{
+  const int64_t dim = table.get_dim();
+  queries.resize(ids.size() * dim);
+  for (int64_t i=0; i<ids.size(); i++) table.normalized_row(ids[i], queries.data() + i * dim);
+}
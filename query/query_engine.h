@@ -0,0 +1,44 @@
+#ifndef QUERY_ENGINE_H
+#define QUERY_ENGINE_H
+
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "embedding_table.h"
+#include "exact_search.h"
+#include "hnsw_index.h"
+
+// Answers a batch of queries with several threads, each taking SIZE_TILE_QUERY queries
+// at a time, by exact search or through an HnswIndex
+class QueryEngine {
+private:
+  const EmbeddingTable& table;
+  const HnswIndex* index;
+
+public:
+  // `index` may be nullptr for exact search only
+  QueryEngine(const EmbeddingTable& _table, const HnswIndex* _index);
+  ~QueryEngine();
+
+  // `queries` holds one unit-length query per table.get_dim() floats.
+  // If `latencies` is given, it gets the seconds each query took; the queries of a
+  // tile of an exact search are answered together and share the time of the tile.
+  void search(const std::vector<float>& queries,
+              const std::vector<int64_t>& ids_excluded,
+              const bool is_exact,
+              const int64_t k,
+              const int64_t ef_search,
+              const int64_t n_threads,
+              std::vector<std::vector<Neighbor>>& results,
+              std::vector<double>* latencies) const;
+
+  // Unit-length queries of the rows `ids`, which are left out of their own results
+  void queries_of_rows(const std::vector<int64_t>& ids, std::vector<float>& queries) const;
+};
+
+#endif
@@ -0,0 +1,21 @@
+#!/bin/bash
+set -e
+EMBEDDINGS="../data/embeddings.txt"
+INDEX="../data/embeddings.hnsw"
+make
+./main --embedding_path=$EMBEDDINGS \
+       --embedding_format=text \
+       --index_path=$INDEX \
+       --build_index \
+       --M=16 \
+       --ef_construction=200 \
+       --n_cores=8 \
+       --benchmark
+./main --embedding_path=$EMBEDDINGS \
+       --embedding_format=text \
+       --index_path=$INDEX \
+       --query_path=../data/queries.txt \
+       --output_path=../data/neighbours.tsv \
+       --k=10 \
+       --ef_search=64 \
+       --n_cores=8